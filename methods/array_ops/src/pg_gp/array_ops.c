@@ -71,6 +71,13 @@ Datum array_fill(PG_FUNCTION_ARGS);
 Datum array_scalar_mult(PG_FUNCTION_ARGS);
 Datum array_sqrt(PG_FUNCTION_ARGS);
 Datum array_normalize(PG_FUNCTION_ARGS);
+Datum array_agg_sum_transition(PG_FUNCTION_ARGS);
+Datum array_agg_sum_merge(PG_FUNCTION_ARGS);
+Datum array_agg_sum_final(PG_FUNCTION_ARGS);
+Datum array_agg_mean_final(PG_FUNCTION_ARGS);
+Datum array_agg_variance_transition(PG_FUNCTION_ARGS);
+Datum array_agg_variance_merge(PG_FUNCTION_ARGS);
+Datum array_agg_variance_final(PG_FUNCTION_ARGS);
 
 
 PG_FUNCTION_INFO_V1(array_of_float);
@@ -419,6 +426,188 @@ char* element_sqrt(Datum elt1, Datum elt2, Oid element_type, char* result){
 }
 
 
+/*
+Type-specialized fast paths
+
+The General_* functions fetch and align every element and dispatch on the element type for every element. For the
+common element types float8, float4, int4 and int8, an array without nulls is a plain C array starting at
+ARR_DATA_PTR (the element size is a multiple of the alignment, so there is no padding). The kernels below operate
+directly on this data with simple loops that the compiler can vectorize. Arrays of other types or with nulls take the
+generic path.
+
+The dot product uses four partial sums, so that it can be vectorized without reassociation by the compiler.
+*/
+
+typedef enum {
+	ARRAY_OP_ADD,
+	ARRAY_OP_SUB,
+	ARRAY_OP_MULT
+} ArrayOp;
+
+#define DEFINE_ARRAY_KERNELS(ctype, suffix) \
+static void kernel_add_##suffix(const ctype *x, const ctype *y, ctype *z, int n){ \
+	int i; \
+	for (i = 0; i < n; i++) \
+		z[i] = x[i] + y[i]; \
+} \
+static void kernel_sub_##suffix(const ctype *x, const ctype *y, ctype *z, int n){ \
+	int i; \
+	for (i = 0; i < n; i++) \
+		z[i] = x[i] - y[i]; \
+} \
+static void kernel_mult_##suffix(const ctype *x, const ctype *y, ctype *z, int n){ \
+	int i; \
+	for (i = 0; i < n; i++) \
+		z[i] = x[i] * y[i]; \
+} \
+static void kernel_scalar_mult_##suffix(const ctype *x, ctype k, ctype *z, int n){ \
+	int i; \
+	for (i = 0; i < n; i++) \
+		z[i] = x[i] * k; \
+} \
+static float8 kernel_dot_##suffix(const ctype *x, const ctype *y, int n){ \
+	float8 s0 = 0, s1 = 0, s2 = 0, s3 = 0; \
+	int i; \
+	for (i = 0; i + 4 <= n; i += 4){ \
+		s0 += (float8) x[i] * y[i]; \
+		s1 += (float8) x[i + 1] * y[i + 1]; \
+		s2 += (float8) x[i + 2] * y[i + 2]; \
+		s3 += (float8) x[i + 3] * y[i + 3]; \
+	} \
+	for (; i < n; i++) \
+		s0 += (float8) x[i] * y[i]; \
+	return (s0 + s1) + (s2 + s3); \
+} \
+static void kernel_binary_##suffix(const char *x, const char *y, char *z, int n, ArrayOp op){ \
+	switch(op){ \
+		case ARRAY_OP_ADD: \
+			kernel_add_##suffix((const ctype *) x, (const ctype *) y, (ctype *) z, n);break; \
+		case ARRAY_OP_SUB: \
+			kernel_sub_##suffix((const ctype *) x, (const ctype *) y, (ctype *) z, n);break; \
+		case ARRAY_OP_MULT: \
+			kernel_mult_##suffix((const ctype *) x, (const ctype *) y, (ctype *) z, n);break; \
+	} \
+}
+
+DEFINE_ARRAY_KERNELS(float8, float8)
+DEFINE_ARRAY_KERNELS(float4, float4)
+DEFINE_ARRAY_KERNELS(int32, int4)
+DEFINE_ARRAY_KERNELS(int64, int8)
+
+/*
+ * Whether an array can take the fast path
+ */
+static bool fast_path_applies(ArrayType *v){
+	if (ARR_NDIM(v) == 0 || ARR_HASNULL(v))
+		return false;
+	switch(ARR_ELEMTYPE(v)){
+		case FLOAT8OID:
+		case FLOAT4OID:
+		case INT4OID:
+		case INT8OID:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/*
+ * Whether two arrays can take the fast path together. Arrays of different
+ * shape take the generic path, which raises the appropriate error.
+ */
+static bool fast_path_applies2(ArrayType *v1, ArrayType *v2){
+	int ndims = ARR_NDIM(v1);
+	
+	if (!fast_path_applies(v1) || !fast_path_applies(v2))
+		return false;
+	if (ARR_NDIM(v2) != ndims || ARR_ELEMTYPE(v1) != ARR_ELEMTYPE(v2))
+		return false;
+	return memcmp(ARR_DIMS(v1), ARR_DIMS(v2), ndims * sizeof(int)) == 0
+		&& memcmp(ARR_LBOUND(v1), ARR_LBOUND(v2), ndims * sizeof(int)) == 0;
+}
+
+/*
+ * Allocate an array without nulls of the same shape and element type as v.
+ * The data is left for the caller to fill in. The memory is zeroed so that
+ * the alignment padding after the header is deterministic, just as with
+ * construct_md_array().
+ */
+static ArrayType *fast_path_alloc_like(ArrayType *v, int *nitems){
+	ArrayType *result;
+	int ndims = ARR_NDIM(v);
+	int elmlen = get_typlen(ARR_ELEMTYPE(v));
+	Size nbytes;
+	
+	*nitems = ArrayGetNItems(ndims, ARR_DIMS(v));
+	nbytes = ARR_OVERHEAD_NONULLS(ndims) + (Size) (*nitems) * elmlen;
+	result = (ArrayType *) palloc0(nbytes);
+	SET_VARSIZE(result, nbytes);
+	result->ndim = ndims;
+	result->dataoffset = 0;
+	result->elemtype = ARR_ELEMTYPE(v);
+	memcpy(ARR_DIMS(result), ARR_DIMS(v), ndims * sizeof(int));
+	memcpy(ARR_LBOUND(result), ARR_LBOUND(v), ndims * sizeof(int));
+	return result;
+}
+
+static Datum Fast_2Array_to_Array(ArrayType *v1, ArrayType *v2, ArrayOp op){
+	int nitems;
+	ArrayType *result = fast_path_alloc_like(v1, &nitems);
+	const char *x = ARR_DATA_PTR(v1);
+	const char *y = ARR_DATA_PTR(v2);
+	char *z = ARR_DATA_PTR(result);
+	
+	switch(ARR_ELEMTYPE(v1)){
+		case FLOAT8OID:
+			kernel_binary_float8(x, y, z, nitems, op);break;
+		case FLOAT4OID:
+			kernel_binary_float4(x, y, z, nitems, op);break;
+		case INT4OID:
+			kernel_binary_int4(x, y, z, nitems, op);break;
+		case INT8OID:
+			kernel_binary_int8(x, y, z, nitems, op);break;
+	}
+	PG_RETURN_ARRAYTYPE_P(result);
+}
+
+static Datum Fast_Array_Scalar_Mult(ArrayType *v, Datum k){
+	int nitems;
+	ArrayType *result = fast_path_alloc_like(v, &nitems);
+	const char *x = ARR_DATA_PTR(v);
+	char *z = ARR_DATA_PTR(result);
+	
+	switch(ARR_ELEMTYPE(v)){
+		case FLOAT8OID:
+			kernel_scalar_mult_float8((const float8 *) x, DatumGetFloat8(k), (float8 *) z, nitems);break;
+		case FLOAT4OID:
+			kernel_scalar_mult_float4((const float4 *) x, DatumGetFloat4(k), (float4 *) z, nitems);break;
+		case INT4OID:
+			kernel_scalar_mult_int4((const int32 *) x, DatumGetInt32(k), (int32 *) z, nitems);break;
+		case INT8OID:
+			kernel_scalar_mult_int8((const int64 *) x, DatumGetInt64(k), (int64 *) z, nitems);break;
+	}
+	PG_RETURN_ARRAYTYPE_P(result);
+}
+
+static Datum Fast_Array_Dot(ArrayType *v1, ArrayType *v2){
+	int nitems = ArrayGetNItems(ARR_NDIM(v1), ARR_DIMS(v1));
+	const char *x = ARR_DATA_PTR(v1);
+	const char *y = ARR_DATA_PTR(v2);
+	float8 result = 0;
+	
+	switch(ARR_ELEMTYPE(v1)){
+		case FLOAT8OID:
+			result = kernel_dot_float8((const float8 *) x, (const float8 *) y, nitems);break;
+		case FLOAT4OID:
+			result = kernel_dot_float4((const float4 *) x, (const float4 *) y, nitems);break;
+		case INT4OID:
+			result = kernel_dot_int4((const int32 *) x, (const int32 *) y, nitems);break;
+		case INT8OID:
+			result = kernel_dot_int8((const int64 *) x, (const int64 *) y, nitems);break;
+	}
+	PG_RETURN_FLOAT8(result);
+}
+
 PG_FUNCTION_INFO_V1(array_stddev);
 Datum array_stddev(PG_FUNCTION_ARGS){
 	ArrayType *v;
@@ -541,7 +730,10 @@ Datum array_dot(PG_FUNCTION_ARGS){
 	v1 = PG_GETARG_ARRAYTYPE_P(0);
 	v2 = PG_GETARG_ARRAYTYPE_P(1);
 	
-	res = General_2Array_to_Element(v1, v2, element_dot, noop_finalize, 1);
+	if (fast_path_applies2(v1, v2))
+		res = Fast_Array_Dot(v1, v2);
+	else
+		res = General_2Array_to_Element(v1, v2, element_dot, noop_finalize, 1);
 	
 	PG_FREE_IF_COPY(v1, 0);
 	PG_FREE_IF_COPY(v2, 1);
@@ -589,7 +781,10 @@ Datum array_add(PG_FUNCTION_ARGS){
 	v1 = PG_GETARG_ARRAYTYPE_P(0);
 	v2 = PG_GETARG_ARRAYTYPE_P(1);
 	
-	res = General_2Array_to_Array(v1, v2, element_add);
+	if (fast_path_applies2(v1, v2))
+		res = Fast_2Array_to_Array(v1, v2, ARRAY_OP_ADD);
+	else
+		res = General_2Array_to_Array(v1, v2, element_add);
 	
 	PG_FREE_IF_COPY(v1, 0);
 	PG_FREE_IF_COPY(v2, 1);
@@ -611,7 +806,10 @@ Datum array_sub(PG_FUNCTION_ARGS){
 	v1 = PG_GETARG_ARRAYTYPE_P(0);
 	v2 = PG_GETARG_ARRAYTYPE_P(1);
 	
-	res = General_2Array_to_Array(v1, v2, element_sub);
+	if (fast_path_applies2(v1, v2))
+		res = Fast_2Array_to_Array(v1, v2, ARRAY_OP_SUB);
+	else
+		res = General_2Array_to_Array(v1, v2, element_sub);
 	
 	PG_FREE_IF_COPY(v1, 0);
 	PG_FREE_IF_COPY(v2, 1);
@@ -633,7 +831,10 @@ Datum array_mult(PG_FUNCTION_ARGS){
 	v1 = PG_GETARG_ARRAYTYPE_P(0);
 	v2 = PG_GETARG_ARRAYTYPE_P(1);
 	
-	res = General_2Array_to_Array(v1, v2, element_mult);
+	if (fast_path_applies2(v1, v2))
+		res = Fast_2Array_to_Array(v1, v2, ARRAY_OP_MULT);
+	else
+		res = General_2Array_to_Array(v1, v2, element_mult);
 	
 	PG_FREE_IF_COPY(v1, 0);
 	PG_FREE_IF_COPY(v2, 1);
@@ -697,7 +898,10 @@ Datum array_scalar_mult(PG_FUNCTION_ARGS){
 	v1 = PG_GETARG_ARRAYTYPE_P(0);
 	v2 = PG_GETARG_DATUM(1);
 	
-	res = General_Array_to_Array(v1, v2, element_mult);
+	if (fast_path_applies(v1))
+		res = Fast_Array_Scalar_Mult(v1, v2);
+	else
+		res = General_Array_to_Array(v1, v2, element_mult);
 	
 	PG_FREE_IF_COPY(v1, 0);
 	return(res);
@@ -1251,3 +1455,243 @@ Datum array_normalize(PG_FUNCTION_ARGS)
 	}	
 
 }
+
+
+/*
+Elementwise aggregates over float8 arrays
+
+The transition state is a single float8 array that is updated in place. When called as an aggregate, PostgreSQL passes
+the state from the aggregate memory context, and returning the same pointer avoids any copy. So there is only one
+allocation per group (in the first call), instead of one new result array per row as with array_add.
+
+array_agg_sum and array_agg_mean share the state (sum_1, ..., sum_n, count). The state of array_agg_variance is
+(mean_1, ..., mean_n, m2_1, ..., m2_n, count), where m2_i is the corrected sum of squares. It is updated with Welford's
+method and merged with the formula by Chan, Golub, and LeVeque, which are numerically stable.
+*/
+
+/*
+ * Return the transition state for destructive updates
+ */
+static ArrayType *agg_get_state(FunctionCallInfo fcinfo, int argno){
+	if (fcinfo->context && IsA(fcinfo->context, AggState))
+		return PG_GETARG_ARRAYTYPE_P(argno);
+	return PG_GETARG_ARRAYTYPE_P_COPY(argno);
+}
+
+/*
+ * Allocate a zero-initialized one-dimensional float8 array
+ */
+static ArrayType *agg_alloc_state(int n){
+	Size nbytes = ARR_OVERHEAD_NONULLS(1) + (Size) n * sizeof(float8);
+	ArrayType *result = (ArrayType *) palloc0(nbytes);
+	
+	SET_VARSIZE(result, nbytes);
+	result->ndim = 1;
+	result->dataoffset = 0;
+	result->elemtype = FLOAT8OID;
+	ARR_DIMS(result)[0] = n;
+	ARR_LBOUND(result)[0] = 1;
+	return result;
+}
+
+/*
+ * Return the number of elements of an input array, which must not contain nulls
+ */
+static int agg_input_size(ArrayType *x, const char *func){
+	if (ARR_HASNULL(x))
+		ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), 
+						errmsg("%s: arrays cannot contain nulls", func)));
+	return ArrayGetNItems(ARR_NDIM(x), ARR_DIMS(x));
+}
+
+/*
+ * Check that a state has the expected number of elements
+ */
+static void agg_check_state_size(ArrayType *state, int expected, const char *func){
+	int size = ArrayGetNItems(ARR_NDIM(state), ARR_DIMS(state));
+	
+	if (size != expected)
+		ereport(ERROR, (errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR), 
+						errmsg("%s: all arrays must have the same length", func)));
+}
+
+PG_FUNCTION_INFO_V1(array_agg_sum_transition);
+Datum array_agg_sum_transition(PG_FUNCTION_ARGS){
+	ArrayType *state;
+	ArrayType *x;
+	float8 *sum;
+	const float8 *values;
+	int n;
+	
+	if (PG_ARGISNULL(1)){
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+	
+	x = PG_GETARG_ARRAYTYPE_P(1);
+	n = agg_input_size(x, "array_agg_sum_transition");
+	if (PG_ARGISNULL(0)){
+		state = agg_alloc_state(n + 1);
+	}else{
+		state = agg_get_state(fcinfo, 0);
+		agg_check_state_size(state, n + 1, "array_agg_sum_transition");
+	}
+	
+	sum = (float8 *) ARR_DATA_PTR(state);
+	values = (const float8 *) ARR_DATA_PTR(x);
+	for (int i = 0; i < n; i++)
+		sum[i] += values[i];
+	sum[n] += 1;
+	
+	PG_RETURN_ARRAYTYPE_P(state);
+}
+
+PG_FUNCTION_INFO_V1(array_agg_sum_merge);
+Datum array_agg_sum_merge(PG_FUNCTION_ARGS){
+	ArrayType *state1;
+	ArrayType *state2;
+	float8 *sum1;
+	const float8 *sum2;
+	int size;
+	
+	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+	if (PG_ARGISNULL(0))
+		PG_RETURN_DATUM(PG_GETARG_DATUM(1));
+	if (PG_ARGISNULL(1))
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	
+	state1 = agg_get_state(fcinfo, 0);
+	state2 = PG_GETARG_ARRAYTYPE_P(1);
+	size = ArrayGetNItems(ARR_NDIM(state1), ARR_DIMS(state1));
+	agg_check_state_size(state2, size, "array_agg_sum_merge");
+	
+	sum1 = (float8 *) ARR_DATA_PTR(state1);
+	sum2 = (const float8 *) ARR_DATA_PTR(state2);
+	for (int i = 0; i < size; i++)
+		sum1[i] += sum2[i];
+	
+	PG_RETURN_ARRAYTYPE_P(state1);
+}
+
+PG_FUNCTION_INFO_V1(array_agg_sum_final);
+Datum array_agg_sum_final(PG_FUNCTION_ARGS){
+	ArrayType *state = PG_GETARG_ARRAYTYPE_P(0);
+	int n = ArrayGetNItems(ARR_NDIM(state), ARR_DIMS(state)) - 1;
+	ArrayType *result = agg_alloc_state(n);
+	
+	memcpy(ARR_DATA_PTR(result), ARR_DATA_PTR(state), n * sizeof(float8));
+	PG_RETURN_ARRAYTYPE_P(result);
+}
+
+PG_FUNCTION_INFO_V1(array_agg_mean_final);
+Datum array_agg_mean_final(PG_FUNCTION_ARGS){
+	ArrayType *state = PG_GETARG_ARRAYTYPE_P(0);
+	int n = ArrayGetNItems(ARR_NDIM(state), ARR_DIMS(state)) - 1;
+	const float8 *sum = (const float8 *) ARR_DATA_PTR(state);
+	ArrayType *result = agg_alloc_state(n);
+	float8 *mean = (float8 *) ARR_DATA_PTR(result);
+	
+	for (int i = 0; i < n; i++)
+		mean[i] = sum[i] / sum[n];
+	PG_RETURN_ARRAYTYPE_P(result);
+}
+
+PG_FUNCTION_INFO_V1(array_agg_variance_transition);
+Datum array_agg_variance_transition(PG_FUNCTION_ARGS){
+	ArrayType *state;
+	ArrayType *x;
+	float8 *mean, *m2, *count;
+	const float8 *values;
+	int n;
+	
+	if (PG_ARGISNULL(1)){
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+	
+	x = PG_GETARG_ARRAYTYPE_P(1);
+	n = agg_input_size(x, "array_agg_variance_transition");
+	if (PG_ARGISNULL(0)){
+		state = agg_alloc_state(2 * n + 1);
+	}else{
+		state = agg_get_state(fcinfo, 0);
+		agg_check_state_size(state, 2 * n + 1, "array_agg_variance_transition");
+	}
+	
+	mean = (float8 *) ARR_DATA_PTR(state);
+	m2 = mean + n;
+	count = mean + 2 * n;
+	values = (const float8 *) ARR_DATA_PTR(x);
+	
+	*count += 1;
+	for (int i = 0; i < n; i++){
+		float8 delta = values[i] - mean[i];
+		mean[i] += delta / *count;
+		m2[i] += delta * (values[i] - mean[i]);
+	}
+	
+	PG_RETURN_ARRAYTYPE_P(state);
+}
+
+PG_FUNCTION_INFO_V1(array_agg_variance_merge);
+Datum array_agg_variance_merge(PG_FUNCTION_ARGS){
+	ArrayType *state1;
+	ArrayType *state2;
+	float8 *mean1, *m21, *count1;
+	const float8 *mean2, *m22;
+	float8 count2, total;
+	int size, n;
+	
+	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+	if (PG_ARGISNULL(0))
+		PG_RETURN_DATUM(PG_GETARG_DATUM(1));
+	if (PG_ARGISNULL(1))
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	
+	state1 = agg_get_state(fcinfo, 0);
+	state2 = PG_GETARG_ARRAYTYPE_P(1);
+	size = ArrayGetNItems(ARR_NDIM(state1), ARR_DIMS(state1));
+	agg_check_state_size(state2, size, "array_agg_variance_merge");
+	n = (size - 1) / 2;
+	
+	mean1 = (float8 *) ARR_DATA_PTR(state1);
+	m21 = mean1 + n;
+	count1 = mean1 + 2 * n;
+	mean2 = (const float8 *) ARR_DATA_PTR(state2);
+	m22 = mean2 + n;
+	count2 = mean2[2 * n];
+	total = *count1 + count2;
+	
+	for (int i = 0; i < n; i++){
+		float8 delta = mean2[i] - mean1[i];
+		mean1[i] += delta * count2 / total;
+		m21[i] += m22[i] + delta * delta * (*count1) * count2 / total;
+	}
+	*count1 = total;
+	
+	PG_RETURN_ARRAYTYPE_P(state1);
+}
+
+PG_FUNCTION_INFO_V1(array_agg_variance_final);
+Datum array_agg_variance_final(PG_FUNCTION_ARGS){
+	ArrayType *state = PG_GETARG_ARRAYTYPE_P(0);
+	int n = (ArrayGetNItems(ARR_NDIM(state), ARR_DIMS(state)) - 1) / 2;
+	const float8 *m2 = (const float8 *) ARR_DATA_PTR(state) + n;
+	float8 count = m2[n];
+	ArrayType *result;
+	float8 *variance;
+	
+	/* Like var_samp, return NULL for fewer than two rows */
+	if (count < 2)
+		PG_RETURN_NULL();
+	
+	result = agg_alloc_state(n);
+	variance = (float8 *) ARR_DATA_PTR(result);
+	for (int i = 0; i < n; i++)
+		variance[i] = m2[i] / (count - 1);
+	PG_RETURN_ARRAYTYPE_P(result);
+}
@@ -0,0 +1,589 @@
+/*!
+ * \file bitset.c
+ *
+ * \brief Fixed-width bitsets for itemsets
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "libpq/pqformat.h"
+#include "catalog/pg_type.h"
+#include "nodes/execnodes.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "access/hash.h"
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef NO_PG_MODULE_MAGIC
+PG_MODULE_MAGIC;
+#endif
+
+/*
+A bitset is a set of positions 1, ..., width, stored as a bitmap of 64-bit words. Position i corresponds to bit
+(i - 1) % 64 of word (i - 1) / 64. Unused bits of the last word are always zero, so that sets can be compared and hashed
+word by word.
+
+The main use is counting the support of itemsets: With transactions and candidates stored as bitsets, a subset test is
+one AND per word, instead of a merge of two sparse vectors. The aggregate bitset_count_subsets tests all candidates
+against each transaction and thus counts the support of all candidates in a single scan.
+*/
+
+typedef struct {
+	int32 vl_len_;	/* varlena header (do not touch directly!) */
+	int32 width;	/* number of bits */
+	uint64 words[1];	/* variable length */
+} Bitset;
+
+#define BITSET_NWORDS(width) (((width) + 63) / 64)
+#define BITSET_SIZE(width) (offsetof(Bitset, words) + BITSET_NWORDS(width) * sizeof(uint64))
+#define BITSET_MAX_WIDTH (INT_MAX - 63)
+#define PG_GETARG_BITSET_P(n) ((Bitset *) PG_DETOAST_DATUM(PG_GETARG_DATUM(n)))
+#define PG_GETARG_BITSET_P_COPY(n) ((Bitset *) PG_DETOAST_DATUM_COPY(PG_GETARG_DATUM(n)))
+
+Datum bitset_in(PG_FUNCTION_ARGS);
+Datum bitset_out(PG_FUNCTION_ARGS);
+Datum bitset_recv(PG_FUNCTION_ARGS);
+Datum bitset_send(PG_FUNCTION_ARGS);
+Datum bitset_from_positions(PG_FUNCTION_ARGS);
+Datum bitset_from_indicators(PG_FUNCTION_ARGS);
+Datum bitset_width(PG_FUNCTION_ARGS);
+Datum bitset_count(PG_FUNCTION_ARGS);
+Datum bitset_positions(PG_FUNCTION_ARGS);
+Datum bitset_or(PG_FUNCTION_ARGS);
+Datum bitset_and(PG_FUNCTION_ARGS);
+Datum bitset_minus(PG_FUNCTION_ARGS);
+Datum bitset_contains(PG_FUNCTION_ARGS);
+Datum bitset_eq(PG_FUNCTION_ARGS);
+Datum bitset_hash(PG_FUNCTION_ARGS);
+Datum bitset_agg_transition(PG_FUNCTION_ARGS);
+Datum bitset_agg_merge(PG_FUNCTION_ARGS);
+Datum bitset_count_subsets_transition(PG_FUNCTION_ARGS);
+Datum bitset_count_subsets_merge(PG_FUNCTION_ARGS);
+
+/*
+ * Number of set bits of a word
+ */
+static inline int popcount64(uint64 x){
+#if defined(__GNUC__)
+	return __builtin_popcountll(x);
+#else
+	x = x - ((x >> 1) & UINT64CONST(0x5555555555555555));
+	x = (x & UINT64CONST(0x3333333333333333)) + ((x >> 2) & UINT64CONST(0x3333333333333333));
+	x = (x + (x >> 4)) & UINT64CONST(0x0f0f0f0f0f0f0f0f);
+	return (int) ((x * UINT64CONST(0x0101010101010101)) >> 56);
+#endif
+}
+
+/*
+ * Allocate an empty bitset
+ */
+static Bitset *bitset_alloc(int32 width){
+	Bitset *result;
+
+	if (width < 0 || width > BITSET_MAX_WIDTH)
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("bitset width must be between 0 and %d", BITSET_MAX_WIDTH)));
+
+	result = (Bitset *) palloc0(BITSET_SIZE(width));
+	SET_VARSIZE(result, BITSET_SIZE(width));
+	result->width = width;
+	return result;
+}
+
+/*
+ * Set the bit of a position, which must be in 1, ..., width
+ */
+static void bitset_set(Bitset *b, int32 position, const char *func){
+	if (position < 1 || position > b->width)
+		ereport(ERROR, (errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR),
+						errmsg("%s: position %d out of range 1..%d", func, position, b->width)));
+	b->words[(position - 1) / 64] |= UINT64CONST(1) << ((position - 1) % 64);
+}
+
+static void bitset_check_width(const Bitset *a, const Bitset *b, const char *func){
+	if (a->width != b->width)
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("%s: bitsets must have the same width", func)));
+}
+
+static int bitset_popcount(const Bitset *b){
+	int count = 0;
+
+	for (int i = 0; i < BITSET_NWORDS(b->width); i++)
+		count += popcount64(b->words[i]);
+	return count;
+}
+
+/*
+ * Test whether sub is a subset of super. Both must have the same width.
+ */
+static inline bool bitset_is_subset(const uint64 *sub, const uint64 *super, int nwords){
+	for (int i = 0; i < nwords; i++)
+		if ((sub[i] & ~super[i]) != 0)
+			return false;
+	return true;
+}
+
+/*
+ * Text representation: width:{position,position,...}, e.g., 8:{1,3,5}
+ */
+PG_FUNCTION_INFO_V1(bitset_in);
+Datum bitset_in(PG_FUNCTION_ARGS){
+	char *str = PG_GETARG_CSTRING(0);
+	char *ptr = str;
+	char *end;
+	long width;
+	Bitset *result;
+
+	width = strtol(ptr, &end, 10);
+	if (end == ptr || *end != ':' || *(end + 1) != '{' || width < 0 || width > BITSET_MAX_WIDTH)
+		ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+						errmsg("invalid input syntax for bitset: \"%s\"", str)));
+	result = bitset_alloc((int32) width);
+
+	ptr = end + 2;
+	while (isspace((unsigned char) *ptr))
+		ptr++;
+	while (*ptr != '}'){
+		long position = strtol(ptr, &end, 10);
+
+		if (end == ptr || position < INT_MIN || position > INT_MAX)
+			ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+							errmsg("invalid input syntax for bitset: \"%s\"", str)));
+		bitset_set(result, (int32) position, "bitset_in");
+
+		ptr = end;
+		while (isspace((unsigned char) *ptr))
+			ptr++;
+		if (*ptr == ',')
+			ptr++;
+		else if (*ptr != '}')
+			ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+							errmsg("invalid input syntax for bitset: \"%s\"", str)));
+	}
+	if (*(ptr + 1) != '\0')
+		ereport(ERROR, (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+						errmsg("invalid input syntax for bitset: \"%s\"", str)));
+
+	PG_RETURN_POINTER(result);
+}
+
+PG_FUNCTION_INFO_V1(bitset_out);
+Datum bitset_out(PG_FUNCTION_ARGS){
+	Bitset *b = PG_GETARG_BITSET_P(0);
+	StringInfoData buf;
+	bool first = true;
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "%d:{", b->width);
+	for (int32 i = 0; i < b->width; i++){
+		if (b->words[i / 64] & (UINT64CONST(1) << (i % 64))){
+			appendStringInfo(&buf, first ? "%d" : ",%d", i + 1);
+			first = false;
+		}
+	}
+	appendStringInfoChar(&buf, '}');
+
+	PG_RETURN_CSTRING(buf.data);
+}
+
+PG_FUNCTION_INFO_V1(bitset_recv);
+Datum bitset_recv(PG_FUNCTION_ARGS){
+	StringInfo buf = (StringInfo) PG_GETARG_POINTER(0);
+	int32 width = pq_getmsgint(buf, sizeof(int32));
+	Bitset *result = bitset_alloc(width);
+
+	for (int i = 0; i < BITSET_NWORDS(width); i++)
+		result->words[i] = (uint64) pq_getmsgint64(buf);
+	if (width % 64 != 0)
+		result->words[width / 64] &= (UINT64CONST(1) << (width % 64)) - 1;
+
+	PG_RETURN_POINTER(result);
+}
+
+PG_FUNCTION_INFO_V1(bitset_send);
+Datum bitset_send(PG_FUNCTION_ARGS){
+	Bitset *b = PG_GETARG_BITSET_P(0);
+	StringInfoData buf;
+
+	pq_begintypsend(&buf);
+	pq_sendint(&buf, b->width, sizeof(int32));
+	for (int i = 0; i < BITSET_NWORDS(b->width); i++)
+		pq_sendint64(&buf, (int64) b->words[i]);
+
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+/*
+ * bitset(positions int4[], width int4): The set of the given positions. Nulls are ignored.
+ */
+PG_FUNCTION_INFO_V1(bitset_from_positions);
+Datum bitset_from_positions(PG_FUNCTION_ARGS){
+	ArrayType *positions = PG_GETARG_ARRAYTYPE_P(0);
+	Bitset *result = bitset_alloc(PG_GETARG_INT32(1));
+	Datum *elems;
+	bool *nulls;
+	int n;
+
+	if (ARR_ELEMTYPE(positions) != INT4OID)
+		ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+						errmsg("bitset: positions must be of type integer[]")));
+
+	deconstruct_array(positions, INT4OID, sizeof(int32), true, 'i', &elems, &nulls, &n);
+	for (int i = 0; i < n; i++)
+		if (!nulls[i])
+			bitset_set(result, DatumGetInt32(elems[i]), "bitset");
+
+	PG_RETURN_POINTER(result);
+}
+
+/*
+ * bitset(indicators float8[]): The set of positions with non-zero entries. The width is the length of the array. This
+ * converts, e.g., the 0/1 svecs of assoc_rules after a cast to float8[].
+ */
+PG_FUNCTION_INFO_V1(bitset_from_indicators);
+Datum bitset_from_indicators(PG_FUNCTION_ARGS){
+	ArrayType *x = PG_GETARG_ARRAYTYPE_P(0);
+	const float8 *values;
+	Bitset *result;
+	int n;
+
+	if (ARR_ELEMTYPE(x) != FLOAT8OID || ARR_NDIM(x) > 1 || ARR_HASNULL(x))
+		ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+						errmsg("bitset: indicators must be a one-dimensional float8 array without nulls")));
+
+	n = ArrayGetNItems(ARR_NDIM(x), ARR_DIMS(x));
+	values = (const float8 *) ARR_DATA_PTR(x);
+	result = bitset_alloc(n);
+	for (int i = 0; i < n; i++)
+		if (values[i] != 0)
+			result->words[i / 64] |= UINT64CONST(1) << (i % 64);
+
+	PG_RETURN_POINTER(result);
+}
+
+PG_FUNCTION_INFO_V1(bitset_width);
+Datum bitset_width(PG_FUNCTION_ARGS){
+	PG_RETURN_INT32(PG_GETARG_BITSET_P(0)->width);
+}
+
+PG_FUNCTION_INFO_V1(bitset_count);
+Datum bitset_count(PG_FUNCTION_ARGS){
+	PG_RETURN_INT32(bitset_popcount(PG_GETARG_BITSET_P(0)));
+}
+
+/*
+ * The positions of all set bits, in ascending order
+ */
+PG_FUNCTION_INFO_V1(bitset_positions);
+Datum bitset_positions(PG_FUNCTION_ARGS){
+	Bitset *b = PG_GETARG_BITSET_P(0);
+	int n = bitset_popcount(b);
+	Datum *elems = (Datum *) palloc(Max(n, 1) * sizeof(Datum));
+	int k = 0;
+
+	for (int i = 0; i < BITSET_NWORDS(b->width); i++){
+		uint64 word = b->words[i];
+
+		while (word != 0){
+			int bit = popcount64((word & -word) - 1);
+
+			elems[k++] = Int32GetDatum(i * 64 + bit + 1);
+			word &= word - 1;
+		}
+	}
+
+	PG_RETURN_ARRAYTYPE_P(construct_array(elems, n, INT4OID, sizeof(int32), true, 'i'));
+}
+
+PG_FUNCTION_INFO_V1(bitset_or);
+Datum bitset_or(PG_FUNCTION_ARGS){
+	Bitset *a = PG_GETARG_BITSET_P(0);
+	Bitset *b = PG_GETARG_BITSET_P(1);
+	Bitset *result;
+
+	bitset_check_width(a, b, "bitset_or");
+	result = bitset_alloc(a->width);
+	for (int i = 0; i < BITSET_NWORDS(a->width); i++)
+		result->words[i] = a->words[i] | b->words[i];
+
+	PG_RETURN_POINTER(result);
+}
+
+PG_FUNCTION_INFO_V1(bitset_and);
+Datum bitset_and(PG_FUNCTION_ARGS){
+	Bitset *a = PG_GETARG_BITSET_P(0);
+	Bitset *b = PG_GETARG_BITSET_P(1);
+	Bitset *result;
+
+	bitset_check_width(a, b, "bitset_and");
+	result = bitset_alloc(a->width);
+	for (int i = 0; i < BITSET_NWORDS(a->width); i++)
+		result->words[i] = a->words[i] & b->words[i];
+
+	PG_RETURN_POINTER(result);
+}
+
+PG_FUNCTION_INFO_V1(bitset_minus);
+Datum bitset_minus(PG_FUNCTION_ARGS){
+	Bitset *a = PG_GETARG_BITSET_P(0);
+	Bitset *b = PG_GETARG_BITSET_P(1);
+	Bitset *result;
+
+	bitset_check_width(a, b, "bitset_minus");
+	result = bitset_alloc(a->width);
+	for (int i = 0; i < BITSET_NWORDS(a->width); i++)
+		result->words[i] = a->words[i] & ~b->words[i];
+
+	PG_RETURN_POINTER(result);
+}
+
+/*
+ * bitset_contains(a, b): Whether b is a subset of a
+ */
+PG_FUNCTION_INFO_V1(bitset_contains);
+Datum bitset_contains(PG_FUNCTION_ARGS){
+	Bitset *a = PG_GETARG_BITSET_P(0);
+	Bitset *b = PG_GETARG_BITSET_P(1);
+
+	bitset_check_width(a, b, "bitset_contains");
+	PG_RETURN_BOOL(bitset_is_subset(b->words, a->words, BITSET_NWORDS(a->width)));
+}
+
+PG_FUNCTION_INFO_V1(bitset_eq);
+Datum bitset_eq(PG_FUNCTION_ARGS){
+	Bitset *a = PG_GETARG_BITSET_P(0);
+	Bitset *b = PG_GETARG_BITSET_P(1);
+
+	PG_RETURN_BOOL(a->width == b->width
+		&& memcmp(a->words, b->words, BITSET_NWORDS(a->width) * sizeof(uint64)) == 0);
+}
+
+/*
+ * Hash of the width and the words. Equal bitsets have equal hashes, since unused bits are always zero.
+ */
+PG_FUNCTION_INFO_V1(bitset_hash);
+Datum bitset_hash(PG_FUNCTION_ARGS){
+	Bitset *b = PG_GETARG_BITSET_P(0);
+
+	return hash_any((unsigned char *) &b->width,
+		VARSIZE(b) - offsetof(Bitset, width));
+}
+
+/*
+ * Aggregate bitset_agg(position, width): The set of all positions of a group
+ */
+PG_FUNCTION_INFO_V1(bitset_agg_transition);
+Datum bitset_agg_transition(PG_FUNCTION_ARGS){
+	Bitset *state;
+
+	if (PG_ARGISNULL(1) || PG_ARGISNULL(2)){
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	if (PG_ARGISNULL(0))
+		state = bitset_alloc(PG_GETARG_INT32(2));
+	else if (fcinfo->context && IsA(fcinfo->context, AggState))
+		state = PG_GETARG_BITSET_P(0);
+	else
+		state = PG_GETARG_BITSET_P_COPY(0);
+
+	if (state->width != PG_GETARG_INT32(2))
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("bitset_agg: width must be the same for all rows")));
+	bitset_set(state, PG_GETARG_INT32(1), "bitset_agg");
+
+	PG_RETURN_POINTER(state);
+}
+
+PG_FUNCTION_INFO_V1(bitset_agg_merge);
+Datum bitset_agg_merge(PG_FUNCTION_ARGS){
+	Bitset *state1;
+	Bitset *state2;
+
+	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+	if (PG_ARGISNULL(0))
+		PG_RETURN_DATUM(PG_GETARG_DATUM(1));
+	if (PG_ARGISNULL(1))
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+
+	state1 = (fcinfo->context && IsA(fcinfo->context, AggState))
+		? PG_GETARG_BITSET_P(0) : PG_GETARG_BITSET_P_COPY(0);
+	state2 = PG_GETARG_BITSET_P(1);
+	bitset_check_width(state1, state2, "bitset_agg");
+	for (int i = 0; i < BITSET_NWORDS(state1->width); i++)
+		state1->words[i] |= state2->words[i];
+
+	PG_RETURN_POINTER(state1);
+}
+
+/*
+ * Candidates of bitset_count_subsets, unpacked once per query
+ *
+ * The candidate array is the same for all rows, but unpacking it (and detoasting each element) per row would cost
+ * more than the subset tests themselves. So we keep a copy of the array in fn_extra, together with the words and
+ * popcounts of all candidates in one contiguous block. A later call reuses the cache if its array is byte-wise equal.
+ */
+typedef struct {
+	ArrayType *array;	/* copy of the candidate array */
+	int ncandidates;
+	int32 width;
+	int nwords;
+	int *popcounts;
+	uint64 *words;	/* ncandidates * nwords words */
+} CandidateCache;
+
+static CandidateCache *get_candidate_cache(FunctionCallInfo fcinfo, ArrayType *candidates){
+	CandidateCache *cache = (CandidateCache *) fcinfo->flinfo->fn_extra;
+	MemoryContext oldcontext;
+	Datum *elems;
+	bool *nulls;
+	int16 typlen;
+	bool typbyval;
+	char typalign;
+
+	if (cache != NULL && VARSIZE(cache->array) == VARSIZE(candidates)
+		&& memcmp(cache->array, candidates, VARSIZE(candidates)) == 0)
+		return cache;
+
+	oldcontext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+	if (cache == NULL)
+		cache = (CandidateCache *) palloc0(sizeof(CandidateCache));
+	else {
+		pfree(cache->array);
+		if (cache->popcounts != NULL)
+			pfree(cache->popcounts);
+		if (cache->words != NULL)
+			pfree(cache->words);
+	}
+	cache->array = (ArrayType *) palloc(VARSIZE(candidates));
+	memcpy(cache->array, candidates, VARSIZE(candidates));
+	cache->popcounts = NULL;
+	cache->words = NULL;
+
+	get_typlenbyvalalign(ARR_ELEMTYPE(candidates), &typlen, &typbyval, &typalign);
+	deconstruct_array(candidates, ARR_ELEMTYPE(candidates), typlen, typbyval, typalign, &elems, &nulls,
+		&cache->ncandidates);
+	cache->width = 0;
+	cache->nwords = 0;
+	for (int i = 0; i < cache->ncandidates; i++){
+		Bitset *c;
+
+		if (nulls[i])
+			ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+							errmsg("bitset_count_subsets: candidates cannot contain nulls")));
+		c = (Bitset *) PG_DETOAST_DATUM(elems[i]);
+		if (i == 0){
+			cache->width = c->width;
+			cache->nwords = BITSET_NWORDS(c->width);
+			cache->popcounts = (int *) palloc(Max(cache->ncandidates, 1) * sizeof(int));
+			cache->words = (uint64 *) palloc(Max((Size) cache->ncandidates * cache->nwords, 1) * sizeof(uint64));
+		} else if (c->width != cache->width)
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("bitset_count_subsets: bitsets must have the same width")));
+		memcpy(cache->words + (Size) i * cache->nwords, c->words, cache->nwords * sizeof(uint64));
+		cache->popcounts[i] = bitset_popcount(c);
+	}
+	fcinfo->flinfo->fn_extra = cache;
+	MemoryContextSwitchTo(oldcontext);
+
+	return cache;
+}
+
+/*
+ * Aggregate bitset_count_subsets(transaction, candidates): For each candidate, the number of transactions that contain
+ * it. The state is a float8 array with one count per candidate.
+ */
+PG_FUNCTION_INFO_V1(bitset_count_subsets_transition);
+Datum bitset_count_subsets_transition(PG_FUNCTION_ARGS){
+	ArrayType *state;
+	Bitset *transaction;
+	CandidateCache *cache;
+	float8 *counts;
+	int size;
+	int transaction_count;
+
+	if (PG_ARGISNULL(1) || PG_ARGISNULL(2)){
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	transaction = PG_GETARG_BITSET_P(1);
+	cache = get_candidate_cache(fcinfo, PG_GETARG_ARRAYTYPE_P(2));
+	if (cache->ncandidates > 0 && cache->width != transaction->width)
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("bitset_count_subsets: bitsets must have the same width")));
+
+	if (PG_ARGISNULL(0) && cache->ncandidates == 0)
+		state = construct_empty_array(FLOAT8OID);
+	else if (PG_ARGISNULL(0)){
+		Size nbytes = ARR_OVERHEAD_NONULLS(1) + (Size) cache->ncandidates * sizeof(float8);
+
+		state = (ArrayType *) palloc0(nbytes);
+		SET_VARSIZE(state, nbytes);
+		state->ndim = 1;
+		state->dataoffset = 0;
+		state->elemtype = FLOAT8OID;
+		ARR_DIMS(state)[0] = cache->ncandidates;
+		ARR_LBOUND(state)[0] = 1;
+	} else if (fcinfo->context && IsA(fcinfo->context, AggState))
+		state = PG_GETARG_ARRAYTYPE_P(0);
+	else
+		state = PG_GETARG_ARRAYTYPE_P_COPY(0);
+
+	size = ArrayGetNItems(ARR_NDIM(state), ARR_DIMS(state));
+	if (size != cache->ncandidates)
+		ereport(ERROR, (errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR),
+						errmsg("bitset_count_subsets: candidates must be the same for all rows")));
+
+	/* A candidate with more items than the transaction cannot be a subset */
+	counts = (float8 *) ARR_DATA_PTR(state);
+	transaction_count = bitset_popcount(transaction);
+	for (int i = 0; i < cache->ncandidates; i++)
+		if (cache->popcounts[i] <= transaction_count
+			&& bitset_is_subset(cache->words + (Size) i * cache->nwords, transaction->words, cache->nwords))
+			counts[i] += 1;
+
+	PG_RETURN_ARRAYTYPE_P(state);
+}
+
+PG_FUNCTION_INFO_V1(bitset_count_subsets_merge);
+Datum bitset_count_subsets_merge(PG_FUNCTION_ARGS){
+	ArrayType *state1;
+	ArrayType *state2;
+	float8 *counts1;
+	const float8 *counts2;
+	int size;
+
+	if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+	if (PG_ARGISNULL(0))
+		PG_RETURN_DATUM(PG_GETARG_DATUM(1));
+	if (PG_ARGISNULL(1))
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+
+	state1 = (fcinfo->context && IsA(fcinfo->context, AggState))
+		? PG_GETARG_ARRAYTYPE_P(0) : PG_GETARG_ARRAYTYPE_P_COPY(0);
+	state2 = PG_GETARG_ARRAYTYPE_P(1);
+	size = ArrayGetNItems(ARR_NDIM(state1), ARR_DIMS(state1));
+	if (size != ArrayGetNItems(ARR_NDIM(state2), ARR_DIMS(state2)))
+		ereport(ERROR, (errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR),
+						errmsg("bitset_count_subsets: candidates must be the same for all rows")));
+
+	counts1 = (float8 *) ARR_DATA_PTR(state1);
+	counts2 = (const float8 *) ARR_DATA_PTR(state2);
+	for (int i = 0; i < size; i++)
+		counts1[i] += counts2[i];
+
+	PG_RETURN_ARRAYTYPE_P(state1);
+}
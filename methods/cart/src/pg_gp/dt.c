@@ -107,6 +107,139 @@ static float8 DT_CONFIDENCE_DEV[]   =
 			} while (0)
 
 
+
+/*
+ * The aggregates for REP and SCV keep their states in a bytea with a
+ * fixed layout: a small header followed by num_slots fixed-size slots.
+ * For REP each slot is the int64 count of one class. For SCV each slot
+ * is a float8 vector indexed by DT_SCV_STATE_ARRAY_INDEX, and one state
+ * can carry the entropy, gini and split info of all the features of a
+ * node, one slot per feature.
+ *
+ * The header is checked when a state is created, and whenever a state
+ * comes from outside the aggregate being computed (the second argument
+ * of a prefunc, or a call outside an aggregate context). After that the
+ * slots are updated and merged in place without any further checks.
+ */
+typedef struct
+{
+	/* DT_REP_STATE_MAGIC or DT_SCV_STATE_MAGIC */
+	int32	magic;
+	/* The number of slots following the header */
+	int32	num_slots;
+	/* 1 infogain, 2 gainratio, 3 gini. Not used by REP */
+	int32	split_crit;
+} dt_aggr_state_header;
+
+
+#define DT_REP_STATE_MAGIC	0x44545250
+#define DT_SCV_STATE_MAGIC	0x44545356
+
+
+/*
+ * Together with the varlena length word, the header takes 16 bytes.
+ * So the slots are 8-byte aligned whenever the state itself is.
+ */
+#define DT_AGGR_STATE_HDRSZ	(VARHDRSZ + sizeof(dt_aggr_state_header))
+
+#define DT_AGGR_STATE_SZ(num_slots, slot_size) \
+			(DT_AGGR_STATE_HDRSZ + (Size)(num_slots) * (slot_size))
+
+#define dt_aggr_state_header_of(state) \
+			((dt_aggr_state_header *)VARDATA(state))
+
+#define dt_aggr_state_slots(state) \
+			((char *)(state) + DT_AGGR_STATE_HDRSZ)
+
+
+/*
+ * The state can only be modified in place if it is owned by the
+ * aggregate calling us. Otherwise, we must work on a copy.
+ */
+#define dt_is_agg_context(fcinfo) \
+			((fcinfo)->context && IsA((fcinfo)->context, AggState))
+
+
+/*
+ * @brief Allocate a zeroed aggregate state with the given number of slots.
+ *
+ * @param magic         DT_REP_STATE_MAGIC or DT_SCV_STATE_MAGIC.
+ * @param num_slots     The number of slots.
+ * @param slot_size     The size of each slot in bytes.
+ * @param split_crit    The split criterion, 0 for REP.
+ *
+ * @return The newly allocated state.
+ *
+ */
+static
+bytea*
+dt_new_aggr_state
+	(
+	int32	magic,
+	int32	num_slots,
+	Size	slot_size,
+	int32	split_crit
+	)
+{
+	Size	state_size				= DT_AGGR_STATE_SZ(num_slots, slot_size);
+	bytea*	state					= (bytea *)palloc0(state_size);
+	dt_aggr_state_header* header	= dt_aggr_state_header_of(state);
+
+	SET_VARSIZE(state, state_size);
+	header->magic		= magic;
+	header->num_slots	= num_slots;
+	header->split_crit	= split_crit;
+
+	return state;
+}
+
+
+/*
+ * @brief Check the header of an aggregate state. This is O(1): only the
+ *        header and the total size are checked, not the slots.
+ *
+ * @param state         The state to check.
+ * @param magic         The expected magic number.
+ * @param slot_size     The expected size of each slot in bytes.
+ *
+ * @return The header of the state.
+ *
+ */
+static
+dt_aggr_state_header*
+dt_check_aggr_state
+	(
+	bytea*	state,
+	int32	magic,
+	Size	slot_size
+	)
+{
+	dt_check_error
+		(
+			state && VARSIZE(state) >= DT_AGGR_STATE_HDRSZ,
+			"invalid aggregation state"
+		);
+
+	dt_aggr_state_header* header = dt_aggr_state_header_of(state);
+
+	dt_check_error_value
+		(
+			header->magic == magic,
+			"invalid aggregation state type: %d",
+			header->magic
+		);
+
+	dt_check_error_value
+		(
+			header->num_slots > 0 &&
+			VARSIZE(state) == DT_AGGR_STATE_SZ(header->num_slots, slot_size),
+			"invalid aggregation state size: %d",
+			(int)VARSIZE(state)
+		);
+
+	return header;
+}
+
 static
 float8
 dt_ebp_calc_errors_internal
@@ -282,14 +415,16 @@ dt_ebp_calc_errors_internal
  * @brief The step function for aggregating the class counts while
  *        doing Reduce Error Pruning (REP).
  *
- * @param class_count_array     The array used to store the accumulated information.
+ * @param class_count_state     The bytea state used to store the accumulated
+ *                              information. It has max_num_of_classes + 1
+ *                              int64 slots:
  *                              [0]: the total number of mis-classified cases
  *                              [i]: the number of cases belonging to the ith class
  * @param classified_class      The predicted class based on our trained DT model.
  * @param original_class        The real class value provided in the validation set.
  * @param max_num_of_classes    The total number of distinct class values.
  *
- * @return An updated state array.
+ * @return An updated state.
  *
  */
 Datum
@@ -298,21 +433,61 @@ dt_rep_aggr_class_count_sfunc
 	PG_FUNCTION_ARGS
 	)
 {
-    ArrayType *pg_class_count    = NULL;
-    int array_dim                = 0;
-    int *p_array_dim             = NULL;
-    int array_length             = 0;
+    bytea *class_count_state     = NULL;
+    dt_aggr_state_header *header = NULL;
     int64 *class_count           = NULL;
     int classified_class    	 = PG_GETARG_INT32(1);
     int original_class      	 = PG_GETARG_INT32(2);
     int max_num_of_classes  	 = PG_GETARG_INT32(3);
-    bool rebuild_array     		 = false;
+
+    /* test if the first argument (class count state) is null */
+    if (PG_ARGISNULL(0))
+    {
+        dt_check_error_value
+    		(
+    			max_num_of_classes >= 2,
+    			"invalid value: %d. "
+    			"The number of classes must be greater than or equal to 2",
+    			max_num_of_classes
+    		);
+
+    	/*
+    	 * We assume the maximum number of classes is limited (up to millions),
+    	 * so that the allocated state won't break our memory limitation.
+    	 */
+        class_count_state =
+        	dt_new_aggr_state
+        		(
+        			DT_REP_STATE_MAGIC,
+        			max_num_of_classes + 1,
+        			sizeof(int64),
+        			0
+        		);
+        header = dt_aggr_state_header_of(class_count_state);
+    }
+    else if (dt_is_agg_context(fcinfo))
+    {
+        /* the state was created by this function, it was checked then */
+        class_count_state = PG_GETARG_BYTEA_P(0);
+        header            = dt_aggr_state_header_of(class_count_state);
+    }
+    else
+    {
+        class_count_state = PG_GETARG_BYTEA_P_COPY(0);
+        header            =
+        	dt_check_aggr_state
+        		(
+        			class_count_state,
+        			DT_REP_STATE_MAGIC,
+        			sizeof(int64)
+        		);
+    }
 
     dt_check_error_value
 		(
-			max_num_of_classes >= 2,
+			max_num_of_classes == header->num_slots - 1,
 			"invalid value: %d. "
-			"The number of classes must be greater than or equal to 2",
+			"The number of classes must be the same for all the rows",
 			max_num_of_classes
 		);
 
@@ -331,55 +506,8 @@ dt_rep_aggr_class_count_sfunc
 			"It must be in range from 1 to the number of classes",
 			classified_class
 		);
-    
-    /* test if the first argument (class count array) is null */
-    if (PG_ARGISNULL(0))
-    {
-    	/*
-    	 * We assume the maximum number of classes is limited (up to millions),
-    	 * so that the allocated array won't break our memory limitation.
-    	 */
-        class_count 	 = palloc0(sizeof(int64) * (max_num_of_classes + 1));
-        array_length 	 = max_num_of_classes + 1;
-        rebuild_array 	 = true;
-
-    }
-    else
-    {
-        if (fcinfo->context && IsA(fcinfo->context, AggState))
-            pg_class_count = PG_GETARG_ARRAYTYPE_P(0);
-        else
-            pg_class_count = PG_GETARG_ARRAYTYPE_P_COPY(0);
-        
-        dt_check_error
-    		(
-    			pg_class_count,
-    			"invalid aggregation state array"
-    		);
-
-        array_dim = ARR_NDIM(pg_class_count);
-
-        dt_check_error_value
-    		(
-    			array_dim == 1,
-    			"invalid array dimension: %d. "
-    			"The dimension of class count array must be equal to 1",
-    			array_dim
-    		);
 
-        p_array_dim         = ARR_DIMS(pg_class_count);
-        array_length        = ArrayGetNItems(array_dim,p_array_dim);
-        class_count    		= (int64 *)ARR_DATA_PTR(pg_class_count);
-
-        dt_check_error_value
-    		(
-    			array_length == max_num_of_classes + 1,
-    			"invalid array length: %d. "
-    			"The length of class count array must be "
-    			"equal to the total number classes + 1",
-    			array_length
-    		);
-    }
+    class_count = (int64 *)dt_aggr_state_slots(class_count_state);
 
     /*
      * If the condition is met, then the current record
@@ -392,33 +520,19 @@ dt_rep_aggr_class_count_sfunc
     /* In any case, we will update the original class count */
     ++class_count[original_class];
 
-    if (rebuild_array)
-    {
-        /* construct a new array to keep the aggr states. */
-        pg_class_count =
-        	construct_array(
-        		(Datum *)class_count,
-                array_length,
-                INT8OID,
-                sizeof(int64),
-                true,
-                'd'
-                );
-    }
-
-    PG_RETURN_ARRAYTYPE_P(pg_class_count);
+    PG_RETURN_BYTEA_P(class_count_state);
 }
 PG_FUNCTION_INFO_V1(dt_rep_aggr_class_count_sfunc);
 
 
 /*
- * @brief The pre-function for REP. It takes two class count arrays
+ * @brief The pre-function for REP. It takes two class count states
  *        produced by the sfunc and combine them together.
  *
- * @param 1 arg         The array returned by sfun1.
- * @param 2 arg         The array returned by sfun2.
+ * @param 1 arg         The state returned by sfun1.
+ * @param 2 arg         The state returned by sfun2.
  *
- * @return The array with the combined information.
+ * @return The state with the combined information.
  *
  */
 Datum
@@ -427,16 +541,12 @@ dt_rep_aggr_class_count_prefunc
 	PG_FUNCTION_ARGS
 	)
 {
-    ArrayType *pg_class_count    	= NULL;
-    int array_dim                   = 0;
-    int *p_array_dim                = NULL;
-    int array_length                = 0;
+    bytea *class_count_state        = NULL;
+    dt_aggr_state_header *header    = NULL;
     int64 *class_count         		= NULL;
 
-    ArrayType *pg_class_count_2   	= NULL;
-    int array_dim2                  = 0;
-    int *p_array_dim2               = NULL;
-    int array_length2               = 0;
+    bytea *class_count_state_2      = NULL;
+    dt_aggr_state_header *header_2  = NULL;
     int64 *class_count_2        	= NULL;
 
     if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
@@ -444,65 +554,51 @@ dt_rep_aggr_class_count_prefunc
     else if (PG_ARGISNULL(1) || PG_ARGISNULL(0))
     {
         /*
-         * If one of the two array is null,
-         * just return the non-null array directly
+         * If one of the two states is null,
+         * just return the non-null state directly
          */
-    	PG_RETURN_ARRAYTYPE_P(PG_ARGISNULL(1) ?
-    				PG_GETARG_ARRAYTYPE_P(0) :
-    				PG_GETARG_ARRAYTYPE_P(1));
+    	PG_RETURN_BYTEA_P(PG_ARGISNULL(1) ?
+    				PG_GETARG_BYTEA_P(0) :
+    				PG_GETARG_BYTEA_P(1));
     }
     else
     {
-        /* If both arrays are not null, we will merge them together */
-        if (fcinfo->context && IsA(fcinfo->context, AggState))
-            pg_class_count = PG_GETARG_ARRAYTYPE_P(0);
+        /* If both states are not null, we will merge them together */
+        if (dt_is_agg_context(fcinfo))
+            class_count_state = PG_GETARG_BYTEA_P(0);
         else
-            pg_class_count = PG_GETARG_ARRAYTYPE_P_COPY(0);
-        
-        dt_check_error
-    		(
-    			pg_class_count,
-    			"invalid aggregation state array"
-    		);
-
-        array_dim = ARR_NDIM(pg_class_count);
-
-        dt_check_error_value
-    		(
-    			array_dim == 1,
-    			"invalid array dimension: %d. "
-    			"The dimension of class count array must be equal to 1",
-    			array_dim
-    		);
+            class_count_state = PG_GETARG_BYTEA_P_COPY(0);
 
-        p_array_dim             = ARR_DIMS(pg_class_count);
-        array_length            = ArrayGetNItems(array_dim,p_array_dim);
-        class_count        		= (int64 *)ARR_DATA_PTR(pg_class_count);
+        class_count_state_2 = PG_GETARG_BYTEA_P(1);
 
-        pg_class_count_2      	= PG_GETARG_ARRAYTYPE_P(1);
-        array_dim2              = ARR_NDIM(pg_class_count_2);
-        dt_check_error_value
-    		(
-    			array_dim2 == 1,
-    			"invalid array dimension: %d. "
-    			"The dimension of class count array must be equal to 1",
-    			array_dim2
-    		);
-
-        p_array_dim2        = ARR_DIMS(pg_class_count_2);
-        array_length2       = ArrayGetNItems(array_dim2,p_array_dim2);
-        class_count_2       = (int64 *)ARR_DATA_PTR(pg_class_count_2);
+        header   =
+        	dt_check_aggr_state
+        		(
+        			class_count_state,
+        			DT_REP_STATE_MAGIC,
+        			sizeof(int64)
+        		);
+        header_2 =
+        	dt_check_aggr_state
+        		(
+        			class_count_state_2,
+        			DT_REP_STATE_MAGIC,
+        			sizeof(int64)
+        		);
 
         dt_check_error
     		(
-    			array_length == array_length2,
-    			"the size of the two array must be the same in prefunction"
+    			header->num_slots == header_2->num_slots,
+    			"the size of the two states must be the same in prefunction"
     		);
 
-        for (int index = 0; index < array_length; index++)
+        class_count   = (int64 *)dt_aggr_state_slots(class_count_state);
+        class_count_2 = (int64 *)dt_aggr_state_slots(class_count_state_2);
+
+        for (int index = 0; index < header->num_slots; index++)
             class_count[index] += class_count_2[index];
 
-        PG_RETURN_ARRAYTYPE_P(pg_class_count);
+        PG_RETURN_BYTEA_P(class_count_state);
     }
 }
 PG_FUNCTION_INFO_V1(dt_rep_aggr_class_count_prefunc);
@@ -510,13 +606,13 @@ PG_FUNCTION_INFO_V1(dt_rep_aggr_class_count_prefunc);
 
 /*
  * @brief The final function for aggregating the class counts for REP.
- *        It takes the class count array produced by the sfunc and produces
+ *        It takes the class count state produced by the sfunc and produces
  *        a two-element array. The first element is the ID of the class that
  *        has the maximum number of cases represented by the root node of
  *        the subtree being processed. The second element is the number of
  *        reduced misclassified cases if the leaf nodes of the subtree are pruned.
  *
- * @param class_count_data  The array containing all the information for the
+ * @param class_count_state The state containing all the information for the
  *                          calculation of Reduced-Error pruning. 
  *
  * @return A two-element array that contains the most frequent class ID and
@@ -529,20 +625,17 @@ dt_rep_aggr_class_count_ffunc
 	PG_FUNCTION_ARGS
 	)
 {
-    ArrayType *pg_class_count    = PG_GETARG_ARRAYTYPE_P(0);
-    int array_dim                = ARR_NDIM(pg_class_count);
-
-    dt_check_error_value
-		(
-			array_dim == 1,
-			"invalid array dimension: %d. "
-			"The dimension of class count array must be equal to 1",
-			array_dim
-		);
+    bytea *class_count_state     = PG_GETARG_BYTEA_P(0);
+    dt_aggr_state_header *header =
+    	dt_check_aggr_state
+    		(
+    			class_count_state,
+    			DT_REP_STATE_MAGIC,
+    			sizeof(int64)
+    		);
 
-    int *p_array_dim           = ARR_DIMS(pg_class_count);
-    int array_length           = ArrayGetNItems(array_dim,p_array_dim);
-    int64 *class_count         = (int64 *)ARR_DATA_PTR(pg_class_count);
+    int array_length           = header->num_slots;
+    int64 *class_count         = (int64 *)dt_aggr_state_slots(class_count_state);
     int64 *result              = palloc(sizeof(int64)*2);
 
     dt_check_error
@@ -759,8 +852,8 @@ PG_FUNCTION_INFO_V1(dt_rep_aggr_class_count_ffunc);
 
 
 /*
- * We use a 14-element array to keep the state of the
- * aggregate for calculating splitting criteria values (SCVs).
+ * Each slot of the state of the aggregate for calculating
+ * splitting criteria values (SCVs) is a 14-element float8 array.
  * The enum types defines which element of that array is used
  * for which purpose.
  *
@@ -854,14 +947,20 @@ enum DT_SCV_FINAL_ARRAY_INDEX
 #define DT_SC_GINI      3
 
 
+/* The number of float8 elements and bytes in one slot of the SCV state */
+#define DT_SCV_SLOT_LEN		(SCV_STATE_MAX_CLASS_ELEM_COUNT + 1)
+#define DT_SCV_SLOT_SIZE	(sizeof(float8) * DT_SCV_SLOT_LEN)
+
+
 /*
  * @brief The function is used to calculate pre-split splitting criteria value. 
  *
- * @param scv_state_array     The array containing all the information for the 
+ * @param scv_state_array     The slot containing all the information for the 
  *                            calculation of splitting criteria values. 
  * @param curr_class_count    Total count of elements belonging to current class.
  * @param total_elem_count    Total count of elements.
  * @param split_criterion     1 - infogain; 2 - gainratio; 3 - gini.
+ *                            It was checked when the state was created.
  *
  */
 static
@@ -874,23 +973,6 @@ dt_accumulate_pre_split_scv
     int         split_criterion
     )
 {
-
-	dt_check_error
-		(
-			scv_state_array,
-			"invalid aggregation state array"
-		);
-
-	dt_check_error_value
-		(
-			(DT_SC_INFOGAIN  == split_criterion ||
-			DT_SC_GAINRATIO  == split_criterion ||
-			DT_SC_GINI       == split_criterion),
-			"invalid split criterion: %d. "
-			"It must be 1(infogain), 2(gainratio) or 3(gini)",
-			split_criterion
-		);
-
 	dt_check_error_value
 		(
 			total_elem_count > 0,
@@ -929,11 +1011,11 @@ dt_accumulate_pre_split_scv
 /*
  * @brief The step function for the aggregation of splitting criteria values.
  *        It accumulates all the information for scv calculation
- *        and stores to a fourteen element array.
+ *        and stores to a fourteen element slot of the state.
  *
- * @param scv_state_array   The array used to accumulate all the information
+ * @param scv_state         The bytea state used to accumulate all the information
  *                          for the calculation of splitting criteria values.
- *                          Please refer to the definition of DT_SCV_STATE_ARRAY_INDEX.
+ *                          Each slot is indexed by DT_SCV_STATE_ARRAY_INDEX.
  * @param split_criterion   1- infogain; 2- gainratio; 3- gini.
  * @param feature_val       The feature value of current record under processing.
  * @param class             The class of current record under processing.
@@ -944,9 +1026,12 @@ dt_accumulate_pre_split_scv
  * @param true_total_count  If there is any missing value, true_total_count is larger
  *      				    than the total count computed in the aggregation. Thus,
  *                          we should multiply a ratio for the computed gain.
+ * @param slot              Optional. The zero-based slot (feature) the current
+ *                          record belongs to. Defaults to 0.
+ * @param num_slots         Optional. The total number of slots (features)
+ *                          carried by the state. Defaults to 1.
  *
- * @return A fourteen element array. Please refer to the definition of 
- *         DT_SCV_STATE_ARRAY_INDEX for the detailed information of this array.
+ * @return The updated state.
  */
 Datum
 dt_scv_aggr_sfunc
@@ -954,69 +1039,117 @@ dt_scv_aggr_sfunc
 	PG_FUNCTION_ARGS
 	)
 {
-    ArrayType*	scv_state_array	= NULL;
-    if (fcinfo->context && IsA(fcinfo->context, AggState))
-        scv_state_array = PG_GETARG_ARRAYTYPE_P(0);
-    else
-        scv_state_array = PG_GETARG_ARRAYTYPE_P_COPY(0);
+    bytea*	scv_state					= NULL;
+    dt_aggr_state_header* header		= NULL;
+    int    split_criterion	= PG_GETARG_INT32(1);
+    bool   is_null_fval     = PG_ARGISNULL(2);
+    float8 feature_val		= PG_GETARG_FLOAT8(2);
+    float8 class			= PG_ARGISNULL(3) ? -1 : PG_GETARG_FLOAT8(3);
+    bool   is_cont_feature 	= PG_ARGISNULL(4) ? false : PG_GETARG_BOOL(4);
+    float8 less				= PG_ARGISNULL(5) ? 0 : PG_GETARG_FLOAT8(5);
+    float8 great			= PG_ARGISNULL(6) ? 0 : PG_GETARG_FLOAT8(6);
+    float8 true_total_count = PG_ARGISNULL(7) ? 0 : PG_GETARG_FLOAT8(7);
+    int    slot				= 0;
+    int    num_slots		= 1;
 
-	dt_check_error
-		(
-			scv_state_array,
-			"invalid aggregation state array"
-		);
+    if (PG_NARGS() > 9)
+    {
+        slot		= PG_ARGISNULL(8) ? 0 : PG_GETARG_INT32(8);
+        num_slots	= PG_ARGISNULL(9) ? 1 : PG_GETARG_INT32(9);
+    }
 
-    int	 array_dim 		= ARR_NDIM(scv_state_array);
+    if (PG_ARGISNULL(0))
+    {
+		dt_check_error_value
+			(
+				(DT_SC_INFOGAIN  == split_criterion ||
+				DT_SC_GAINRATIO  == split_criterion ||
+				DT_SC_GINI       == split_criterion),
+				"invalid split criterion: %d. "
+				"It must be 1(infogain), 2(gainratio) or 3(gini)",
+				split_criterion
+			);
 
-    dt_check_error_value
-		(
-			array_dim == 1,
-			"invalid array dimension: %d. "
-			"The dimension of scv state array must be equal to 1",
-			array_dim
-		);
+		dt_check_error_value
+			(
+				num_slots > 0,
+				"invalid number of features: %d. "
+				"It must be greater than 0",
+				num_slots
+			);
 
-    int* p_array_dim	= ARR_DIMS(scv_state_array);
-    int  array_length	= ArrayGetNItems(array_dim, p_array_dim);
+        scv_state = 
+        	dt_new_aggr_state
+        		(
+        			DT_SCV_STATE_MAGIC,
+        			num_slots,
+        			DT_SCV_SLOT_SIZE,
+        			split_criterion
+        		);
+        header = dt_aggr_state_header_of(scv_state);
+    }
+    else if (dt_is_agg_context(fcinfo))
+    {
+        /* the state was created by this function, it was checked then */
+        scv_state	= PG_GETARG_BYTEA_P(0);
+        header		= dt_aggr_state_header_of(scv_state);
+    }
+    else
+    {
+        scv_state	= PG_GETARG_BYTEA_P_COPY(0);
+        header		=
+        	dt_check_aggr_state
+        		(
+        			scv_state,
+        			DT_SCV_STATE_MAGIC,
+        			DT_SCV_SLOT_SIZE
+        		);
+    }
 
+    /*
+     * The arguments must agree with the state before we write into
+     * it. These are O(1) checks, also for states created by this
+     * function, since num_slots and split_criterion may vary between
+     * the rows of one aggregation.
+     */
     dt_check_error_value
 		(
-			array_length == SCV_STATE_MAX_CLASS_ELEM_COUNT + 1,
-			"invalid array length: %d",
-			array_length
+			VARSIZE(scv_state) ==
+				DT_AGGR_STATE_SZ(header->num_slots, DT_SCV_SLOT_SIZE),
+			"invalid aggregation state size: %d",
+			(int)VARSIZE(scv_state)
 		);
 
-    float8 *scv_state_data = (float8 *)ARR_DATA_PTR(scv_state_array);
-	dt_check_error
+    dt_check_error_value
 		(
-			scv_state_data,
-			"invalid aggregation data array"
+			num_slots == header->num_slots,
+			"invalid number of features: %d. "
+			"It must be the same for all the rows of the aggregation",
+			num_slots
 		);
 
-    int    split_criterion	= PG_GETARG_INT32(1);
-    bool   is_null_fval     = PG_ARGISNULL(2);
-    float8 feature_val		= PG_GETARG_FLOAT8(2);
-    float8 class			= PG_ARGISNULL(3) ? -1 : PG_GETARG_FLOAT8(3);
-    bool   is_cont_feature 	= PG_ARGISNULL(4) ? false : PG_GETARG_BOOL(4);
-    float8 less				= PG_ARGISNULL(5) ? 0 : PG_GETARG_FLOAT8(5);
-    float8 great			= PG_ARGISNULL(6) ? 0 : PG_GETARG_FLOAT8(6);
-    float8 true_total_count = PG_ARGISNULL(7) ? 0 : PG_GETARG_FLOAT8(7);
-
-	dt_check_error_value
+    dt_check_error_value
 		(
-			(DT_SC_INFOGAIN  == split_criterion ||
-			DT_SC_GAINRATIO  == split_criterion ||
-			DT_SC_GINI       == split_criterion),
+			split_criterion == header->split_crit,
 			"invalid split criterion: %d. "
-			"It must be 1(infogain), 2(gainratio) or 3(gini)",
+			"It must be the same for all the rows of the aggregation",
 			split_criterion
 		);
 
+    dt_check_error_value
+		(
+			slot >= 0 && slot < header->num_slots,
+			"invalid feature slot: %d",
+			slot
+		);
+    float8 *scv_state_data = 
+    	(float8 *)dt_aggr_state_slots(scv_state) + slot * DT_SCV_SLOT_LEN;
+
     /*
      *  If the count for total element is still zero
      *  it is the first time that step function is
-     *  invoked. In that case, we should initialize
-     *  several elements.
+     *  invoked for this slot. In that case, we should
+     *  initialize several elements.
      */ 
     if (dt_is_float_zero(scv_state_data[SCV_STATE_TOTAL_ELEM_COUNT]))
     {
@@ -1208,20 +1341,22 @@ dt_scv_aggr_sfunc
         }
     }
 
-    PG_RETURN_ARRAYTYPE_P(scv_state_array);
+
+    PG_RETURN_BYTEA_P(scv_state);
 }
 PG_FUNCTION_INFO_V1(dt_scv_aggr_sfunc);
 
 
 /*
  * @brief The pre-function for the aggregation of splitting criteria values.
- *        It takes the state array produced by two sfunc and combine them together.
+ *        It takes the states produced by two sfunc and combine them together,
+ *        slot by slot.
  *
- * @param scv_state_array    The array from sfunc1.
- * @param scv_state_array    The array from sfunc2.
+ * @param scv_state    The state from sfunc1.
+ * @param scv_state    The state from sfunc2.
  *
- * @return A fourteen element array. Please refer to the definition of 
- *         DT_SCV_STATE_ARRAY_INDEX for the detailed information of this array.
+ * @return The combined state. Please refer to the definition of 
+ *         DT_SCV_STATE_ARRAY_INDEX for the layout of each slot.
  *
  */
 Datum
@@ -1230,183 +1365,110 @@ dt_scv_aggr_prefunc
 	PG_FUNCTION_ARGS
 	)
 {
-    ArrayType*	scv_state_array	= NULL;
-    if (fcinfo->context && IsA(fcinfo->context, AggState))
-        scv_state_array = PG_GETARG_ARRAYTYPE_P(0);
+    if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+        PG_RETURN_NULL();
+    else if (PG_ARGISNULL(1) || PG_ARGISNULL(0))
+    {
+    	PG_RETURN_BYTEA_P(PG_ARGISNULL(1) ?
+    				PG_GETARG_BYTEA_P(0) :
+    				PG_GETARG_BYTEA_P(1));
+    }
+
+    bytea*	scv_state	= NULL;
+    if (dt_is_agg_context(fcinfo))
+        scv_state = PG_GETARG_BYTEA_P(0);
     else
-        scv_state_array = PG_GETARG_ARRAYTYPE_P_COPY(0);
+        scv_state = PG_GETARG_BYTEA_P_COPY(0);
 
-	dt_check_error
-		(
-			scv_state_array,
-			"invalid aggregation state array"
-		);
+    bytea*	scv_state2	= PG_GETARG_BYTEA_P(1);
 
-    int array_dim 		= ARR_NDIM(scv_state_array);
-    dt_check_error_value
-		(
-			array_dim == 1,
-			"invalid array dimension: %d. "
-			"The dimension of scv state array must be equal to 1",
-			array_dim
-		);
+    dt_aggr_state_header* header	=
+    	dt_check_aggr_state(scv_state, DT_SCV_STATE_MAGIC, DT_SCV_SLOT_SIZE);
+    dt_aggr_state_header* header2	=
+    	dt_check_aggr_state(scv_state2, DT_SCV_STATE_MAGIC, DT_SCV_SLOT_SIZE);
 
-    int *p_array_dim 	= ARR_DIMS(scv_state_array);
-    int array_length 	= ArrayGetNItems(array_dim, p_array_dim);
-    dt_check_error_value
+    dt_check_error
 		(
-			array_length == SCV_STATE_MAX_CLASS_ELEM_COUNT + 1,
-			"invalid array length: %d",
-			array_length
+			header->num_slots == header2->num_slots &&
+			header->split_crit == header2->split_crit,
+			"the two states must have the same features and split criterion"
 		);
 
     /* the scv state data from a segment */
-    float8 *scv_state_data = (float8 *)ARR_DATA_PTR(scv_state_array);
-	dt_check_error
-		(
-			scv_state_data,
-			"invalid aggregation data array"
-		);    
-
-    ArrayType* scv_state_array2	= PG_GETARG_ARRAYTYPE_P(1);
-	dt_check_error
-		(
-			scv_state_array2,
-			"invalid aggregation state array"
-		);
-
-    array_dim 		= ARR_NDIM(scv_state_array2);
-    dt_check_error_value
-		(
-			array_dim == 1,
-			"invalid array dimension: %d. "
-			"The dimension of scv state array must be equal to 1",
-			array_dim
-		);    
-    p_array_dim 	= ARR_DIMS(scv_state_array2);
-    array_length 	= ArrayGetNItems(array_dim, p_array_dim);
-    dt_check_error_value
-		(
-			array_length == SCV_STATE_MAX_CLASS_ELEM_COUNT + 1,
-			"invalid array length: %d",
-			array_length
-		);
-
+    float8 *scv_state_data	= (float8 *)dt_aggr_state_slots(scv_state);
     /* the scv state data from another segment */
-    float8 *scv_state_data2 = (float8 *)ARR_DATA_PTR(scv_state_array2);
-	dt_check_error
-		(
-			scv_state_data2,
-			"invalid aggregation data array"
-		); 
-
-    /*
-     * For the following data, such as entropy, gini and split info,
-     * we need to combine the accumulated value from multiple segments.
-     */ 
-    scv_state_data[SCV_STATE_TOTAL_ELEM_COUNT]	+=
-    		scv_state_data2[SCV_STATE_TOTAL_ELEM_COUNT];
-    scv_state_data[SCV_STATE_ENTROPY_DATA] 		+=
-    		scv_state_data2[SCV_STATE_ENTROPY_DATA];
-    scv_state_data[SCV_STATE_SPLIT_INFO_DATA]	+=
-    		scv_state_data2[SCV_STATE_SPLIT_INFO_DATA];
-    scv_state_data[SCV_STATE_GINI_DATA]			+=
-    		scv_state_data2[SCV_STATE_GINI_DATA];
+    float8 *scv_state_data2	= (float8 *)dt_aggr_state_slots(scv_state2);
 
-    /*
-     * The following elements are just initialized once. If the first
-     * scv_state is not initialized, we copy them from the second scv_state.
-     */ 
-    if (dt_is_float_zero(scv_state_data[SCV_STATE_SPLIT_CRIT]))
-    {
-        scv_state_data[SCV_STATE_SPLIT_CRIT]		=
-        		scv_state_data2[SCV_STATE_SPLIT_CRIT];
-        scv_state_data[SCV_STATE_TRUE_TOTAL_COUNT]	=
-        		scv_state_data2[SCV_STATE_TRUE_TOTAL_COUNT];
-        scv_state_data[SCV_STATE_IS_CONT]			=
-        		scv_state_data2[SCV_STATE_IS_CONT];
-    }
-    
-    /*
-     *  We should compare the results from different segments and
-     *  find the class with maximum cases.
-     */ 
-    if (scv_state_data[SCV_STATE_MAX_CLASS_ELEM_COUNT] <
-    	scv_state_data2[SCV_STATE_MAX_CLASS_ELEM_COUNT])
+    for (int slot = 0;
+    	 slot < header->num_slots;
+    	 slot++, scv_state_data += DT_SCV_SLOT_LEN, scv_state_data2 += DT_SCV_SLOT_LEN
+    	)
     {
-        scv_state_data[SCV_STATE_MAX_CLASS_ELEM_COUNT]	=
-        		scv_state_data2[SCV_STATE_MAX_CLASS_ELEM_COUNT];
-        scv_state_data[SCV_STATE_MAX_CLASS_ID]			=
-        		scv_state_data2[SCV_STATE_MAX_CLASS_ID];
+		/*
+		 * For the following data, such as entropy, gini and split info,
+		 * we need to combine the accumulated value from multiple segments.
+		 */ 
+		scv_state_data[SCV_STATE_TOTAL_ELEM_COUNT]	+=
+				scv_state_data2[SCV_STATE_TOTAL_ELEM_COUNT];
+		scv_state_data[SCV_STATE_ENTROPY_DATA] 		+=
+				scv_state_data2[SCV_STATE_ENTROPY_DATA];
+		scv_state_data[SCV_STATE_SPLIT_INFO_DATA]	+=
+				scv_state_data2[SCV_STATE_SPLIT_INFO_DATA];
+		scv_state_data[SCV_STATE_GINI_DATA]			+=
+				scv_state_data2[SCV_STATE_GINI_DATA];
+
+		/*
+		 * The following elements are just initialized once. If the first
+		 * scv_state is not initialized, we copy them from the second scv_state.
+		 */ 
+		if (dt_is_float_zero(scv_state_data[SCV_STATE_SPLIT_CRIT]))
+		{
+			scv_state_data[SCV_STATE_SPLIT_CRIT]		=
+					scv_state_data2[SCV_STATE_SPLIT_CRIT];
+			scv_state_data[SCV_STATE_TRUE_TOTAL_COUNT]	=
+					scv_state_data2[SCV_STATE_TRUE_TOTAL_COUNT];
+			scv_state_data[SCV_STATE_IS_CONT]			=
+					scv_state_data2[SCV_STATE_IS_CONT];
+		}
+
+		/*
+		 *  We should compare the results from different segments and
+		 *  find the class with maximum cases.
+		 */ 
+		if (scv_state_data[SCV_STATE_MAX_CLASS_ELEM_COUNT] <
+			scv_state_data2[SCV_STATE_MAX_CLASS_ELEM_COUNT])
+		{
+			scv_state_data[SCV_STATE_MAX_CLASS_ELEM_COUNT]	=
+					scv_state_data2[SCV_STATE_MAX_CLASS_ELEM_COUNT];
+			scv_state_data[SCV_STATE_MAX_CLASS_ID]			=
+					scv_state_data2[SCV_STATE_MAX_CLASS_ID];
+		}
     }
 
-    PG_RETURN_ARRAYTYPE_P(scv_state_array);
+    PG_RETURN_BYTEA_P(scv_state);
 }
 PG_FUNCTION_INFO_V1(dt_scv_aggr_prefunc);
 
 
 /*
- * @brief The final function for the aggregation of splitting criteria values.
- *        It takes the state array produced by the sfunc and produces
- *        an eleven-element array.
+ * @brief Compute the eleven-element result for one slot of the SCV state.
  *
- * @param scv_state_array  The array containing all the information for the 
- *                         calculation of splitting criteria values. 
- *
- * @return An eleven element array. Please refer to the definition of 
- *         DT_SCV_FINAL_ARRAY_INDEX for the detailed information of this array.
+ * @param scv_state_data  The slot containing all the information for the 
+ *                        calculation of splitting criteria values. 
+ * @param result          The eleven elements to fill. Please refer to the
+ *                        definition of DT_SCV_FINAL_ARRAY_INDEX.
  *
  */
-Datum
-dt_scv_aggr_ffunc
+static
+void
+dt_scv_aggr_final_slot
 	(
-	PG_FUNCTION_ARGS
+	const float8*	scv_state_data,
+	float8*			result
 	)
 {
-    ArrayType*	scv_state_array	= PG_GETARG_ARRAYTYPE_P(0);
-	dt_check_error
-		(
-			scv_state_array,
-			"invalid aggregation state array"
-		);
-
-    int	 array_dim		= ARR_NDIM(scv_state_array);
-    dt_check_error_value
-		(
-			array_dim == 1,
-			"invalid array dimension: %d. "
-			"The dimension of state array must be equal to 1",
-			array_dim
-		);
-
-    int* p_array_dim 	= ARR_DIMS(scv_state_array);
-    int  array_length 	= ArrayGetNItems(array_dim, p_array_dim);
-
-    dt_check_error_value
-		(
-			array_length == SCV_STATE_MAX_CLASS_ELEM_COUNT + 1,
-			"invalid array length: %d",
-			array_length
-		);
-
-    dtelog(NOTICE, "dt_scv_aggr_ffunc array_length:%d",array_length);
-
-    float8 *scv_state_data = (float8 *)ARR_DATA_PTR(scv_state_array);
-    dt_check_error
-    	(
-    		scv_state_data,
-    		"invalid aggregation data array"
-    	);
-
-    float8 init_scv = scv_state_data[SCV_STATE_INIT_SCV];
-
-    int result_size	= 11;
-    float8 *result	= palloc0(sizeof(float8) * result_size);
-    dt_check_error
-    	(
-    		result,
-    		"memory allocation failure"
-    	);
+    float8 init_scv			= scv_state_data[SCV_STATE_INIT_SCV];
+    float8 true_total_count	= scv_state_data[SCV_STATE_TRUE_TOTAL_COUNT];
 
     dtelog
     	(
@@ -1424,35 +1486,32 @@ dt_scv_aggr_ffunc
     result[SCV_FINAL_CLASS_ID]			= scv_state_data[SCV_STATE_MAX_CLASS_ID];
 
     /* If true total count is 0/null, there is no missing values*/
-    if (!(scv_state_data[SCV_STATE_TRUE_TOTAL_COUNT]>0))
+    if (!(true_total_count > 0))
     {
-        scv_state_data[SCV_STATE_TRUE_TOTAL_COUNT] =
-        		scv_state_data[SCV_STATE_TOTAL_ELEM_COUNT];
+        true_total_count = scv_state_data[SCV_STATE_TOTAL_ELEM_COUNT];
     }
 
     /* true total count should be greater than 0*/
     dt_check_error
     	(
-    		scv_state_data[SCV_STATE_TRUE_TOTAL_COUNT] > 0,
+    		true_total_count > 0,
     		"true total count should be greater than 0"
     	);
 
     /* We use the true total count here in case of missing value. */
-    result[SCV_FINAL_TOTAL_COUNT] = scv_state_data[SCV_STATE_TRUE_TOTAL_COUNT];
+    result[SCV_FINAL_TOTAL_COUNT] = true_total_count;
     float8 ratio 				  = 1;
 
     /*
      * If there is any missing value, we should multiply a ratio for
-     * the computed gain. We already checked
-     * scv_state_data[SCV_STATE_TRUE_TOTAL_COUNT] is greater than 0.
+     * the computed gain. We already checked true_total_count is
+     * greater than 0.
      */
-    ratio = scv_state_data[SCV_STATE_TOTAL_ELEM_COUNT]/
-    		scv_state_data[SCV_STATE_TRUE_TOTAL_COUNT];
+    ratio = scv_state_data[SCV_STATE_TOTAL_ELEM_COUNT] / true_total_count;
 
     /* We use the true total count to compute the probability */
     result[SCV_FINAL_CLASS_PROB] = 
-        scv_state_data[SCV_STATE_MAX_CLASS_ELEM_COUNT]/
-        scv_state_data[SCV_STATE_TRUE_TOTAL_COUNT];
+        scv_state_data[SCV_STATE_MAX_CLASS_ELEM_COUNT] / true_total_count;
 
     if (!dt_is_float_zero(scv_state_data[SCV_STATE_TOTAL_ELEM_COUNT]))
     {
@@ -1527,16 +1586,91 @@ dt_scv_aggr_ffunc
         		"number of total element counts: %lld. ",
         		(int64)scv_state_data[SCV_STATE_TOTAL_ELEM_COUNT]
         	);
+}
 
-    ArrayType* result_array =
-        construct_array(
-            (Datum *)result,
-            result_size,
-            FLOAT8OID,
-            sizeof(float8),
-            true,
-            'd'
-            );
+
+/*
+ * @brief The final function for the aggregation of splitting criteria values.
+ *        It takes the state produced by the sfunc and produces an
+ *        eleven-element array for each of its slots.
+ *
+ * @param scv_state  The state containing all the information for the 
+ *                   calculation of splitting criteria values. 
+ *
+ * @return An eleven element array if the state has a single slot, or a
+ *         (num_slots x 11) array otherwise. Slots without any records are
+ *         returned as zeros. Please refer to the definition of 
+ *         DT_SCV_FINAL_ARRAY_INDEX for the detailed information of this array.
+ *
+ */
+Datum
+dt_scv_aggr_ffunc
+	(
+	PG_FUNCTION_ARGS
+	)
+{
+    bytea*	scv_state				= PG_GETARG_BYTEA_P(0);
+    dt_aggr_state_header* header	=
+    	dt_check_aggr_state(scv_state, DT_SCV_STATE_MAGIC, DT_SCV_SLOT_SIZE);
+
+    dtelog(NOTICE, "dt_scv_aggr_ffunc num_slots:%d", header->num_slots);
+
+    const float8 *scv_state_data = (float8 *)dt_aggr_state_slots(scv_state);
+
+    int result_size	= SCV_FINAL_TOTAL_COUNT + 1;
+    float8 *result	= palloc0(sizeof(float8) * result_size * header->num_slots);
+    dt_check_error
+    	(
+    		result,
+    		"memory allocation failure"
+    	);
+
+    ArrayType* result_array = NULL;
+    if (1 == header->num_slots)
+    {
+    	dt_scv_aggr_final_slot(scv_state_data, result);
+
+		result_array =
+			construct_array(
+				(Datum *)result,
+				result_size,
+				FLOAT8OID,
+				sizeof(float8),
+				true,
+				'd'
+				);
+    }
+    else
+    {
+    	for (int slot = 0; slot < header->num_slots; slot++)
+    	{
+    		if (!dt_is_float_zero
+    				(
+    				scv_state_data[slot * DT_SCV_SLOT_LEN + 
+    							   SCV_STATE_TOTAL_ELEM_COUNT]
+    				))
+    			dt_scv_aggr_final_slot
+    				(
+    					scv_state_data + slot * DT_SCV_SLOT_LEN,
+    					result + slot * result_size
+    				);
+    	}
+
+    	int dims[2]	= {header->num_slots, result_size};
+    	int lbs[2]	= {1, 1};
+		result_array =
+			construct_md_array(
+				(Datum *)result,
+				NULL,
+				2,
+				dims,
+				lbs,
+				FLOAT8OID,
+				sizeof(float8),
+				true,
+				'd'
+				);
+    }
 
     PG_RETURN_ARRAYTYPE_P(result_array);
 }
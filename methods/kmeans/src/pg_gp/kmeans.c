@@ -1,10 +1,13 @@
 #include <postgres.h>
+#include <catalog/pg_type.h>
 #include <nodes/memnodes.h>
 #include <utils/builtins.h>
 #include <utils/memutils.h>
 #include "../../../svec/src/pg_gp/sparse_vector.h"
 #include "../../../svec/src/pg_gp/operators.h"
 
+#include <math.h>
+
 typedef enum {
     L1NORM = 1,
     L2NORM,
@@ -91,6 +94,37 @@ compute_metric(PGFunction inMetricFn, MemoryContext inMemContext, Datum inVec1,
     return distance;
 }
 
+/*
+ * Bounds derived from the triangle inequality are only valid for metrics that
+ * actually satisfy it. The Tanimoto distance does not in general (only for
+ * binary vectors), so for it we always fall back to the exhaustive search.
+ */
+static
+inline
+bool
+metric_allows_bounds(KMeansMetric inMetric)
+{
+    return inMetric == L1NORM || inMetric == L2NORM || inMetric == COSINE;
+}
+
+static
+ArrayType *
+construct_float8_array(const float8 *inValues, int inLen)
+{
+    ArrayType      *arr;
+    size_t          bytes;
+
+    bytes = ARR_OVERHEAD_NONULLS(1) + sizeof(float8) * inLen;
+    arr = (ArrayType *) palloc0(bytes);
+    SET_VARSIZE(arr, bytes);
+    ARR_ELEMTYPE(arr) = FLOAT8OID;
+    ARR_NDIM(arr) = 1;
+    ARR_DIMS(arr)[0] = inLen;
+    ARR_LBOUND(arr)[0] = 1;
+    memcpy(ARR_DATA_PTR(arr), inValues, sizeof(float8) * inLen);
+    return arr;
+}
+
 static
 MemoryContext
 setup_mem_context_for_functional_calls() {
@@ -205,6 +239,197 @@ internal_kmeans_closest_centroid(PG_FUNCTION_ARGS) {
     PG_RETURN_INT32(closest_centroid + ARR_LBOUND(centroids_arr)[0]);
 }
 
+/*
+ * Per-iteration centroid statistics for the bounded (Hamerly) assignment step.
+ *
+ * Returns an array of length 2k: elements 1..k hold the distance each centroid
+ * moved since the previous iteration (0 if there is no previous iteration),
+ * elements k+1..2k hold half the distance from each centroid to its closest
+ * other centroid. A point whose distance to its centroid c is at most the
+ * latter value cannot be closer to any other centroid.
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_centroid_bounds);
+Datum
+internal_kmeans_centroid_bounds(PG_FUNCTION_ARGS) {
+    Datum          *centroids;
+    int             num_centroids;
+    Datum          *prev_centroids = NULL;
+    int             num_prev_centroids = 0;
+    PGFunction      metric_fn;
+
+    float8         *bounds;
+    float8         *shifts;
+    float8         *half_gaps;
+    float8          distance;
+    MemoryContext   mem_context_for_function_calls;
+
+    get_svec_array_elms(PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 0)),
+        &centroids, &num_centroids);
+    if (!PG_ARGISNULL(1)) {
+        get_svec_array_elms(PG_GETARG_ARRAYTYPE_P(1), &prev_centroids,
+            &num_prev_centroids);
+        if (num_prev_centroids != num_centroids)
+            ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("internal error: number of centroids changed between "
+                    "iterations")));
+    }
+    metric_fn = get_metric_fn(PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 2)));
+
+    bounds = (float8 *) palloc(sizeof(float8) * 2 * num_centroids);
+    shifts = bounds;
+    half_gaps = bounds + num_centroids;
+    for (int i = 0; i < num_centroids; i++) {
+        shifts[i] = 0;
+        half_gaps[i] = INFINITY;
+    }
+
+    mem_context_for_function_calls = setup_mem_context_for_functional_calls();
+    if (prev_centroids != NULL) {
+        for (int i = 0; i < num_centroids; i++)
+            shifts[i] = compute_metric(metric_fn,
+                mem_context_for_function_calls, centroids[i],
+                prev_centroids[i]);
+    }
+    /* The distance matrix is symmetric, so only its upper half is computed */
+    for (int i = 0; i < num_centroids; i++) {
+        for (int j = i + 1; j < num_centroids; j++) {
+            distance = compute_metric(metric_fn,
+                mem_context_for_function_calls, centroids[i], centroids[j])
+                / 2;
+            if (distance < half_gaps[i])
+                half_gaps[i] = distance;
+            if (distance < half_gaps[j])
+                half_gaps[j] = distance;
+        }
+    }
+    MemoryContextDelete(mem_context_for_function_calls);
+
+    PG_RETURN_ARRAYTYPE_P(construct_float8_array(bounds, 2 * num_centroids));
+}
+
+/*
+ * Bounded variant of internal_kmeans_closest_centroid(), following
+ * G. Hamerly: Making k-means even faster, SDM 2010.
+ *
+ * Each point carries its current centroid id, an upper bound on the distance
+ * to that centroid and a lower bound on the distance to every other
+ * (candidate) centroid. After the bounds have been adjusted by how far the
+ * centroids moved, the distances only need to be evaluated if the upper bound
+ * exceeds both the lower bound and half the distance to the closest other
+ * centroid. In later iterations, this is true only for a small fraction of
+ * the points.
+ *
+ * Returns the array (cid, upper bound, lower bound). If the previous
+ * assignment or the bounds are NULL, all candidate centroids are searched.
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_closest_centroid_bounded);
+Datum
+internal_kmeans_closest_centroid_bounded(PG_FUNCTION_ARGS) {
+    SvecType       *svec;
+    ArrayType      *canopy_ids_arr = NULL;
+    int4           *canopy_ids = NULL;
+    ArrayType      *centroids_arr;
+    Datum          *centroids;
+    int             num_centroids;
+    int             num_candidates;
+    ArrayType      *bounds_arr;
+    float8         *shifts;
+    float8         *half_gaps;
+    KMeansMetric    metric;
+    PGFunction      metric_fn;
+
+    bool            indirect;
+    bool            have_bounds;
+    int             prev_centroid = -1;
+    float8          upper = INFINITY, lower = 0;
+    float8          max_other_shift = 0;
+    float8          distance, min_distance = INFINITY;
+    float8          second_min_distance = INFINITY;
+    int             closest_centroid = 0;
+    int             cid;
+    float8          result[3];
+    MemoryContext   mem_context_for_function_calls;
+
+    svec = PG_GETARG_SVECTYPE_P(verify_arg_nonnull(fcinfo, 0));
+    if (PG_ARGISNULL(1)) {
+        indirect = false;
+    } else {
+        indirect = true;
+        canopy_ids_arr = PG_GETARG_ARRAYTYPE_P(1);
+        if (ARR_NDIM(canopy_ids_arr) == 0)
+            ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("internal error: array of close canopies cannot be empty")));
+        canopy_ids = (int4*) ARR_DATA_PTR(canopy_ids_arr);
+    }
+    centroids_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 5));
+    get_svec_array_elms(centroids_arr, &centroids, &num_centroids);
+    num_candidates = indirect ? ARR_DIMS(canopy_ids_arr)[0] : num_centroids;
+    bounds_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 6));
+    if (ARR_NDIM(bounds_arr) != 1
+        || ARR_DIMS(bounds_arr)[0] != 2 * num_centroids
+        || ARR_HASNULL(bounds_arr))
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("internal error: centroid bounds do not match centroids")));
+    shifts = (float8 *) ARR_DATA_PTR(bounds_arr);
+    half_gaps = shifts + num_centroids;
+    metric = PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 7));
+    metric_fn = get_metric_fn(metric);
+
+    have_bounds = metric_allows_bounds(metric)
+        && !PG_ARGISNULL(2) && !PG_ARGISNULL(3) && !PG_ARGISNULL(4);
+    if (have_bounds) {
+        prev_centroid = PG_GETARG_INT32(2) - ARR_LBOUND(centroids_arr)[0];
+        have_bounds = prev_centroid >= 0 && prev_centroid < num_centroids;
+    }
+
+    mem_context_for_function_calls = setup_mem_context_for_functional_calls();
+    if (have_bounds) {
+        for (int i = 0; i < num_centroids; i++)
+            if (i != prev_centroid && shifts[i] > max_other_shift)
+                max_other_shift = shifts[i];
+        upper = PG_GETARG_FLOAT8(3) + shifts[prev_centroid];
+        lower = PG_GETARG_FLOAT8(4) - max_other_shift;
+
+        if (upper > lower && upper > half_gaps[prev_centroid]) {
+            /* Tighten the upper bound and test again */
+            upper = compute_metric(metric_fn, mem_context_for_function_calls,
+                PointerGetDatum(svec), centroids[prev_centroid]);
+        }
+        if (upper <= lower || upper <= half_gaps[prev_centroid]) {
+            MemoryContextDelete(mem_context_for_function_calls);
+            result[0] = prev_centroid + ARR_LBOUND(centroids_arr)[0];
+            result[1] = upper;
+            result[2] = lower;
+            PG_RETURN_ARRAYTYPE_P(construct_float8_array(result, 3));
+        }
+    }
+
+    for (int i = 0; i < num_candidates; i++) {
+        cid = indirect ? canopy_ids[i] - ARR_LBOUND(canopy_ids_arr)[0] : i;
+        if (cid == prev_centroid)
+            distance = upper;
+        else
+            distance = compute_metric(metric_fn, mem_context_for_function_calls,
+                PointerGetDatum(svec), centroids[cid]);
+        if (distance < min_distance) {
+            second_min_distance = min_distance;
+            closest_centroid = cid;
+            min_distance = distance;
+        } else if (distance < second_min_distance) {
+            second_min_distance = distance;
+        }
+    }
+    MemoryContextDelete(mem_context_for_function_calls);
+
+    result[0] = closest_centroid + ARR_LBOUND(centroids_arr)[0];
+    result[1] = min_distance;
+    result[2] = second_min_distance;
+    PG_RETURN_ARRAYTYPE_P(construct_float8_array(result, 3));
+}
+
 PG_FUNCTION_INFO_V1(internal_kmeans_canopy_transition);
 Datum
 internal_kmeans_canopy_transition(PG_FUNCTION_ARGS) {
@@ -295,3 +520,837 @@ internal_remove_close_canopies(PG_FUNCTION_ARGS) {
             'd') /* elmalign */
         );
 }
+
+/*
+ * State of the single-scan k-means iteration UDA:kmeans_step(), a FLOAT8[]
+ * with the following layout:
+ *
+ *   [0]                  number of centroids k
+ *   [1]                  dimension d
+ *   [2]                  number of points
+ *   [3]                  number of points that changed their assignment
+ *   [4, 4 + k)           number of points assigned to each centroid
+ *   [4 + k, 4 + k + kd)  coordinate sums of the points assigned to each
+ *                        centroid (row-major, one row per centroid)
+ */
+#define KMEANS_STEP_HEADER_LEN 4
+
+static
+inline
+void
+find_closest_centroids(PGFunction inMetricFn, MemoryContext inMemContext,
+    Datum inPoint, Datum *inCentroids, ArrayType *inCanopyIdsArr,
+    int inNumCandidates, int *outClosest, float8 *outMinDistance,
+    float8 *outSecondMinDistance)
+{
+    int4           *canopy_ids = NULL;
+    int             cid;
+    float8          distance;
+
+    if (inCanopyIdsArr != NULL)
+        canopy_ids = (int4 *) ARR_DATA_PTR(inCanopyIdsArr);
+
+    *outClosest = 0;
+    *outMinDistance = INFINITY;
+    *outSecondMinDistance = INFINITY;
+    for (int i = 0; i < inNumCandidates; i++) {
+        cid = canopy_ids != NULL
+            ? canopy_ids[i] - ARR_LBOUND(inCanopyIdsArr)[0]
+            : i;
+        distance = compute_metric(inMetricFn, inMemContext, inPoint,
+            inCentroids[cid]);
+        if (distance < *outMinDistance) {
+            *outSecondMinDistance = *outMinDistance;
+            *outClosest = cid;
+            *outMinDistance = distance;
+        } else if (distance < *outSecondMinDistance) {
+            *outSecondMinDistance = distance;
+        }
+    }
+}
+
+/*
+ * Transition function of UDA:kmeans_step().
+ *
+ * Assigns the point to its closest centroid and adds it to that centroid's
+ * coordinate sum. For cosine and tanimoto, the normalized point is added,
+ * which matches the barycenter used by the multi-statement iteration.
+ *
+ * To decide whether the point changed its assignment, we would need its
+ * closest centroid in the previous iteration. By the triangle inequality, the
+ * distance to each previous centroid differs from the distance to the current
+ * one by at most the centroid shift, so the previous assignment is known to
+ * be the same whenever
+ *   d(x, c_a) + shift(a) < d(x, c_second) - max_{j != a} shift(j).
+ * Only if this test fails do we search the previous centroids.
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_step_transition);
+Datum
+internal_kmeans_step_transition(PG_FUNCTION_ARGS) {
+    ArrayType      *state_arr;
+    float8         *state;
+    SvecType       *svec;
+    float8         *point;
+    int             dim;
+    ArrayType      *canopy_ids_arr = NULL;
+    ArrayType      *centroids_arr;
+    Datum          *centroids;
+    int             num_centroids;
+    int             num_candidates;
+    ArrayType      *bounds_arr;
+    float8         *shifts;
+    Datum          *prev_centroids = NULL;
+    int             num_prev_centroids;
+    KMeansMetric    metric;
+    PGFunction      metric_fn;
+
+    int             closest, prev_closest;
+    float8          min_distance, second_min_distance;
+    float8          max_other_shift = 0;
+    float8          norm = 0;
+    float8         *sums;
+    size_t          state_len;
+    MemoryContext   mem_context_for_function_calls;
+
+    svec = PG_GETARG_SVECTYPE_P(verify_arg_nonnull(fcinfo, 1));
+    if (!PG_ARGISNULL(2)) {
+        canopy_ids_arr = PG_GETARG_ARRAYTYPE_P(2);
+        if (ARR_NDIM(canopy_ids_arr) == 0)
+            ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("internal error: array of close canopies cannot be empty")));
+    }
+    centroids_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 3));
+    get_svec_array_elms(centroids_arr, &centroids, &num_centroids);
+    num_candidates = canopy_ids_arr != NULL
+        ? ARR_DIMS(canopy_ids_arr)[0]
+        : num_centroids;
+    bounds_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 4));
+    if (ARR_NDIM(bounds_arr) != 1
+        || ARR_DIMS(bounds_arr)[0] != 2 * num_centroids
+        || ARR_HASNULL(bounds_arr))
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("internal error: centroid bounds do not match centroids")));
+    shifts = (float8 *) ARR_DATA_PTR(bounds_arr);
+    if (!PG_ARGISNULL(5)) {
+        get_svec_array_elms(PG_GETARG_ARRAYTYPE_P(5), &prev_centroids,
+            &num_prev_centroids);
+        if (num_prev_centroids != num_centroids)
+            ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("internal error: number of centroids changed between "
+                    "iterations")));
+    }
+    metric = PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 6));
+    metric_fn = get_metric_fn(metric);
+
+    dim = svec->dimension;
+    if (PG_ARGISNULL(0)) {
+        /* This is the first call, so create a new state array */
+        state_len = KMEANS_STEP_HEADER_LEN
+            + (size_t) num_centroids * (dim + 1);
+        if (state_len
+            > (MaxAllocSize - ARR_OVERHEAD_NONULLS(1)) / sizeof(float8))
+            ereport(ERROR,
+                (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+                 errmsg("kmeans_step: %d centroids of dimension %d exceed the "
+                    "maximum state size", num_centroids, dim)));
+        state = (float8 *) palloc0(state_len * sizeof(float8));
+        state[0] = num_centroids;
+        state[1] = dim;
+        state_arr = construct_float8_array(state, state_len);
+        pfree(state);
+    } else if (fcinfo->context && IsA(fcinfo->context, AggState))
+        state_arr = PG_GETARG_ARRAYTYPE_P(0);
+    else
+        state_arr = PG_GETARG_ARRAYTYPE_P_COPY(0);
+    state = (float8 *) ARR_DATA_PTR(state_arr);
+
+    if (state[0] != num_centroids || state[1] != dim)
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("kmeans_step: expected %d centroids of dimension %d, but "
+                "got %d centroids and a point of dimension %d",
+                (int) state[0], (int) state[1], num_centroids, dim)));
+
+    mem_context_for_function_calls = setup_mem_context_for_functional_calls();
+    find_closest_centroids(metric_fn, mem_context_for_function_calls,
+        PointerGetDatum(svec), centroids, canopy_ids_arr, num_candidates,
+        &closest, &min_distance, &second_min_distance);
+
+    if (prev_centroids == NULL) {
+        /* First iteration: every point counts as reassigned */
+        prev_closest = -1;
+    } else {
+        prev_closest = closest;
+        for (int i = 0; i < num_centroids; i++)
+            if (i != closest && shifts[i] > max_other_shift)
+                max_other_shift = shifts[i];
+        if (!metric_allows_bounds(metric)
+            || !(min_distance + shifts[closest]
+                    < second_min_distance - max_other_shift)) {
+            float8 ignored_min, ignored_second_min;
+
+            find_closest_centroids(metric_fn, mem_context_for_function_calls,
+                PointerGetDatum(svec), prev_centroids, canopy_ids_arr,
+                num_candidates, &prev_closest, &ignored_min,
+                &ignored_second_min);
+        }
+    }
+    MemoryContextDelete(mem_context_for_function_calls);
+
+    point = sdata_to_float8arr(sdata_from_svec(svec));
+    if (metric == COSINE || metric == TANIMOTO) {
+        for (int i = 0; i < dim; i++)
+            norm += point[i] * point[i];
+        norm = sqrt(norm);
+    }
+    if (norm == 0)
+        norm = 1;
+
+    sums = state + KMEANS_STEP_HEADER_LEN + num_centroids
+        + (size_t) closest * dim;
+    for (int i = 0; i < dim; i++)
+        sums[i] += point[i] / norm;
+    state[KMEANS_STEP_HEADER_LEN + closest]++;
+    state[2]++;
+    if (prev_closest != closest)
+        state[3]++;
+
+    PG_RETURN_ARRAYTYPE_P(state_arr);
+}
+
+/*
+ * Preliminary merge function of UDA:kmeans_step()
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_step_merge);
+Datum
+internal_kmeans_step_merge(PG_FUNCTION_ARGS) {
+    ArrayType      *state1_arr, *state2_arr;
+    float8         *state1, *state2;
+    int             len;
+
+    if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+        PG_RETURN_NULL();
+    if (PG_ARGISNULL(0))
+        PG_RETURN_ARRAYTYPE_P(PG_GETARG_ARRAYTYPE_P(1));
+    if (PG_ARGISNULL(1))
+        PG_RETURN_ARRAYTYPE_P(PG_GETARG_ARRAYTYPE_P(0));
+
+    if (fcinfo->context && IsA(fcinfo->context, AggState))
+        state1_arr = PG_GETARG_ARRAYTYPE_P(0);
+    else
+        state1_arr = PG_GETARG_ARRAYTYPE_P_COPY(0);
+    state2_arr = PG_GETARG_ARRAYTYPE_P(1);
+    state1 = (float8 *) ARR_DATA_PTR(state1_arr);
+    state2 = (float8 *) ARR_DATA_PTR(state2_arr);
+    len = ARR_DIMS(state1_arr)[0];
+
+    if (len != ARR_DIMS(state2_arr)[0]
+        || state1[0] != state2[0] || state1[1] != state2[1])
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("kmeans_step: cannot merge states of different "
+                "dimensions")));
+
+    for (int i = 2; i < len; i++)
+        state1[i] += state2[i];
+
+    PG_RETURN_ARRAYTYPE_P(state1_arr);
+}
+
+/*
+ * Compute the next centroids from the state of UDA:kmeans_step(). Centroids
+ * without any assigned point keep their old position.
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_step_centroids);
+Datum
+internal_kmeans_step_centroids(PG_FUNCTION_ARGS) {
+    ArrayType      *state_arr;
+    float8         *state;
+    ArrayType      *centroids_arr;
+    Datum          *centroids;
+    int             num_centroids;
+    int             dim;
+    float8         *counts;
+    float8         *sums;
+    float8         *mean;
+    Datum          *new_centroids;
+
+    state_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 0));
+    state = (float8 *) ARR_DATA_PTR(state_arr);
+    centroids_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 1));
+    get_svec_array_elms(centroids_arr, &centroids, &num_centroids);
+
+    if (ARR_DIMS(state_arr)[0] < KMEANS_STEP_HEADER_LEN
+        || state[0] != num_centroids
+        || ARR_DIMS(state_arr)[0] != KMEANS_STEP_HEADER_LEN
+            + num_centroids * (state[1] + 1))
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("internal error: k-means state does not match centroids")));
+    dim = (int) state[1];
+    counts = state + KMEANS_STEP_HEADER_LEN;
+    sums = counts + num_centroids;
+
+    mean = (float8 *) palloc(sizeof(float8) * dim);
+    new_centroids = (Datum *) palloc(sizeof(Datum) * num_centroids);
+    for (int i = 0; i < num_centroids; i++, sums += dim) {
+        if (counts[i] == 0) {
+            new_centroids[i] = centroids[i];
+            continue;
+        }
+        for (int j = 0; j < dim; j++)
+            mean[j] = sums[j] / counts[i];
+        new_centroids[i] = PointerGetDatum(svec_from_float8arr(mean, dim));
+    }
+
+    PG_RETURN_ARRAYTYPE_P(
+        construct_array(
+            new_centroids, /* elems */
+            num_centroids, /* nelems */
+            ARR_ELEMTYPE(centroids_arr), /* elmtype */
+            -1, /* elmlen */
+            false, /* elmbyval */
+            'd') /* elmalign */
+        );
+}
+
+/*
+ * Return the number of points that changed their assignment, from the state
+ * of UDA:kmeans_step()
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_step_reassigned);
+Datum
+internal_kmeans_step_reassigned(PG_FUNCTION_ARGS) {
+    ArrayType      *state_arr;
+
+    state_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 0));
+    if (ARR_DIMS(state_arr)[0] < KMEANS_STEP_HEADER_LEN)
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("internal error: invalid k-means state")));
+
+    PG_RETURN_INT64((int64) ((float8 *) ARR_DATA_PTR(state_arr))[3]);
+}
+
+/*
+ * State of the k-means|| sampling UDA:kmeans_parallel_sample(), a FLOAT8[]
+ * with the following layout:
+ *
+ *   [0]                  dimension d
+ *   [1]                  capacity M (maximum number of retained points)
+ *   [2]                  sum of squared distances to the candidate set, phi
+ *   [3]                  number m of retained points
+ *   [4, 4 + M)           sampling keys of the retained points (max-heap)
+ *   [4 + M, 4 + M + Md)  coordinates of the retained points (row-major)
+ *
+ * k-means|| (Bahmani et al.: Scalable k-means++, VLDB 2012) samples each point
+ * x independently with probability min(1, l * D(x)^2 / phi), where D(x) is the
+ * distance to the current candidate set and l is the oversampling factor.
+ * Since phi is only known after the scan, each point instead draws a key
+ * u / D(x)^2 with u uniform in (0, 1], and we retain the M points with the
+ * smallest keys. A point is then sampled if and only if its key is at most
+ * l / phi. With M >= 2l, the expected number of sampled points l is very
+ * unlikely to exceed the capacity.
+ */
+#define KMEANS_PARALLEL_HEADER_LEN 4
+
+static
+inline
+double
+kmeans_uniform_random()
+{
+    /* uniform in the open interval (0, 1) */
+    return (random() + 1.0) / (RAND_MAX + 2.0);
+}
+
+/*
+ * Move the retained point in slot inFrom of the sampling state to slot inTo
+ */
+static
+inline
+void
+kmeans_parallel_move(float8 *inKeys, int inCapacity, int inDim, int inFrom,
+    int inTo)
+{
+    inKeys[inTo] = inKeys[inFrom];
+    memcpy(inKeys + inCapacity + (size_t) inTo * inDim,
+        inKeys + inCapacity + (size_t) inFrom * inDim,
+        sizeof(float8) * inDim);
+}
+
+/*
+ * Retain a point with the given key in the sampling state, evicting the point
+ * with the largest key if the state is full. Returns a pointer to the
+ * coordinates to fill in, or NULL if the point is not retained.
+ *
+ * The keys form a binary max-heap, so the largest key is always in slot 0.
+ * Once the state is full, most points are rejected after a single comparison
+ * with it; otherwise, retaining a point takes O(log M) moves.
+ */
+static
+float8 *
+kmeans_parallel_retain(float8 *inState, float8 inKey)
+{
+    int             dim = (int) inState[0];
+    int             capacity = (int) inState[1];
+    int             size = (int) inState[3];
+    float8         *keys = inState + KMEANS_PARALLEL_HEADER_LEN;
+    int             hole, parent, child;
+
+    if (size < capacity) {
+        /* Sift up from a new leaf */
+        hole = size;
+        inState[3] = size + 1;
+        while (hole > 0) {
+            parent = (hole - 1) / 2;
+            if (keys[parent] >= inKey)
+                break;
+            kmeans_parallel_move(keys, capacity, dim, parent, hole);
+            hole = parent;
+        }
+    } else {
+        if (capacity == 0 || inKey >= keys[0])
+            return NULL;
+
+        /* Replace the root and sift down */
+        hole = 0;
+        while ((child = 2 * hole + 1) < capacity) {
+            if (child + 1 < capacity && keys[child + 1] > keys[child])
+                child++;
+            if (keys[child] <= inKey)
+                break;
+            kmeans_parallel_move(keys, capacity, dim, child, hole);
+            hole = child;
+        }
+    }
+    keys[hole] = inKey;
+    return keys + capacity + (size_t) hole * dim;
+}
+
+/*
+ * Transition function of UDA:kmeans_parallel_sample()
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_parallel_transition);
+Datum
+internal_kmeans_parallel_transition(PG_FUNCTION_ARGS) {
+    ArrayType      *state_arr;
+    float8         *state;
+    SvecType       *svec;
+    int             dim;
+    Datum          *candidates;
+    int             num_candidates;
+    int             capacity;
+    PGFunction      metric_fn;
+
+    int             closest;
+    float8          min_distance, second_min_distance;
+    float8          squared_distance;
+    float8         *coords;
+    float8         *point;
+    size_t          state_len;
+    MemoryContext   mem_context_for_function_calls;
+
+    svec = PG_GETARG_SVECTYPE_P(verify_arg_nonnull(fcinfo, 1));
+    get_svec_array_elms(PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 2)),
+        &candidates, &num_candidates);
+    capacity = PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 3));
+    metric_fn = get_metric_fn(PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 4)));
+    dim = svec->dimension;
+
+    if (capacity < 0)
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("kmeans_parallel_sample: capacity must be non-negative")));
+    if (num_candidates == 0)
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("kmeans_parallel_sample: candidate set must not be empty")));
+
+    if (PG_ARGISNULL(0)) {
+        /* This is the first call, so create a new state array */
+        state_len = KMEANS_PARALLEL_HEADER_LEN + (size_t) capacity * (dim + 1);
+        if (state_len
+            > (MaxAllocSize - ARR_OVERHEAD_NONULLS(1)) / sizeof(float8))
+            ereport(ERROR,
+                (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+                 errmsg("kmeans_parallel_sample: %d points of dimension %d "
+                    "exceed the maximum state size", capacity, dim)));
+        state = (float8 *) palloc0(state_len * sizeof(float8));
+        state[0] = dim;
+        state[1] = capacity;
+        state_arr = construct_float8_array(state, state_len);
+        pfree(state);
+    } else if (fcinfo->context && IsA(fcinfo->context, AggState))
+        state_arr = PG_GETARG_ARRAYTYPE_P(0);
+    else
+        state_arr = PG_GETARG_ARRAYTYPE_P_COPY(0);
+    state = (float8 *) ARR_DATA_PTR(state_arr);
+
+    if (state[0] != dim || state[1] != capacity)
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("kmeans_parallel_sample: expected points of dimension %d, "
+                "but got dimension %d", (int) state[0], dim)));
+
+    mem_context_for_function_calls = setup_mem_context_for_functional_calls();
+    find_closest_centroids(metric_fn, mem_context_for_function_calls,
+        PointerGetDatum(svec), candidates, NULL, num_candidates,
+        &closest, &min_distance, &second_min_distance);
+    MemoryContextDelete(mem_context_for_function_calls);
+
+    squared_distance = min_distance * min_distance;
+    state[2] += squared_distance;
+    /* Points that coincide with a candidate are never sampled */
+    if (squared_distance > 0) {
+        coords = kmeans_parallel_retain(state,
+            kmeans_uniform_random() / squared_distance);
+        if (coords != NULL) {
+            point = sdata_to_float8arr(sdata_from_svec(svec));
+            memcpy(coords, point, sizeof(float8) * dim);
+        }
+    }
+
+    PG_RETURN_ARRAYTYPE_P(state_arr);
+}
+
+/*
+ * Preliminary merge function of UDA:kmeans_parallel_sample()
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_parallel_merge);
+Datum
+internal_kmeans_parallel_merge(PG_FUNCTION_ARGS) {
+    ArrayType      *state1_arr, *state2_arr;
+    float8         *state1, *state2;
+    int             dim, capacity;
+    float8         *coords;
+
+    if (PG_ARGISNULL(0) && PG_ARGISNULL(1))
+        PG_RETURN_NULL();
+    if (PG_ARGISNULL(0))
+        PG_RETURN_ARRAYTYPE_P(PG_GETARG_ARRAYTYPE_P(1));
+    if (PG_ARGISNULL(1))
+        PG_RETURN_ARRAYTYPE_P(PG_GETARG_ARRAYTYPE_P(0));
+
+    if (fcinfo->context && IsA(fcinfo->context, AggState))
+        state1_arr = PG_GETARG_ARRAYTYPE_P(0);
+    else
+        state1_arr = PG_GETARG_ARRAYTYPE_P_COPY(0);
+    state2_arr = PG_GETARG_ARRAYTYPE_P(1);
+    state1 = (float8 *) ARR_DATA_PTR(state1_arr);
+    state2 = (float8 *) ARR_DATA_PTR(state2_arr);
+
+    if (ARR_DIMS(state1_arr)[0] != ARR_DIMS(state2_arr)[0]
+        || state1[0] != state2[0] || state1[1] != state2[1])
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("kmeans_parallel_sample: cannot merge states of different "
+                "dimensions")));
+    dim = (int) state2[0];
+    capacity = (int) state2[1];
+
+    state1[2] += state2[2];
+    for (int i = 0; i < (int) state2[3]; i++) {
+        coords = kmeans_parallel_retain(state1,
+            state2[KMEANS_PARALLEL_HEADER_LEN + i]);
+        if (coords != NULL)
+            memcpy(coords,
+                state2 + KMEANS_PARALLEL_HEADER_LEN + capacity
+                    + (size_t) i * dim,
+                sizeof(float8) * dim);
+    }
+
+    PG_RETURN_ARRAYTYPE_P(state1_arr);
+}
+
+/*
+ * Append the points sampled by UDA:kmeans_parallel_sample() to the candidate
+ * set
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_parallel_candidates);
+Datum
+internal_kmeans_parallel_candidates(PG_FUNCTION_ARGS) {
+    ArrayType      *state_arr;
+    float8         *state;
+    ArrayType      *candidates_arr;
+    Datum          *candidates;
+    int             num_candidates;
+    float8          oversampling;
+    int             dim, capacity;
+    float8          threshold;
+    Datum          *new_candidates;
+    int             num_new_candidates;
+
+    state_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 0));
+    state = (float8 *) ARR_DATA_PTR(state_arr);
+    candidates_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 1));
+    get_svec_array_elms(candidates_arr, &candidates, &num_candidates);
+    oversampling = PG_GETARG_FLOAT8(verify_arg_nonnull(fcinfo, 2));
+
+    if (ARR_DIMS(state_arr)[0] < KMEANS_PARALLEL_HEADER_LEN
+        || ARR_DIMS(state_arr)[0] != KMEANS_PARALLEL_HEADER_LEN
+            + state[1] * (state[0] + 1))
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("internal error: invalid k-means|| state")));
+    dim = (int) state[0];
+    capacity = (int) state[1];
+    threshold = state[2] > 0 ? oversampling / state[2] : 0;
+
+    new_candidates = (Datum *) palloc(sizeof(Datum)
+        * (num_candidates + (int) state[3]));
+    memcpy(new_candidates, candidates, sizeof(Datum) * num_candidates);
+    num_new_candidates = num_candidates;
+    for (int i = 0; i < (int) state[3]; i++) {
+        if (state[KMEANS_PARALLEL_HEADER_LEN + i] <= threshold)
+            new_candidates[num_new_candidates++] = PointerGetDatum(
+                svec_from_float8arr(
+                    state + KMEANS_PARALLEL_HEADER_LEN + capacity
+                        + (size_t) i * dim,
+                    dim));
+    }
+
+    PG_RETURN_ARRAYTYPE_P(
+        construct_array(
+            new_candidates, /* elems */
+            num_new_candidates, /* nelems */
+            ARR_ELEMTYPE(candidates_arr), /* elmtype */
+            -1, /* elmlen */
+            false, /* elmbyval */
+            'd') /* elmalign */
+        );
+}
+
+/*
+ * Select k centroids among weighted candidates using kmeans++ seeding, where
+ * the probability of picking a candidate is proportional to its weight times
+ * its minimum squared distance to the centroids picked so far. Runs entirely
+ * in memory, so it is meant for the small candidate set of k-means||.
+ *
+ * Fewer than k centroids are returned if there are fewer than k distinct
+ * candidates with positive weight.
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_weighted_plusplus);
+Datum
+internal_kmeans_weighted_plusplus(PG_FUNCTION_ARGS) {
+    ArrayType      *candidates_arr;
+    Datum          *candidates;
+    int             num_candidates;
+    ArrayType      *weights_arr;
+    float8         *weights;
+    int             k;
+    PGFunction      metric_fn;
+
+    float8         *min_distances;
+    Datum          *centroids;
+    int             num_centroids = 0;
+    int             picked;
+    float8          total, target, distance;
+    MemoryContext   mem_context_for_function_calls;
+
+    candidates_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 0));
+    get_svec_array_elms(candidates_arr, &candidates, &num_candidates);
+    weights_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 1));
+    k = PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 2));
+    metric_fn = get_metric_fn(PG_GETARG_INT32(verify_arg_nonnull(fcinfo, 3)));
+
+    if (ARR_NDIM(weights_arr) != 1
+        || ARR_DIMS(weights_arr)[0] != num_candidates
+        || ARR_HASNULL(weights_arr))
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("kmeans_weighted_plusplus: expected one weight per "
+                "candidate")));
+    if (k <= 0)
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("kmeans_weighted_plusplus: k must be positive")));
+    weights = (float8 *) ARR_DATA_PTR(weights_arr);
+
+    /* Before the first pick, all distances are conceptually equal */
+    min_distances = (float8 *) palloc(sizeof(float8) * num_candidates);
+    for (int i = 0; i < num_candidates; i++)
+        min_distances[i] = 1;
+    centroids = (Datum *) palloc(sizeof(Datum) * Min(k, num_candidates));
+
+    mem_context_for_function_calls = setup_mem_context_for_functional_calls();
+    while (num_centroids < k) {
+        total = 0;
+        for (int i = 0; i < num_candidates; i++)
+            total += weights[i] * min_distances[i];
+        if (!(total > 0))
+            break;
+
+        /* Fall back to the last eligible candidate in case of rounding */
+        target = kmeans_uniform_random() * total;
+        picked = -1;
+        for (int i = 0; i < num_candidates; i++) {
+            if (!(weights[i] * min_distances[i] > 0))
+                continue;
+            picked = i;
+            target -= weights[i] * min_distances[i];
+            if (target <= 0)
+                break;
+        }
+        centroids[num_centroids++] = candidates[picked];
+
+        for (int i = 0; i < num_candidates; i++) {
+            distance = compute_metric(metric_fn,
+                mem_context_for_function_calls, candidates[i],
+                candidates[picked]);
+            if (num_centroids == 1 || distance * distance < min_distances[i])
+                min_distances[i] = distance * distance;
+        }
+    }
+    MemoryContextDelete(mem_context_for_function_calls);
+
+    PG_RETURN_ARRAYTYPE_P(
+        construct_array(
+            centroids, /* elems */
+            num_centroids, /* nelems */
+            ARR_ELEMTYPE(candidates_arr), /* elmtype */
+            -1, /* elmlen */
+            false, /* elmbyval */
+            'd') /* elmalign */
+        );
+}
+
+/*
+ * Return the number of points aggregated by UDA:kmeans_step()
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_step_num_points);
+Datum
+internal_kmeans_step_num_points(PG_FUNCTION_ARGS) {
+    ArrayType      *state_arr;
+
+    state_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 0));
+    if (ARR_DIMS(state_arr)[0] < KMEANS_STEP_HEADER_LEN)
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("internal error: invalid k-means state")));
+
+    PG_RETURN_INT64((int64) ((float8 *) ARR_DATA_PTR(state_arr))[2]);
+}
+
+/*
+ * Validate the state of UDA:kmeans_step() and the per-centroid counts used by
+ * the mini-batch updates. Returns the dimension.
+ */
+static
+int
+check_minibatch_args(ArrayType *inStateArr, int inNumCentroids,
+    ArrayType *inCountsArr)
+{
+    float8         *state = (float8 *) ARR_DATA_PTR(inStateArr);
+
+    if (ARR_DIMS(inStateArr)[0] < KMEANS_STEP_HEADER_LEN
+        || state[0] != inNumCentroids
+        || ARR_DIMS(inStateArr)[0] != KMEANS_STEP_HEADER_LEN
+            + inNumCentroids * (state[1] + 1))
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("internal error: k-means state does not match centroids")));
+    if (ARR_NDIM(inCountsArr) != 1
+        || ARR_DIMS(inCountsArr)[0] != inNumCentroids
+        || ARR_HASNULL(inCountsArr))
+        ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("internal error: expected one count per centroid")));
+    return (int) state[1];
+}
+
+/*
+ * Mini-batch centroid update (D. Sculley: Web-scale k-means clustering,
+ * WWW 2010).
+ *
+ * Each centroid c has a count v(c) of all points assigned to it in previous
+ * batches, and each point x assigned to it in the current batch moves it by
+ * the per-center learning rate 1/v(c), after incrementing v(c):
+ *   c <- (1 - 1/v(c)) c + 1/v(c) x.
+ * Since the assignments of a batch are computed with fixed centroids, applying
+ * these updates for all n(c) points of the batch amounts to
+ *   c <- (v(c) c + sum of the points) / (v(c) + n(c)),
+ * which only needs the coordinate sums accumulated by UDA:kmeans_step().
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_minibatch_centroids);
+Datum
+internal_kmeans_minibatch_centroids(PG_FUNCTION_ARGS) {
+    ArrayType      *state_arr;
+    float8         *state;
+    ArrayType      *centroids_arr;
+    Datum          *centroids;
+    int             num_centroids;
+    ArrayType      *prev_counts_arr;
+    float8         *prev_counts;
+    int             dim;
+    float8         *counts;
+    float8         *sums;
+    float8         *centroid;
+    Datum          *new_centroids;
+
+    state_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 0));
+    centroids_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 1));
+    get_svec_array_elms(centroids_arr, &centroids, &num_centroids);
+    prev_counts_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 2));
+    dim = check_minibatch_args(state_arr, num_centroids, prev_counts_arr);
+
+    state = (float8 *) ARR_DATA_PTR(state_arr);
+    prev_counts = (float8 *) ARR_DATA_PTR(prev_counts_arr);
+    counts = state + KMEANS_STEP_HEADER_LEN;
+    sums = counts + num_centroids;
+
+    new_centroids = (Datum *) palloc(sizeof(Datum) * num_centroids);
+    for (int i = 0; i < num_centroids; i++, sums += dim) {
+        if (counts[i] == 0) {
+            new_centroids[i] = centroids[i];
+            continue;
+        }
+        centroid = sdata_to_float8arr(sdata_from_svec(
+            DatumGetSvecTypeP(centroids[i])));
+        for (int j = 0; j < dim; j++)
+            centroid[j] = (prev_counts[i] * centroid[j] + sums[j])
+                / (prev_counts[i] + counts[i]);
+        new_centroids[i] = PointerGetDatum(svec_from_float8arr(centroid, dim));
+    }
+
+    PG_RETURN_ARRAYTYPE_P(
+        construct_array(
+            new_centroids, /* elems */
+            num_centroids, /* nelems */
+            ARR_ELEMTYPE(centroids_arr), /* elmtype */
+            -1, /* elmlen */
+            false, /* elmbyval */
+            'd') /* elmalign */
+        );
+}
+
+/*
+ * Add the per-centroid counts of the current mini-batch to those of the
+ * previous batches
+ */
+PG_FUNCTION_INFO_V1(internal_kmeans_minibatch_counts);
+Datum
+internal_kmeans_minibatch_counts(PG_FUNCTION_ARGS) {
+    ArrayType      *state_arr;
+    ArrayType      *prev_counts_arr;
+    float8         *counts;
+    float8         *new_counts;
+    int             num_centroids;
+
+    state_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 0));
+    prev_counts_arr = PG_GETARG_ARRAYTYPE_P(verify_arg_nonnull(fcinfo, 1));
+    num_centroids = ARR_NDIM(prev_counts_arr) == 1
+        ? ARR_DIMS(prev_counts_arr)[0]
+        : 0;
+    check_minibatch_args(state_arr, num_centroids, prev_counts_arr);
+
+    counts = (float8 *) ARR_DATA_PTR(state_arr) + KMEANS_STEP_HEADER_LEN;
+    new_counts = (float8 *) palloc(sizeof(float8) * num_centroids);
+    for (int i = 0; i < num_centroids; i++)
+        new_counts[i] = ((float8 *) ARR_DATA_PTR(prev_counts_arr))[i]
+            + counts[i];
+
+    PG_RETURN_ARRAYTYPE_P(construct_float8_array(new_counts, num_centroids));
+}
@@ -23,17 +23,26 @@ namespace eigen_integration {
  *     will be aligned!
  * @param inOptions A combination of DecompositionOptions
  * @param inExtras A combination of SPDDecompositionExtras
+ * @param inConditionNoThreshold Condition number below which the
+ *     pseudo-inverse is computed with a Cholesky decomposition instead of the
+ *     eigen decomposition (see computeExtras())
  */
 template <class MatrixType>
 inline
 SymmetricPositiveDefiniteEigenDecomposition<MatrixType>
     ::SymmetricPositiveDefiniteEigenDecomposition(
-    const MatrixType &inMatrix, int inOptions, int inExtras)
+    const MatrixType &inMatrix, int inOptions, int inExtras,
+    double inConditionNoThreshold)
   : Base(inMatrix, inOptions) {
     
-    computeExtras(inMatrix, inExtras);
+    computeExtras(inMatrix, inExtras, inConditionNoThreshold);
 }
 
+template <class MatrixType>
+const double
+SymmetricPositiveDefiniteEigenDecomposition<MatrixType>
+    ::kDefaultConditionNoThreshold = 1000;
+
 /**
  * @brief Return the condition number of the matrix
  * 
@@ -80,14 +89,14 @@ SymmetricPositiveDefiniteEigenDecomposition<MatrixType>::pseudoInverse() const {
 /**
  * @brief Perform extra computations after the decomposition
  *
- * If the matrix has a condition number of less than 1000 (currently
- * this is hard-coded), it necessarily has full rank and is invertible. 
- * The Moore-Penrose pseudo-inverse coincides with the inverse and we
- * compute it directly, using a \f$ L D L^T \f$ Cholesky decomposition.
+ * If the matrix has a condition number of less than
+ * \c inConditionNoThreshold (by default 1000), it necessarily has full rank
+ * and is invertible. The Moore-Penrose pseudo-inverse coincides with the
+ * inverse and we compute it directly, using a \f$ L D L^T \f$ Cholesky
+ * decomposition.
  *
- * If the matrix has a condition number of more than 1000, we are on the
- * safe side and use the eigen decomposition for computing the
- * pseudo-inverse.
+ * If the matrix has a larger condition number, we are on the safe side and
+ * use the eigen decomposition for computing the pseudo-inverse.
  * 
  * Since the eigenvectors of a symmtric positive semi-definite matrix
  * are orthogonal, and Eigen moreover scales them to have norm 1 (i.e.,
@@ -111,13 +120,12 @@ template <class MatrixType>
 inline
 void
 SymmetricPositiveDefiniteEigenDecomposition<MatrixType>::computeExtras(
-    const MatrixType &inMatrix, int inExtras) {
+    const MatrixType &inMatrix, int inExtras, double inConditionNoThreshold) {
     
     if (inExtras & ComputePseudoInverse) {
         mPinv.resize(inMatrix.rows(), inMatrix.cols());
 
-        // FIXME: No hard-coded constant here
-        if (conditionNo() < 1000) {
+        if (conditionNo() < inConditionNoThreshold) {
             // We are doing a Cholesky decomposition of a matrix with
             // pivoting. This is faster than the PartialPivLU that
             // Eigen's inverse() method would use
@@ -34,15 +34,23 @@ public:
 
     using Base::eigenvalues;
 
+    /**
+     * Default condition number below which the pseudo-inverse is computed
+     * with an \f$ L D L^T \f$ Cholesky decomposition
+     */
+    static const double kDefaultConditionNoThreshold;
+
     SymmetricPositiveDefiniteEigenDecomposition(const MatrixType &inMatrix,
-        int inOptions = ComputeEigenvectors, int inExtras = 0);
+        int inOptions = ComputeEigenvectors, int inExtras = 0,
+        double inConditionNoThreshold = kDefaultConditionNoThreshold);
     
     double conditionNo() const;
     
     const MatrixType &pseudoInverse() const;
     
 protected:
-    void computeExtras(const MatrixType &inMatrix, int inExtras);
+    void computeExtras(const MatrixType &inMatrix, int inExtras,
+        double inConditionNoThreshold);
     
     MatrixType mPinv;
 };
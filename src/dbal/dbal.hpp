@@ -30,7 +30,9 @@ enum Mutability {
 
 enum MemoryContext {
     FunctionContext,
-    AggregateContext
+    AggregateContext,
+    CacheContext,
+    ArenaContext
 };
 
 enum ZeroMemory {
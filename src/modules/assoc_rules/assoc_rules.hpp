@@ -0,0 +1,9 @@
+/* -----------------------------------------------------------------------------
+ *
+ * @file assoc_rules.hpp
+ *
+ * @brief Umbrella header that includes all association-rules headers
+ *
+ * -------------------------------------------------------------------------- */
+
+#include "fpgrowth.hpp"
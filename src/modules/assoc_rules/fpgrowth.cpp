@@ -0,0 +1,450 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file fpgrowth.cpp
+ *
+ * @brief Frequent-itemset mining and association rules with FP-growth
+ *
+ * The transition function inserts each transaction into a prefix tree (the
+ * FP-tree), whose paths share the common prefixes of the transactions. Trees
+ * of different segments are merged node by node. The final mining step turns
+ * the tree into a weighted transaction database and runs the (recursive)
+ * FP-growth algorithm in memory, so that all frequent itemsets are found
+ * without further passes over the data.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "fpgrowth.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace assoc_rules {
+
+/**
+ * @brief Transition state for building an FP-tree
+ *
+ * Items are positive integers. The caller is expected to number the frequent
+ * items in descending order of their support, so that ascending item ids are
+ * the usual FP-tree order and the tree is as compact as possible.
+ *
+ * Each node stores its item, its count (the number of transactions whose path
+ * passes through the node), its parent, its first child, and its next sibling.
+ * Node 0 is the root. Since the root is never a child, 0 also serves as the
+ * null link. The storage is grown by doubling.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 1, and all elemenets are 0. Handle::operator[] will
+ * perform bounds checking.
+ */
+template <class Handle>
+class FPTreeTransitionState {
+public:
+    enum { kItem = 0, kCount, kParent, kFirstChild, kNextSibling, kNodeSize };
+
+    FPTreeTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind();
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Return the fields of a node
+     */
+    typename HandleTraits<Handle>::DoublePtr node(uint32_t inNode) {
+        madlib_assert(inNode < capacity(),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        return &mStorage[1 + kNodeSize * static_cast<size_t>(inNode)];
+    }
+
+    /**
+     * @brief Return the child of a node for the given item, adding it if
+     *     necessary
+     */
+    uint32_t child(const Allocator &inAllocator, uint32_t inParent,
+        double inItem) {
+
+        for (uint32_t c = static_cast<uint32_t>(node(inParent)[kFirstChild]);
+            c != 0; c = static_cast<uint32_t>(node(c)[kNextSibling]))
+            if (node(c)[kItem] == inItem)
+                return c;
+
+        reserve(inAllocator, numNodes + 1);
+        uint32_t c = numNodes;
+        numNodes = c + 1;
+        node(c)[kItem] = inItem;
+        node(c)[kCount] = 0;
+        node(c)[kParent] = inParent;
+        node(c)[kFirstChild] = 0;
+        node(c)[kNextSibling] = node(inParent)[kFirstChild];
+        node(inParent)[kFirstChild] = c;
+        return c;
+    }
+
+    /**
+     * @brief Insert a (sorted) transaction with the given multiplicity
+     */
+    void insert(const Allocator &inAllocator, const std::vector<double> &inItems,
+        double inCount) {
+
+        if (numNodes == 0) {
+            reserve(inAllocator, 1);
+            numNodes = 1;
+        }
+
+        uint32_t current = 0;
+        for (size_t i = 0; i < inItems.size(); i++) {
+            current = child(inAllocator, current, inItems[i]);
+            node(current)[kCount] += inCount;
+        }
+        node(0)[kCount] += inCount;
+    }
+
+    /**
+     * @brief Add all counts of another tree to this one
+     *
+     * We walk the other tree depth-first and insert each of its nodes below the
+     * node of this tree that corresponds to the other node's parent.
+     */
+    template <class OtherHandle>
+    void merge(const Allocator &inAllocator,
+        FPTreeTransitionState<OtherHandle> &inOtherState) {
+
+        std::vector<std::pair<uint32_t, uint32_t> > stack;
+        stack.push_back(std::make_pair(0U, 0U));
+        node(0)[kCount] += inOtherState.node(0)[kCount];
+        while (!stack.empty()) {
+            uint32_t thisNode = stack.back().first;
+            uint32_t otherNode = stack.back().second;
+            stack.pop_back();
+
+            for (uint32_t c = static_cast<uint32_t>(
+                    inOtherState.node(otherNode)[kFirstChild]);
+                c != 0;
+                c = static_cast<uint32_t>(inOtherState.node(c)[kNextSibling])) {
+
+                uint32_t thisChild = child(inAllocator, thisNode,
+                    inOtherState.node(c)[kItem]);
+                node(thisChild)[kCount] += inOtherState.node(c)[kCount];
+                stack.push_back(std::make_pair(thisChild, c));
+            }
+        }
+    }
+
+private:
+    uint32_t capacity() const {
+        return static_cast<uint32_t>((mStorage.size() - 1) / kNodeSize);
+    }
+
+    static inline size_t arraySize(uint32_t inCapacity) {
+        return 1 + kNodeSize * static_cast<size_t>(inCapacity);
+    }
+
+    /**
+     * @brief Make sure that there is room for inNumNodes nodes
+     */
+    void reserve(const Allocator &inAllocator, uint32_t inNumNodes) {
+        if (inNumNodes <= capacity())
+            return;
+
+        uint32_t newCapacity = std::max(capacity(), 8U);
+        while (newCapacity < inNumNodes) {
+            if (newCapacity > (std::numeric_limits<uint32_t>::max() >> 1))
+                throw std::runtime_error("Too many nodes in FP-tree.");
+            newCapacity *= 2;
+        }
+
+        Handle oldStorage = mStorage;
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(newCapacity));
+        std::copy(oldStorage.ptr(), oldStorage.ptr() + oldStorage.size(),
+            mStorage.ptr());
+        rebind();
+    }
+
+    void rebind() {
+        madlib_assert(mStorage.size() >= 1,
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        numNodes.rebind(&mStorage[0]);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 numNodes;
+};
+
+namespace {
+
+typedef std::vector<int> Itemset;
+typedef std::map<Itemset, double> ItemsetSupports;
+
+/**
+ * @brief A (conditional) transaction with its multiplicity
+ */
+struct WeightedPath {
+    Itemset items;
+    double count;
+};
+
+typedef std::vector<WeightedPath> PathDatabase;
+
+/**
+ * @brief Turn an FP-tree into a database of weighted, sorted transactions
+ *
+ * Every node whose count exceeds the sum of its children's counts is the last
+ * node of that many transactions.
+ */
+void
+treeToPaths(FPTreeTransitionState<ArrayHandle<double> > &inTree,
+    PathDatabase &outPaths) {
+
+    typedef FPTreeTransitionState<ArrayHandle<double> > Tree;
+
+    uint32_t numNodes = inTree.numNodes;
+    std::vector<double> childCounts(numNodes, 0.);
+    for (uint32_t n = 1; n < numNodes; n++)
+        childCounts[static_cast<uint32_t>(inTree.node(n)[Tree::kParent])]
+            += inTree.node(n)[Tree::kCount];
+
+    for (uint32_t n = 1; n < numNodes; n++) {
+        double count = inTree.node(n)[Tree::kCount] - childCounts[n];
+        if (count <= 0)
+            continue;
+
+        WeightedPath path;
+        path.count = count;
+        for (uint32_t p = n; p != 0;
+            p = static_cast<uint32_t>(inTree.node(p)[Tree::kParent]))
+            path.items.push_back(
+                static_cast<int>(inTree.node(p)[Tree::kItem]));
+        std::reverse(path.items.begin(), path.items.end());
+        outPaths.push_back(path);
+    }
+}
+
+/**
+ * @brief Find all frequent itemsets that extend a prefix
+ *
+ * The paths of inDatabase only contain items that are smaller than all items
+ * of ioPrefix. Each frequent itemset is therefore enumerated exactly once,
+ * namely by adding its items in descending order.
+ */
+void
+mineFrequentItemsets(const PathDatabase &inDatabase, Itemset &ioPrefix,
+    double inMinCount, ItemsetSupports &outSupports) {
+
+    std::map<int, double> itemCounts;
+    for (size_t i = 0; i < inDatabase.size(); i++)
+        for (size_t j = 0; j < inDatabase[i].items.size(); j++)
+            itemCounts[inDatabase[i].items[j]] += inDatabase[i].count;
+
+    for (std::map<int, double>::const_iterator it = itemCounts.begin();
+        it != itemCounts.end(); ++it) {
+
+        if (it->second < inMinCount)
+            continue;
+
+        ioPrefix.push_back(it->first);
+        Itemset itemset(ioPrefix);
+        std::sort(itemset.begin(), itemset.end());
+        outSupports[itemset] = it->second;
+
+        // The conditional database of the item consists of the frequent items
+        // preceding it in the paths containing it
+        PathDatabase conditional;
+        for (size_t i = 0; i < inDatabase.size(); i++) {
+            const Itemset &items = inDatabase[i].items;
+            Itemset::const_iterator pos
+                = std::lower_bound(items.begin(), items.end(), it->first);
+            if (pos == items.end() || *pos != it->first)
+                continue;
+
+            WeightedPath path;
+            path.count = inDatabase[i].count;
+            for (Itemset::const_iterator item = items.begin(); item != pos;
+                ++item)
+                if (itemCounts[*item] >= inMinCount)
+                    path.items.push_back(*item);
+            if (!path.items.empty())
+                conditional.push_back(path);
+        }
+        if (!conditional.empty())
+            mineFrequentItemsets(conditional, ioPrefix, inMinCount,
+                outSupports);
+
+        ioPrefix.pop_back();
+    }
+}
+
+/**
+ * @brief Return a float8 array with the content of a vector
+ */
+MutableArrayHandle<double>
+toArray(const std::vector<double> &inVector) {
+    MutableArrayHandle<double> array = allocateArray<double>(inVector.size());
+    std::copy(inVector.begin(), inVector.end(), array.ptr());
+    return array;
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Perform the FP-tree transition step
+ *
+ * Duplicate items within a transaction are ignored.
+ */
+AnyType
+fpgrowth_tree_transition::run(AnyType &args) {
+    FPTreeTransitionState<MutableArrayHandle<double> > state = args[0];
+    if (args[1].isNull())
+        return state;
+    ArrayHandle<double> transaction = args[1].getAs<ArrayHandle<double> >();
+
+    std::vector<double> items(transaction.ptr(),
+        transaction.ptr() + transaction.size());
+    for (size_t i = 0; i < items.size(); i++)
+        if (!(items[i] >= 1 && items[i] <= std::numeric_limits<int>::max()
+            && items[i] == std::floor(items[i])))
+            throw std::invalid_argument("Items must be positive integers.");
+    std::sort(items.begin(), items.end());
+    items.erase(std::unique(items.begin(), items.end()), items.end());
+
+    state.insert(*this, items, 1);
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+fpgrowth_tree_merge_states::run(AnyType &args) {
+    FPTreeTransitionState<MutableArrayHandle<double> > stateLeft = args[0];
+    FPTreeTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.numNodes == 0)
+        return stateRight;
+    else if (stateRight.numNodes == 0)
+        return stateLeft;
+
+    stateLeft.merge(*this, stateRight);
+    return stateLeft;
+}
+
+/**
+ * @brief Mine all frequent itemsets of an FP-tree and return the association
+ *     rules that meet the minimum confidence
+ *
+ * Since the C++ abstraction layer has no set-returning functions, the rules
+ * are returned as parallel arrays. The items of rule \f$ i \f$ (1-based) are
+ * items[offsets[i] + 1 : offsets[i + 1]]; the first antecedent_lengths[i] of
+ * them form the antecedent, the others the consequent.
+ *
+ * As in the Apriori implementation, the conviction of rules with confidence 1
+ * is reported as 0.
+ */
+AnyType
+fpgrowth_rules::run(AnyType &args) {
+    FPTreeTransitionState<ArrayHandle<double> > tree = args[0];
+    double numTransactions = args[1].getAs<double>();
+    double minSupport = args[2].getAs<double>();
+    double minConfidence = args[3].getAs<double>();
+
+    if (numTransactions <= 0)
+        throw std::invalid_argument("Number of transactions must be "
+            "positive.");
+
+    PathDatabase paths;
+    if (tree.numNodes > 0)
+        treeToPaths(tree, paths);
+
+    // Support counts are integers. Rounding the threshold up (with some
+    // tolerance for the floating-point error of the product) gives the same
+    // result as the test count / numTransactions >= minSupport in SQL. E.g.,
+    // 0.07 * 100 evaluates to 7.000000000000001.
+    double minCount = std::ceil(minSupport * numTransactions - 1e-9);
+
+    ItemsetSupports supports;
+    Itemset prefix;
+    mineFrequentItemsets(paths, prefix, minCount, supports);
+
+    std::vector<double> items;
+    std::vector<double> offsets(1, 0.);
+    std::vector<double> antecedentLengths;
+    std::vector<double> support;
+    std::vector<double> confidence;
+    std::vector<double> lift;
+    std::vector<double> conviction;
+
+    for (ItemsetSupports::const_iterator it = supports.begin();
+        it != supports.end(); ++it) {
+
+        const Itemset &itemset = it->first;
+        size_t k = itemset.size();
+        if (k < 2)
+            continue;
+        if (k > 30)
+            throw std::runtime_error("Frequent itemset too large to enumerate "
+                "all association rules. Consider increasing the minimum "
+                "support.");
+
+        // Every non-empty proper subset is an antecedent. By the downward
+        // closure property, all subsets are frequent and thus have a support.
+        for (uint32_t mask = 1; mask < (1U << k) - 1; mask++) {
+            Itemset antecedent;
+            Itemset consequent;
+            for (size_t i = 0; i < k; i++)
+                ((mask & (1U << i)) ? antecedent : consequent).push_back(
+                    itemset[i]);
+
+            double conf = it->second / supports[antecedent];
+            if (conf < minConfidence)
+                continue;
+            double supportY = supports[consequent] / numTransactions;
+
+            items.insert(items.end(), antecedent.begin(), antecedent.end());
+            items.insert(items.end(), consequent.begin(), consequent.end());
+            offsets.push_back(static_cast<double>(items.size()));
+            antecedentLengths.push_back(static_cast<double>(antecedent.size()));
+            support.push_back(it->second / numTransactions);
+            confidence.push_back(conf);
+            lift.push_back(conf / supportY);
+            conviction.push_back(conf == 1 ? 0 : (1 - supportY) / (1 - conf));
+        }
+    }
+
+    AnyType tuple;
+    tuple
+        << toArray(items)
+        << toArray(offsets)
+        << toArray(antecedentLengths)
+        << toArray(support)
+        << toArray(confidence)
+        << toArray(lift)
+        << toArray(conviction);
+    return tuple;
+}
+
+} // namespace assoc_rules
+
+} // namespace modules
+
+} // namespace madlib
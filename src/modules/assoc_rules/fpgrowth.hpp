@@ -0,0 +1,20 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file fpgrowth.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief FP-growth: Transition function
+ */
+DECLARE_UDF(assoc_rules, fpgrowth_tree_transition)
+
+/**
+ * @brief FP-growth: State merge function
+ */
+DECLARE_UDF(assoc_rules, fpgrowth_tree_merge_states)
+
+/**
+ * @brief FP-growth: Mine frequent itemsets and generate association rules
+ */
+DECLARE_UDF(assoc_rules, fpgrowth_rules)
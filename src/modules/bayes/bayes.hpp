@@ -0,0 +1,9 @@
+/* -----------------------------------------------------------------------------
+ *
+ * @file bayes.hpp
+ *
+ * @brief Umbrella header that includes all Naive Bayes headers
+ *
+ * -------------------------------------------------------------------------- */
+
+#include "naive_bayes.hpp"
@@ -0,0 +1,615 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file naive_bayes.cpp
+ *
+ * @brief Naive Bayes functions
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+#include <utils/Math.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "naive_bayes.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace bayes {
+
+namespace {
+
+/**
+ * @brief Number of elements of each row in the flattened model array
+ *
+ * Each row is (class, class_log_prior, attr, value, log_prob).
+ */
+const size_t kModelRowLength = 5;
+
+/**
+ * @brief Marker for an unused slot in the hash table
+ */
+const uint32_t kEmptySlot = std::numeric_limits<uint32_t>::max();
+
+/**
+ * @brief In-memory Naive Bayes model, cached for the duration of a query
+ *
+ * The model is built once from the flattened model array and then reused for
+ * all rows classified in the same query. We map each (attr, value) pair to a
+ * row of the dense matrix \c logProbs (with one column per class) by means
+ * of an open-addressing hash table with linear probing.
+ *
+ * This is a plain-old data structure living in dbal::CacheContext. No
+ * destructor will ever be called.
+ */
+struct NaiveBayesModel {
+    /**
+     * Whether the model argument is the same for all calls within the query
+     * (see UDF::isArgumentStable()). Decided once, on the first call.
+     */
+    bool stable;
+
+    /**
+     * Address and size of the model array this model was built from. For a
+     * stable argument, these identify the model in O(1).
+     */
+    const double* source;
+    size_t sourceSize;
+
+    uint32_t numClasses;
+    uint32_t numEntries;
+
+    /**
+     * Number of slots in the hash table. Always a power of 2.
+     */
+    uint32_t tableSize;
+
+    /**
+     * Sorted class values, and their log prior probabilities
+     */
+    double* classes;
+    double* classLogPriors;
+
+    /**
+     * Hash table: Key (attr, value) and the associated row of logProbs
+     */
+    uint64_t* keys;
+    uint32_t* rows;
+
+    /**
+     * numEntries x numClasses matrix (row-major) with the log-probabilities
+     * log P(A_attr = value | C = class). NaN if there is no probability for a
+     * triple (class, attr, value).
+     */
+    double* logProbs;
+};
+
+inline
+uint64_t
+attrValueKey(double inAttr, double inValue) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(
+                static_cast<int32_t>(inAttr))) << 32)
+        | static_cast<uint32_t>(static_cast<int32_t>(inValue));
+}
+
+inline
+uint32_t
+slotOf(uint64_t inKey, uint32_t inTableSize) {
+    // Fibonacci hashing: Use the high bits of a multiplicative hash
+    return static_cast<uint32_t>((inKey * 0x9E3779B97F4A7C15ULL) >> 32)
+        & (inTableSize - 1);
+}
+
+/**
+ * @brief Find the slot of a key in the hash table
+ *
+ * @return The slot that either contains \c inKey or that is empty (and where
+ *     \c inKey would be inserted)
+ */
+inline
+uint32_t
+findSlot(const NaiveBayesModel& inModel, uint64_t inKey) {
+    uint32_t slot = slotOf(inKey, inModel.tableSize);
+    while (inModel.rows[slot] != kEmptySlot && inModel.keys[slot] != inKey)
+        slot = (slot + 1) & (inModel.tableSize - 1);
+    return slot;
+}
+
+} // namespace
+
+/**
+ * @brief Naive Bayes: Classify an attribute array
+ *
+ * Arguments are:
+ * - the attributes of the row to classify,
+ * - the number of attributes to use for classification,
+ * - the flattened model array, consisting of rows
+ *   (class, class_log_prior, attr, value, log_prob).
+ *
+ * The model array should be the same for all calls within one query
+ * (typically, it is an uncorrelated subquery). The first call builds a hash
+ * table from it and checks whether the model argument is stable for
+ * the query. If so, the hash table is reused for all subsequent rows (as long
+ * as the model array is at the same address and of the same size). Otherwise,
+ * e.g., if the model is a column, it is rebuilt for every row.
+ *
+ * Returns the tuple (classes, log_prob) where classes are the most likely
+ * class(es) and log_prob is their log-probability (NULL if it cannot be
+ * computed for any class). Just like the SQL implementation, a class for which
+ * any attribute value has no probability is considered least likely.
+ */
+AnyType
+nb_classify::run(AnyType &args) {
+    ArrayHandle<double> attributes = args[0].getAs<ArrayHandle<double> >();
+    int32_t numAttrs = args[1].getAs<int32_t>();
+    ArrayHandle<double> modelArray = args[2].getAs<ArrayHandle<double> >();
+
+    if (numAttrs < 0)
+        throw std::invalid_argument("Number of attributes must not be "
+            "negative.");
+    if (modelArray.size() == 0 || modelArray.size() % kModelRowLength != 0)
+        throw std::invalid_argument("Invalid Naive Bayes model array.");
+
+    void*& cache = userCache();
+    NaiveBayesModel* model = static_cast<NaiveBayesModel*>(cache);
+
+    if (model == NULL || !model->stable
+        || model->source != modelArray.ptr()
+        || model->sourceSize != modelArray.size()) {
+
+        const size_t numRows = modelArray.size() / kModelRowLength;
+        const double* row;
+
+        // A different model array (e.g., the function is called with a
+        // non-constant model): Do not accumulate memory in the cache context
+        if (model != NULL) {
+            free<dbal::CacheContext>(model->classes);
+            free<dbal::CacheContext>(model->keys);
+            free<dbal::CacheContext>(model->rows);
+            free<dbal::CacheContext>(model->logProbs);
+            free<dbal::CacheContext>(model);
+            cache = NULL;
+        }
+
+        model = static_cast<NaiveBayesModel*>(
+            allocate<dbal::CacheContext, dbal::DoZero, dbal::ThrowBadAlloc>(
+                sizeof(NaiveBayesModel)));
+        model->stable = isArgumentStable(2);
+        model->source = modelArray.ptr();
+        model->sourceSize = modelArray.size();
+
+        // Pass 1: The model array is ordered by class, so collecting the
+        // distinct classes is a linear scan
+        model->classes = static_cast<double*>(
+            allocate<dbal::CacheContext, dbal::DoNotZero, dbal::ThrowBadAlloc>(
+                2 * numRows * sizeof(double)));
+        model->classLogPriors = model->classes + numRows;
+        model->numClasses = 0;
+        row = modelArray.ptr();
+        for (size_t i = 0; i < numRows; ++i, row += kModelRowLength) {
+            if (model->numClasses > 0
+                && row[0] == model->classes[model->numClasses - 1])
+                continue;
+            if (model->numClasses > 0
+                && row[0] < model->classes[model->numClasses - 1])
+                throw std::invalid_argument("Naive Bayes model array is not "
+                    "ordered by class.");
+            model->classes[model->numClasses] = row[0];
+            model->classLogPriors[model->numClasses] = row[1];
+            model->numClasses++;
+        }
+
+        // Pass 2: Insert all distinct (attr, value) pairs into the hash table.
+        // A load factor of at most 1/2 keeps the probe sequences short.
+        model->tableSize = utils::nextPowerOfTwo(
+            static_cast<uint32_t>(2 * numRows));
+        model->keys = static_cast<uint64_t*>(
+            allocate<dbal::CacheContext, dbal::DoNotZero, dbal::ThrowBadAlloc>(
+                model->tableSize * sizeof(uint64_t)));
+        model->rows = static_cast<uint32_t*>(
+            allocate<dbal::CacheContext, dbal::DoNotZero, dbal::ThrowBadAlloc>(
+                model->tableSize * sizeof(uint32_t)));
+        std::fill(model->rows, model->rows + model->tableSize, kEmptySlot);
+        model->numEntries = 0;
+        row = modelArray.ptr();
+        for (size_t i = 0; i < numRows; ++i, row += kModelRowLength) {
+            uint64_t key = attrValueKey(row[2], row[3]);
+            uint32_t slot = findSlot(*model, key);
+            if (model->rows[slot] == kEmptySlot) {
+                model->keys[slot] = key;
+                model->rows[slot] = model->numEntries++;
+            }
+        }
+
+        // Pass 3: Fill the matrix of log-probabilities
+        size_t numProbs = static_cast<size_t>(model->numEntries)
+            * model->numClasses;
+        model->logProbs = static_cast<double*>(
+            allocate<dbal::CacheContext, dbal::DoNotZero, dbal::ThrowBadAlloc>(
+                numProbs * sizeof(double)));
+        std::fill(model->logProbs, model->logProbs + numProbs,
+            std::numeric_limits<double>::quiet_NaN());
+        row = modelArray.ptr();
+        for (size_t i = 0; i < numRows; ++i, row += kModelRowLength) {
+            uint32_t classIdx = static_cast<uint32_t>(
+                std::lower_bound(model->classes,
+                    model->classes + model->numClasses, row[0])
+                - model->classes);
+            uint32_t entry = model->rows[
+                findSlot(*model, attrValueKey(row[2], row[3]))];
+            model->logProbs[static_cast<size_t>(entry) * model->numClasses
+                + classIdx] = row[4];
+        }
+
+        cache = model;
+    }
+
+    // Score all classes at once: Look up each attribute only once, and add
+    // the row of log-probabilities for all classes
+    MutableArrayHandle<double> logProbs
+        = allocateArray<double>(model->numClasses);
+    std::copy(model->classLogPriors,
+        model->classLogPriors + model->numClasses, logProbs.ptr());
+
+    bool haveAllAttributes = static_cast<size_t>(numAttrs) <= attributes.size();
+    for (int32_t attr = 1; haveAllAttributes && attr <= numAttrs; ++attr) {
+        uint32_t slot = findSlot(*model,
+            attrValueKey(attr, attributes[attr - 1]));
+        if (model->rows[slot] == kEmptySlot) {
+            haveAllAttributes = false;
+            break;
+        }
+
+        const double* probs = model->logProbs
+            + static_cast<size_t>(model->rows[slot]) * model->numClasses;
+        for (uint32_t c = 0; c < model->numClasses; ++c)
+            logProbs[c] += probs[c];
+    }
+
+    // Determine the most likely classes. NaN log-probabilities (an attribute
+    // value without probability for that class) count as least likely, and if
+    // all are NaN, all classes are equally (un)likely.
+    double maxLogProb = -std::numeric_limits<double>::infinity();
+    uint32_t numMax = 0;
+    bool haveLogProb = false;
+    if (haveAllAttributes) {
+        for (uint32_t c = 0; c < model->numClasses; ++c) {
+            if (std::isnan(logProbs[c]))
+                continue;
+            if (!haveLogProb || logProbs[c] > maxLogProb) {
+                maxLogProb = logProbs[c];
+                numMax = 0;
+                haveLogProb = true;
+            }
+            if (logProbs[c] == maxLogProb)
+                numMax++;
+        }
+    }
+
+    MutableArrayHandle<double> classes = allocateArray<double>(
+        haveLogProb ? numMax : model->numClasses);
+    for (uint32_t c = 0, pos = 0; c < model->numClasses; ++c)
+        if (!haveLogProb || logProbs[c] == maxLogProb)
+            classes[pos++] = model->classes[c];
+
+    AnyType tuple;
+    tuple << classes;
+    if (haveLogProb)
+        tuple << maxLogProb;
+    else
+        tuple << Null();
+    return tuple;
+}
+
+/**
+ * @brief Transition state for the Naive Bayes training aggregate
+ *
+ * The state is an open-addressing hash table (with linear probing) that maps
+ * triples (attr, value, class) to counts. Class counts are stored with the
+ * reserved key (0, 0, class), since attributes are numbered starting at 1.
+ * The distinct attribute values are exactly the (attr, value) pairs of all
+ * keys with attr > 0, so they need no separate bookkeeping.
+ *
+ * To the database, the state is exposed as a single DOUBLE PRECISION array:
+ * <tt>(numAttrs, numRows, numEntries, capacity, slots...)</tt>, where each of
+ * the \c capacity slots consists of the four elements
+ * <tt>(attr, value, class, cnt)</tt>. A slot is empty if its count is 0.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 4, and all elements are 0.
+ */
+template <class Handle>
+class NBTrainingState {
+public:
+    NBTrainingState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind();
+    }
+
+    /**
+     * @brief Convert to backend representation
+     *
+     * We define this function so that we can use TransitionState in the argument
+     * list and as a return type.
+     */
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Return the slot that contains the given key, or the empty slot
+     *     where it would be inserted
+     */
+    uint32_t slotOf(int32_t inAttr, int32_t inValue, int32_t inClass) const {
+        // Multiplicative hashing of all three components. The capacity is a
+        // power of 2, so we keep the (better mixed) high bits.
+        uint64_t hash = (static_cast<uint64_t>(static_cast<uint32_t>(inAttr))
+                * 0x9E3779B97F4A7C15ULL)
+            ^ (static_cast<uint64_t>(static_cast<uint32_t>(inValue))
+                * 0xC2B2AE3D27D4EB4FULL)
+            ^ (static_cast<uint64_t>(static_cast<uint32_t>(inClass))
+                * 0x165667B19E3779F9ULL);
+        uint32_t slot = static_cast<uint32_t>(hash >> 32) & (capacity - 1);
+
+        while (count(slot) != 0 && (
+                attr(slot) != inAttr || value(slot) != inValue
+                || cls(slot) != inClass))
+            slot = (slot + 1) & (capacity - 1);
+        return slot;
+    }
+
+    /**
+     * @brief Return the count of a key, or 0 if the key does not exist
+     */
+    double countOf(int32_t inAttr, int32_t inValue, int32_t inClass) const {
+        return capacity == 0 ? 0 : count(slotOf(inAttr, inValue, inClass));
+    }
+
+    /**
+     * @brief Add to the count of a key, inserting the key if necessary
+     *
+     * Whenever the load factor would exceed 1/2, we reallocate the state with
+     * twice the capacity and rehash all entries.
+     */
+    void add(const Allocator& inAllocator, int32_t inAttr, int32_t inValue,
+        int32_t inClass, double inCount) {
+
+        if (2 * (static_cast<uint64_t>(numEntries) + 1) > capacity)
+            grow(inAllocator);
+
+        uint32_t slot = slotOf(inAttr, inValue, inClass);
+        if (count(slot) == 0) {
+            slots[4 * slot] = inAttr;
+            slots[4 * slot + 1] = inValue;
+            slots[4 * slot + 2] = inClass;
+            numEntries = numEntries + 1;
+        }
+        slots[4 * slot + 3] += inCount;
+    }
+
+    int32_t attr(uint32_t inSlot) const {
+        return static_cast<int32_t>(slots[4 * inSlot]);
+    }
+    int32_t value(uint32_t inSlot) const {
+        return static_cast<int32_t>(slots[4 * inSlot + 1]);
+    }
+    int32_t cls(uint32_t inSlot) const {
+        return static_cast<int32_t>(slots[4 * inSlot + 2]);
+    }
+    double count(uint32_t inSlot) const {
+        return slots[4 * inSlot + 3];
+    }
+
+private:
+    static inline size_t arraySize(uint32_t inCapacity) {
+        return 4 + 4 * static_cast<size_t>(inCapacity);
+    }
+
+    void rebind() {
+        numAttrs.rebind(&mStorage[0]);
+        numRows.rebind(&mStorage[1]);
+        numEntries.rebind(&mStorage[2]);
+        capacity.rebind(&mStorage[3]);
+
+        madlib_assert(mStorage.size() >= arraySize(capacity),
+            std::runtime_error("Out-of-bounds array access detected."));
+        slots = mStorage.ptr() + 4;
+    }
+
+    void grow(const Allocator& inAllocator) {
+        NBTrainingState oldSelf = *this;
+        uint32_t newCapacity = oldSelf.capacity == 0 ? 16
+            : 2 * oldSelf.capacity;
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(newCapacity));
+        mStorage[3] = newCapacity;
+        rebind();
+        // Assigning one reference to another would copy the reference, not
+        // the value, so we copy through plain integers
+        uint32_t attrs = oldSelf.numAttrs;
+        numAttrs = attrs;
+        uint64_t rows = oldSelf.numRows;
+        numRows = rows;
+
+        for (uint32_t slot = 0; slot < oldSelf.capacity; ++slot) {
+            if (oldSelf.count(slot) == 0)
+                continue;
+
+            uint32_t newSlot = slotOf(oldSelf.attr(slot), oldSelf.value(slot),
+                oldSelf.cls(slot));
+            std::copy(oldSelf.slots + 4 * slot, oldSelf.slots + 4 * slot + 4,
+                slots + 4 * newSlot);
+        }
+        uint32_t entries = oldSelf.numEntries;
+        numEntries = entries;
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 numAttrs;
+    typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numEntries;
+    typename HandleTraits<Handle>::ReferenceToUInt32 capacity;
+    typename HandleTraits<Handle>::DoublePtr slots;
+};
+
+/**
+ * @brief Naive Bayes training: Transition function
+ *
+ * Count the class and all (attr, value, class) triples of a training row.
+ */
+AnyType
+nb_train_transition::run(AnyType &args) {
+    NBTrainingState<MutableArrayHandle<double> > state = args[0];
+    int32_t trainingClass = args[1].getAs<int32_t>();
+    ArrayHandle<double> attributes = args[2].getAs<ArrayHandle<double> >();
+    int32_t numAttrs = args[3].getAs<int32_t>();
+
+    if (numAttrs <= 0)
+        throw std::invalid_argument("Number of attributes must be positive.");
+    if (attributes.size() < static_cast<size_t>(numAttrs))
+        throw std::invalid_argument("Attribute array has fewer elements than "
+            "the number of attributes to use for classification.");
+    if (state.numRows == 0)
+        state.numAttrs = numAttrs;
+    else if (state.numAttrs != static_cast<uint32_t>(numAttrs))
+        throw std::invalid_argument("Number of attributes must not change "
+            "during training.");
+
+    state.numRows++;
+    state.add(*this, 0, 0, trainingClass, 1);
+    for (int32_t attr = 1; attr <= numAttrs; ++attr)
+        state.add(*this, attr, static_cast<int32_t>(attributes[attr - 1]),
+            trainingClass, 1);
+
+    return state;
+}
+
+/**
+ * @brief Naive Bayes training: Merge transition states
+ */
+AnyType
+nb_train_merge_states::run(AnyType &args) {
+    NBTrainingState<MutableArrayHandle<double> > stateLeft = args[0];
+    NBTrainingState<ArrayHandle<double> > stateRight = args[1];
+
+    if (stateRight.numRows == 0)
+        return stateLeft;
+    else if (stateLeft.numRows == 0)
+        return stateRight;
+    else if (stateLeft.numAttrs != stateRight.numAttrs)
+        throw std::invalid_argument("Inconsistent numbers of attributes.");
+
+    stateLeft.numRows += stateRight.numRows;
+    for (uint32_t slot = 0; slot < stateRight.capacity; ++slot)
+        if (stateRight.count(slot) != 0)
+            stateLeft.add(*this, stateRight.attr(slot),
+                stateRight.value(slot), stateRight.cls(slot),
+                stateRight.count(slot));
+
+    return stateLeft;
+}
+
+/**
+ * @brief Naive Bayes training: Final function
+ *
+ * Return the class priors and feature counts as a single DOUBLE PRECISION
+ * array
+ * <tt>(numClasses, numFeatureRows, classRows..., featureRows...)</tt>,
+ * where each of the \c numClasses class rows is
+ * <tt>(class, class_cnt, all_cnt)</tt> and each of the \c numFeatureRows
+ * feature rows is <tt>(class, attr, value, cnt, attr_cnt)</tt>. Just like
+ * the SQL implementation, there is a feature row for every class and every
+ * (attr, value) pair occurring in the training data, so \c cnt may be 0.
+ * Rows are ordered by class, attr, value.
+ */
+AnyType
+nb_train_final::run(AnyType &args) {
+    NBTrainingState<ArrayHandle<double> > state = args[0];
+
+    // If we haven't seen any data, just return Null. This is the standard
+    // behavior of aggregate function on empty data sets (compare, e.g.,
+    // how PostgreSQL handles sum or avg on empty inputs)
+    if (state.numRows == 0)
+        return Null();
+
+    // Collect the classes and the distinct (attr, value) pairs. We sort
+    // packed 64-bit keys: Since attr and value are non-negative in practice,
+    // but need not be, we flip the sign bits to preserve the order.
+    MutableArrayHandle<double> classesAndCounts
+        = allocateArray<double>(2 * state.numEntries);
+    uint64_t* attrValues = static_cast<uint64_t*>(
+        allocate<dbal::FunctionContext, dbal::DoNotZero, dbal::ThrowBadAlloc>(
+            (state.numEntries + 1) * sizeof(uint64_t)));
+    double* classes = classesAndCounts.ptr();
+    uint32_t numClasses = 0;
+    uint32_t numPairs = 0;
+    for (uint32_t slot = 0; slot < state.capacity; ++slot) {
+        if (state.count(slot) == 0)
+            continue;
+        if (state.attr(slot) == 0)
+            classes[numClasses++] = state.cls(slot);
+        else
+            attrValues[numPairs++] =
+                (static_cast<uint64_t>(static_cast<uint32_t>(state.attr(slot))
+                    ^ 0x80000000U) << 32)
+                | (static_cast<uint32_t>(state.value(slot)) ^ 0x80000000U);
+    }
+    std::sort(classes, classes + numClasses);
+    std::sort(attrValues, attrValues + numPairs);
+    numPairs = static_cast<uint32_t>(
+        std::unique(attrValues, attrValues + numPairs) - attrValues);
+
+    MutableArrayHandle<double> result = allocateArray<double>(
+        2 + 3 * static_cast<size_t>(numClasses)
+        + 5 * static_cast<size_t>(numClasses) * numPairs);
+    double* out = result.ptr();
+    *out++ = numClasses;
+    *out++ = static_cast<double>(numClasses) * numPairs;
+
+    for (uint32_t c = 0; c < numClasses; ++c) {
+        int32_t cls = static_cast<int32_t>(classes[c]);
+        *out++ = cls;
+        *out++ = state.countOf(0, 0, cls);
+        *out++ = static_cast<double>(state.numRows);
+    }
+
+    for (uint32_t c = 0; c < numClasses; ++c) {
+        int32_t cls = static_cast<int32_t>(classes[c]);
+        // attr_cnt is the length of the run of pairs with the same attr
+        for (uint32_t begin = 0, end; begin < numPairs; begin = end) {
+            uint32_t attrBits = static_cast<uint32_t>(attrValues[begin] >> 32);
+            for (end = begin; end < numPairs
+                && static_cast<uint32_t>(attrValues[end] >> 32) == attrBits;
+                ++end) ;
+
+            int32_t attr = static_cast<int32_t>(attrBits ^ 0x80000000U);
+            for (uint32_t p = begin; p < end; ++p) {
+                int32_t value = static_cast<int32_t>(
+                    static_cast<uint32_t>(attrValues[p]) ^ 0x80000000U);
+                *out++ = cls;
+                *out++ = attr;
+                *out++ = value;
+                *out++ = state.countOf(attr, value, cls);
+                *out++ = end - begin;
+            }
+        }
+    }
+
+    free<dbal::FunctionContext>(attrValues);
+    return result;
+}
+
+} // namespace bayes
+
+} // namespace modules
+
+} // namespace madlib
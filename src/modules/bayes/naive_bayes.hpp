@@ -0,0 +1,25 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file naive_bayes.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Naive Bayes: Classify an attribute array using an in-memory model
+ */
+DECLARE_UDF(bayes, nb_classify)
+
+/**
+ * @brief Naive Bayes training: Transition function
+ */
+DECLARE_UDF(bayes, nb_train_transition)
+
+/**
+ * @brief Naive Bayes training: State merge function
+ */
+DECLARE_UDF(bayes, nb_train_merge_states)
+
+/**
+ * @brief Naive Bayes training: Final function
+ */
+DECLARE_UDF(bayes, nb_train_final)
@@ -23,6 +23,11 @@
  * entry point when calling the madlib library).
  */
 
+#include <modules/assoc_rules/assoc_rules.hpp>
+#include <modules/bayes/bayes.hpp>
+#include <modules/linalg/linalg.hpp>
 #include <modules/prob/prob.hpp>
 #include <modules/regress/regress.hpp>
 #include <modules/stats/stats.hpp>
+#include <modules/svd_mf/svd_mf.hpp>
+#include <modules/utilities/utilities.hpp>
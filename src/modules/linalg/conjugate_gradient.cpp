@@ -0,0 +1,603 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file conjugate_gradient.cpp
+ *
+ * @brief Conjugate-gradient functions
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+
+#include "conjugate_gradient.hpp"
+
+namespace madlib {
+
+// Use Eigen
+using namespace dbal::eigen_integration;
+
+namespace modules {
+
+namespace linalg {
+
+/**
+ * @brief Transition state for the matrix-vector product
+ *
+ * The matrix is given row by row, each row with its (1-based) row number. Rows
+ * may arrive in any order, so no sorting is needed: We write the dot product of
+ * row \f$ i \f$ and the vector directly into position \f$ i \f$ of the result.
+ * The vector is copied into the state on the first row, so that the (possibly
+ * large) argument needs to be read only once.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 3, and all elemenets are 0.
+ */
+template <class Handle>
+class MVPTransitionState {
+    template <class OtherHandle>
+    friend class MVPTransitionState;
+
+public:
+    MVPTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[0]));
+    }
+
+    /**
+     * @brief Convert to backend representation
+     *
+     * We define this function so that we can use TransitionState in the argument
+     * list and as a return type.
+     */
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     */
+    inline void initialize(const Allocator &inAllocator,
+        const ArrayHandle<double> &inVector) {
+
+        if (inVector.size() == 0
+            || inVector.size() > std::numeric_limits<uint32_t>::max())
+            throw std::invalid_argument("Invalid vector length.");
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(inVector.size()));
+        rebind(inVector.size());
+        dimension = inVector.size();
+        std::copy(inVector.ptr(), inVector.ptr() + inVector.size(),
+            vector.data());
+    }
+
+    /**
+     * @brief Return the position of a row in the result vector
+     */
+    inline Index positionOf(int32_t inRowID) const {
+        if (inRowID < 1 || static_cast<uint32_t>(inRowID) > dimension)
+            throw std::invalid_argument("Row number out of range.");
+        return inRowID - 1;
+    }
+
+    /**
+     * @brief Merge with another TransitionState object
+     *
+     * Since every row contributes to exactly one position of the result, we
+     * can simply add the partial results.
+     */
+    template <class OtherHandle>
+    MVPTransitionState &operator+=(
+        const MVPTransitionState<OtherHandle> &inOtherState) {
+
+        if (mStorage.size() != inOtherState.mStorage.size())
+            throw std::logic_error("Internal error: Incompatible transition "
+                "states");
+
+        numRows += inOtherState.numRows;
+        product += inOtherState.product;
+        return *this;
+    }
+
+private:
+    static inline size_t arraySize(size_t inDimension) {
+        return 2 + 2 * inDimension;
+    }
+
+    /**
+     * @brief Rebind to a new storage array
+     *
+     * Array layout:
+     * - 0: dimension (length of the vector, and number of rows of the matrix)
+     * - 1: numRows (number of rows seen so far)
+     * - 2: vector (the vector to multiply with)
+     * - 2 + dimension: product (the matrix-vector product, as seen so far)
+     */
+    void rebind(uint32_t inDimension) {
+        dimension.rebind(&mStorage[0]);
+        numRows.rebind(&mStorage[1]);
+        vector.rebind(&mStorage[2], inDimension);
+        product.rebind(&mStorage[2 + inDimension], inDimension);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 dimension;
+    typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap vector;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap product;
+};
+
+/**
+ * @brief Transition state for extracting the diagonal of a matrix
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 3, and all elemenets are 0.
+ */
+template <class Handle>
+class DiagonalTransitionState {
+    template <class OtherHandle>
+    friend class DiagonalTransitionState;
+
+public:
+    DiagonalTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[0]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     *
+     * @param inDimension The number of columns of the (square) matrix
+     */
+    inline void initialize(const Allocator &inAllocator, Index inDimension) {
+        if (inDimension == 0
+            || static_cast<uint64_t>(inDimension)
+                > std::numeric_limits<uint32_t>::max())
+            throw std::invalid_argument("Invalid matrix dimension.");
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(inDimension));
+        rebind(inDimension);
+        dimension = inDimension;
+    }
+
+    inline Index positionOf(int32_t inRowID) const {
+        if (inRowID < 1 || static_cast<uint32_t>(inRowID) > dimension)
+            throw std::invalid_argument("Row number out of range.");
+        return inRowID - 1;
+    }
+
+    template <class OtherHandle>
+    DiagonalTransitionState &operator+=(
+        const DiagonalTransitionState<OtherHandle> &inOtherState) {
+
+        if (mStorage.size() != inOtherState.mStorage.size())
+            throw std::logic_error("Internal error: Incompatible transition "
+                "states");
+
+        numRows += inOtherState.numRows;
+        diagonal += inOtherState.diagonal;
+        return *this;
+    }
+
+private:
+    static inline size_t arraySize(size_t inDimension) {
+        return 2 + inDimension;
+    }
+
+    /**
+     * @brief Rebind to a new storage array
+     *
+     * Array layout:
+     * - 0: dimension (number of rows and columns of the matrix)
+     * - 1: numRows (number of rows seen so far)
+     * - 2: diagonal (as seen so far)
+     */
+    void rebind(uint32_t inDimension) {
+        dimension.rebind(&mStorage[0]);
+        numRows.rebind(&mStorage[1]);
+        diagonal.rebind(&mStorage[2], inDimension);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 dimension;
+    typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap diagonal;
+};
+
+/**
+ * @brief State of the (preconditioned) conjugate-gradient solver
+ *
+ * The complete state of the solver is kept in a single DOUBLE PRECISION array,
+ * so that each iteration needs only one scan over the matrix (to compute
+ * \f$ A \boldsymbol p \f$) and one call of conjugate_gradient_step(). In
+ * particular, the vectors never have to leave the database in text form.
+ */
+template <class Handle>
+class CGState {
+public:
+    CGState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        madlib_assert(mStorage.size() >= 4
+            && mStorage.size() == arraySize(static_cast<uint32_t>(mStorage[0])),
+            std::invalid_argument("Invalid conjugate-gradient state."));
+        rebind(static_cast<uint32_t>(mStorage[0]));
+    }
+
+    CGState(const Allocator &inAllocator, uint32_t inDimension)
+      : mStorage(inAllocator.allocateArray<double>(arraySize(inDimension))) {
+
+        rebind(inDimension);
+        dimension = inDimension;
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Restart from the current solution, given the residual
+     *
+     * The new search direction is the preconditioned residual.
+     */
+    void restart() {
+        p = r.cwiseProduct(invDiagonal);
+        r_transp_z = dot(r, p);
+        r_transp_r = r.squaredNorm();
+    }
+
+    static inline size_t arraySize(uint32_t inDimension) {
+        return 4 + 5 * static_cast<size_t>(inDimension);
+    }
+
+private:
+    /**
+     * @brief Rebind to a new storage array
+     *
+     * Array layout:
+     * - 0: dimension (number of unknowns)
+     * - 1: iteration (number of iterations so far)
+     * - 2: r_transp_z (r^T M^{-1} r, where M is the preconditioner)
+     * - 3: r_transp_r (squared norm of the residual)
+     * - 4: x (current solution)
+     * - 4 + dimension: r (current residual b - A x)
+     * - 4 + 2 * dimension: p (current search direction)
+     * - 4 + 3 * dimension: invDiagonal (inverse of the Jacobi preconditioner,
+     *   all 1 if no preconditioning)
+     * - 4 + 4 * dimension: b (right-hand side)
+     */
+    void rebind(uint32_t inDimension) {
+        dimension.rebind(&mStorage[0]);
+        iteration.rebind(&mStorage[1]);
+        r_transp_z.rebind(&mStorage[2]);
+        r_transp_r.rebind(&mStorage[3]);
+        x.rebind(&mStorage[4], inDimension);
+        r.rebind(&mStorage[4 + inDimension], inDimension);
+        p.rebind(&mStorage[4 + 2 * inDimension], inDimension);
+        invDiagonal.rebind(&mStorage[4 + 3 * inDimension], inDimension);
+        b.rebind(&mStorage[4 + 4 * inDimension], inDimension);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 dimension;
+    typename HandleTraits<Handle>::ReferenceToUInt64 iteration;
+    typename HandleTraits<Handle>::ReferenceToDouble r_transp_z;
+    typename HandleTraits<Handle>::ReferenceToDouble r_transp_r;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap x;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap r;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap p;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap invDiagonal;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap b;
+};
+
+/**
+ * @brief Perform the matrix-vector product transition step (dense rows)
+ */
+AnyType
+matrix_vector_product_transition::run(AnyType &args) {
+    MVPTransitionState<MutableArrayHandle<double> > state = args[0];
+    int32_t rowID = args[1].getAs<int32_t>();
+    HandleMap<const ColumnVector> row = args[2].getAs<ArrayHandle<double> >();
+
+    // Only read the vector for the first row
+    if (state.numRows == 0)
+        state.initialize(*this, args[3].getAs<ArrayHandle<double> >());
+
+    if (row.size() != state.vector.size())
+        throw std::invalid_argument("Matrix rows and vector have different "
+            "lengths.");
+
+    state.numRows++;
+    state.product(state.positionOf(rowID)) += dot(row, state.vector);
+    return state;
+}
+
+/**
+ * @brief Perform the matrix-vector product transition step (sparse rows)
+ *
+ * The cost is linear in the number of non-zero elements of the row.
+ */
+AnyType
+svec_matrix_vector_product_transition::run(AnyType &args) {
+    MVPTransitionState<MutableArrayHandle<double> > state = args[0];
+    int32_t rowID = args[1].getAs<int32_t>();
+    SparseColumnVector row = args[2].getAs<SparseColumnVector>();
+
+    if (state.numRows == 0)
+        state.initialize(*this, args[3].getAs<ArrayHandle<double> >());
+
+    if (row.size() != state.vector.size())
+        throw std::invalid_argument("Matrix rows and vector have different "
+            "lengths.");
+
+    double sum = 0;
+    for (SparseColumnVector::InnerIterator it(row); it; ++it)
+        sum += it.value() * state.vector(it.index());
+
+    state.numRows++;
+    state.product(state.positionOf(rowID)) += sum;
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+matrix_vector_product_merge_states::run(AnyType &args) {
+    MVPTransitionState<MutableArrayHandle<double> > stateLeft = args[0];
+    MVPTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.numRows == 0)
+        return stateRight;
+    else if (stateRight.numRows == 0)
+        return stateLeft;
+
+    // Merge states together and return
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the matrix-vector product final step
+ */
+AnyType
+matrix_vector_product_final::run(AnyType &args) {
+    MVPTransitionState<ArrayHandle<double> > state = args[0];
+
+    // If we haven't seen any data, just return Null. This is the standard
+    // behavior of aggregate function on empty data sets (compare, e.g.,
+    // how PostgreSQL handles sum or avg on empty inputs)
+    if (state.numRows == 0)
+        return Null();
+
+    HandleMap<ColumnVector> product(allocateArray<double>(state.dimension));
+    product = state.product;
+    return product;
+}
+
+/**
+ * @brief Perform the matrix-diagonal transition step (dense rows)
+ */
+AnyType
+matrix_diagonal_transition::run(AnyType &args) {
+    DiagonalTransitionState<MutableArrayHandle<double> > state = args[0];
+    int32_t rowID = args[1].getAs<int32_t>();
+    ArrayHandle<double> row = args[2].getAs<ArrayHandle<double> >();
+
+    if (state.numRows == 0)
+        state.initialize(*this, row.size());
+    else if (row.size() != state.dimension)
+        throw std::invalid_argument("Matrix rows have different lengths.");
+
+    Index pos = state.positionOf(rowID);
+    state.numRows++;
+    state.diagonal(pos) += row[pos];
+    return state;
+}
+
+/**
+ * @brief Perform the matrix-diagonal transition step (sparse rows)
+ */
+AnyType
+svec_matrix_diagonal_transition::run(AnyType &args) {
+    DiagonalTransitionState<MutableArrayHandle<double> > state = args[0];
+    int32_t rowID = args[1].getAs<int32_t>();
+    SparseColumnVector row = args[2].getAs<SparseColumnVector>();
+
+    if (state.numRows == 0)
+        state.initialize(*this, row.size());
+    else if (row.size() != state.dimension)
+        throw std::invalid_argument("Matrix rows have different lengths.");
+
+    Index pos = state.positionOf(rowID);
+    state.numRows++;
+    state.diagonal(pos) += row.coeff(pos);
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+matrix_diagonal_merge_states::run(AnyType &args) {
+    DiagonalTransitionState<MutableArrayHandle<double> > stateLeft = args[0];
+    DiagonalTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    if (stateLeft.numRows == 0)
+        return stateRight;
+    else if (stateRight.numRows == 0)
+        return stateLeft;
+
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the matrix-diagonal final step
+ */
+AnyType
+matrix_diagonal_final::run(AnyType &args) {
+    DiagonalTransitionState<ArrayHandle<double> > state = args[0];
+
+    if (state.numRows == 0)
+        return Null();
+
+    HandleMap<ColumnVector> diagonal(allocateArray<double>(state.dimension));
+    diagonal = state.diagonal;
+    return diagonal;
+}
+
+/**
+ * @brief Initialize the conjugate-gradient solver state
+ *
+ * Arguments are the right-hand side \f$ \boldsymbol b \f$ and, optionally
+ * (may be NULL), the diagonal of the matrix for Jacobi preconditioning. We
+ * start with \f$ \boldsymbol x = \boldsymbol 0 \f$, so that the initial
+ * residual is \f$ \boldsymbol b \f$ and no matrix scan is needed.
+ */
+AnyType
+conjugate_gradient_init::run(AnyType &args) {
+    HandleMap<const ColumnVector> b = args[0].getAs<ArrayHandle<double> >();
+
+    if (b.size() == 0
+        || static_cast<uint64_t>(b.size())
+            > std::numeric_limits<uint32_t>::max())
+        throw std::invalid_argument("Invalid length of right-hand side.");
+    if (!isfinite(b))
+        throw std::domain_error("Right-hand side is not finite.");
+
+    CGState<MutableArrayHandle<double> > state(*this, b.size());
+    state.iteration = 0;
+    state.x.setZero();
+    state.b = b;
+    state.r = b;
+
+    if (args[1].isNull()) {
+        state.invDiagonal.setOnes();
+    } else {
+        HandleMap<const ColumnVector> diagonal
+            = args[1].getAs<ArrayHandle<double> >();
+        if (diagonal.size() != b.size())
+            throw std::invalid_argument("Matrix diagonal and right-hand side "
+                "have different lengths.");
+        if (!isfinite(diagonal) || (diagonal.array() <= 0).any())
+            throw std::domain_error("Matrix is not positive definite: Its "
+                "diagonal contains non-positive elements.");
+        state.invDiagonal = diagonal.cwiseInverse();
+    }
+
+    state.restart();
+    return state;
+}
+
+/**
+ * @brief Perform one conjugate-gradient iteration
+ *
+ * Given the product \f$ A \boldsymbol p \f$ of the matrix and the current
+ * search direction, update the solution, the residual, and the search
+ * direction. All vector operations are done in memory.
+ */
+AnyType
+conjugate_gradient_step::run(AnyType &args) {
+    CGState<MutableArrayHandle<double> > state = args[0];
+    HandleMap<const ColumnVector> Ap = args[1].getAs<ArrayHandle<double> >();
+
+    if (Ap.size() != state.p.size())
+        throw std::invalid_argument("Matrix-vector product has wrong length.");
+
+    double p_transp_Ap = dot(state.p, Ap);
+    if (!(p_transp_Ap > 0)) {
+        if (state.r_transp_r == 0)
+            return state;
+        throw std::domain_error("Matrix is not positive definite.");
+    }
+
+    double alpha = state.r_transp_z / p_transp_Ap;
+    state.x += alpha * state.p;
+    state.r -= alpha * Ap;
+
+    ColumnVector z = state.r.cwiseProduct(state.invDiagonal);
+    double r_transp_z = dot(state.r, z);
+    double beta = r_transp_z / state.r_transp_z;
+    state.p = z + beta * state.p;
+    state.r_transp_z = r_transp_z;
+    state.r_transp_r = state.r.squaredNorm();
+    state.iteration++;
+    return state;
+}
+
+/**
+ * @brief Recompute the residual from scratch and restart
+ *
+ * The recursively updated residual accumulates rounding errors. Given
+ * \f$ A \boldsymbol x \f$ for the current solution, we recompute
+ * \f$ \boldsymbol r = \boldsymbol b - A \boldsymbol x \f$ and restart with
+ * the preconditioned residual as search direction.
+ */
+AnyType
+conjugate_gradient_restart::run(AnyType &args) {
+    CGState<MutableArrayHandle<double> > state = args[0];
+    HandleMap<const ColumnVector> Ax = args[1].getAs<ArrayHandle<double> >();
+
+    if (Ax.size() != state.x.size())
+        throw std::invalid_argument("Matrix-vector product has wrong length.");
+
+    state.r = state.b - Ax;
+    state.restart();
+    return state;
+}
+
+/**
+ * @brief Return the current search direction
+ */
+AnyType
+conjugate_gradient_direction::run(AnyType &args) {
+    CGState<ArrayHandle<double> > state = args[0];
+
+    HandleMap<ColumnVector> p(allocateArray<double>(state.dimension));
+    p = state.p;
+    return p;
+}
+
+/**
+ * @brief Return the current solution
+ */
+AnyType
+conjugate_gradient_solution::run(AnyType &args) {
+    CGState<ArrayHandle<double> > state = args[0];
+
+    HandleMap<ColumnVector> x(allocateArray<double>(state.dimension));
+    x = state.x;
+    return x;
+}
+
+/**
+ * @brief Return the squared norm of the current residual
+ */
+AnyType
+conjugate_gradient_residual_norm::run(AnyType &args) {
+    CGState<ArrayHandle<double> > state = args[0];
+
+    return static_cast<double>(state.r_transp_r);
+}
+
+} // namespace linalg
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,75 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file conjugate_gradient.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Matrix-vector product: Transition function for dense matrix rows
+ */
+DECLARE_UDF(linalg, matrix_vector_product_transition)
+
+/**
+ * @brief Matrix-vector product: Transition function for sparse matrix rows
+ */
+DECLARE_UDF(linalg, svec_matrix_vector_product_transition)
+
+/**
+ * @brief Matrix-vector product: State merge function
+ */
+DECLARE_UDF(linalg, matrix_vector_product_merge_states)
+
+/**
+ * @brief Matrix-vector product: Final function
+ */
+DECLARE_UDF(linalg, matrix_vector_product_final)
+
+/**
+ * @brief Matrix diagonal: Transition function for dense matrix rows
+ */
+DECLARE_UDF(linalg, matrix_diagonal_transition)
+
+/**
+ * @brief Matrix diagonal: Transition function for sparse matrix rows
+ */
+DECLARE_UDF(linalg, svec_matrix_diagonal_transition)
+
+/**
+ * @brief Matrix diagonal: State merge function
+ */
+DECLARE_UDF(linalg, matrix_diagonal_merge_states)
+
+/**
+ * @brief Matrix diagonal: Final function
+ */
+DECLARE_UDF(linalg, matrix_diagonal_final)
+
+/**
+ * @brief Conjugate gradient: Initialize the solver state
+ */
+DECLARE_UDF(linalg, conjugate_gradient_init)
+
+/**
+ * @brief Conjugate gradient: Perform one iteration, given A p
+ */
+DECLARE_UDF(linalg, conjugate_gradient_step)
+
+/**
+ * @brief Conjugate gradient: Recompute the residual, given A x
+ */
+DECLARE_UDF(linalg, conjugate_gradient_restart)
+
+/**
+ * @brief Conjugate gradient: Return the current search direction
+ */
+DECLARE_UDF(linalg, conjugate_gradient_direction)
+
+/**
+ * @brief Conjugate gradient: Return the current solution
+ */
+DECLARE_UDF(linalg, conjugate_gradient_solution)
+
+/**
+ * @brief Conjugate gradient: Return the squared norm of the current residual
+ */
+DECLARE_UDF(linalg, conjugate_gradient_residual_norm)
@@ -0,0 +1,9 @@
+/* -----------------------------------------------------------------------------
+ *
+ * @file linalg.hpp
+ *
+ * @brief Umbrella header that includes all linear-algebra headers
+ *
+ * -------------------------------------------------------------------------- */
+
+#include "conjugate_gradient.hpp"
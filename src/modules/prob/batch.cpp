@@ -0,0 +1,218 @@
+/* ----------------------------------------------------------------------- *//** 
+ *
+ * @file batch.cpp
+ *
+ * @brief Evaluate distribution functions for whole arrays of points
+ *
+ * Computing p-values for many tests at once is dominated by the overhead of
+ * calling a UDF once per point. The functions in this file take an array of
+ * points and return the array of CDF values. They use exactly the same
+ * numerical methods as the scalar functions, so results (and error bounds)
+ * are identical to calling the scalar function for every point.
+ *
+ * Degrees of freedom are given either as a single-element array (applying to
+ * all points) or as an array with one value per point. Consecutive points with
+ * equal degrees of freedom share the argument checks and the distribution
+ * object, so inputs grouped by degrees of freedom are evaluated fastest.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#include <boost/math/distributions/chi_squared.hpp>
+#include <boost/math/distributions/fisher_f.hpp>
+
+#include "batch.hpp"
+#include "boost.hpp"
+#include "kolmogorov.hpp"
+#include "student.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+namespace prob {
+
+namespace {
+    // Anonymous namespace for internal functions
+
+/**
+ * @brief Check that a parameter array can be broadcast to the points
+ */
+void
+checkParameterSize(const ArrayHandle<double>& inPoints,
+    const ArrayHandle<double>& inParam, const char* inName) {
+
+    if (inParam.size() != 1 && inParam.size() != inPoints.size())
+        throw std::invalid_argument(std::string(inName) + " must have either "
+            "one element or one element per point");
+}
+
+/**
+ * @brief Return the i-th element of a parameter array, repeating a
+ *     single-element array
+ */
+inline
+double
+parameter(const ArrayHandle<double>& inParam, size_t i) {
+    return inParam.size() == 1 ? inParam[0] : inParam[i];
+}
+
+/**
+ * @brief CDF of a distribution with support [0, infinity)
+ *
+ * This has the same special cases as chiSquaredCDF() and fisherF_CDF(), but
+ * takes an already constructed distribution object.
+ */
+template <class Distribution>
+inline
+double
+nonNegativeCDF(const Distribution& inDist, double t) {
+    if (std::isnan(t))
+        return std::numeric_limits<double>::quiet_NaN();
+    else if (t == std::numeric_limits<double>::infinity())
+        return 1;
+    else if (t < 0)
+        return 0;
+
+    return boost::math::cdf(inDist, t);
+}
+
+} // namespace
+
+/**
+ * @brief Chi-squared cumulative distribution function for an array of points:
+ *     In-database interface
+ */
+AnyType
+chi_squared_cdf_batch::run(AnyType &args) {
+    ArrayHandle<double> t = args[0].getAs<ArrayHandle<double> >();
+    ArrayHandle<double> nu = args[1].getAs<ArrayHandle<double> >();
+    checkParameterSize(t, nu, "Degrees of freedom");
+
+    MutableArrayHandle<double> result = allocateArray<double>(t.size());
+    // NaN compares unequal to everything, so the first degree of freedom is
+    // always checked
+    double lastNu = std::numeric_limits<double>::quiet_NaN();
+    boost::math::chi_squared dist;
+    for (size_t i = 0; i < t.size(); i++) {
+        double curNu = parameter(nu, i);
+        if (std::isnan(curNu)) {
+            result[i] = std::numeric_limits<double>::quiet_NaN();
+            continue;
+        }
+        if (curNu != lastNu) {
+            if (curNu <= 0)
+                throw std::domain_error("Chi Squared distribution undefined "
+                    "for degree of freedom <= 0");
+            dist = boost::math::chi_squared(curNu);
+            lastNu = curNu;
+        }
+        result[i] = nonNegativeCDF(dist, t[i]);
+    }
+    return result;
+}
+
+/**
+ * @brief Fisher F cumulative distribution function for an array of points:
+ *     In-database interface
+ */
+AnyType
+fisher_f_cdf_batch::run(AnyType &args) {
+    ArrayHandle<double> t = args[0].getAs<ArrayHandle<double> >();
+    ArrayHandle<double> df1 = args[1].getAs<ArrayHandle<double> >();
+    ArrayHandle<double> df2 = args[2].getAs<ArrayHandle<double> >();
+    checkParameterSize(t, df1, "Degrees of freedom in numerator");
+    checkParameterSize(t, df2, "Degrees of freedom in denominator");
+
+    MutableArrayHandle<double> result = allocateArray<double>(t.size());
+    double lastDf1 = std::numeric_limits<double>::quiet_NaN();
+    double lastDf2 = std::numeric_limits<double>::quiet_NaN();
+    boost::math::fisher_f dist(1, 1);
+    for (size_t i = 0; i < t.size(); i++) {
+        double curDf1 = parameter(df1, i);
+        double curDf2 = parameter(df2, i);
+        if (std::isnan(curDf1) || std::isnan(curDf2)) {
+            result[i] = std::numeric_limits<double>::quiet_NaN();
+            continue;
+        }
+        if (curDf1 != lastDf1 || curDf2 != lastDf2) {
+            if (curDf1 <= 0 || curDf2 <= 0)
+                throw std::domain_error("Fisher F distribution undefined for "
+                    "degrees of freedom <= 0");
+            dist = boost::math::fisher_f(curDf1, curDf2);
+            lastDf1 = curDf1;
+            lastDf2 = curDf2;
+        }
+        result[i] = nonNegativeCDF(dist, t[i]);
+    }
+    return result;
+}
+
+/**
+ * @brief Kolmogorov cumulative distribution function for an array of points:
+ *     In-database interface
+ */
+AnyType
+kolmogorov_cdf_batch::run(AnyType &args) {
+    ArrayHandle<double> t = args[0].getAs<ArrayHandle<double> >();
+
+    MutableArrayHandle<double> result = allocateArray<double>(t.size());
+    for (size_t i = 0; i < t.size(); i++)
+        result[i] = kolmogorovCDF(t[i]);
+    return result;
+}
+
+/**
+ * @brief Normal cumulative distribution function for an array of points:
+ *     In-database interface
+ */
+AnyType
+normal_cdf_batch::run(AnyType &args) {
+    ArrayHandle<double> t = args[0].getAs<ArrayHandle<double> >();
+    double mu = args[1].getAs<double>();
+    double sigma = args[2].getAs<double>();
+
+    if (sigma < 0)
+        throw std::domain_error("Normal distribtion distribution undefined for "
+            "standard deviation < 0");
+
+    MutableArrayHandle<double> result = allocateArray<double>(t.size());
+    for (size_t i = 0; i < t.size(); i++)
+        result[i] = normalCDF(t[i], mu, sigma);
+    return result;
+}
+
+/**
+ * @brief Student-t cumulative distribution function for an array of points:
+ *     In-database interface
+ *
+ * studentT_CDF() chooses between several methods depending on the degree of
+ * freedom, and none of them has state worth caching beyond the argument check.
+ */
+AnyType
+student_t_cdf_batch::run(AnyType &args) {
+    ArrayHandle<double> t = args[0].getAs<ArrayHandle<double> >();
+    ArrayHandle<double> nu = args[1].getAs<ArrayHandle<double> >();
+    checkParameterSize(t, nu, "Degrees of freedom");
+
+    MutableArrayHandle<double> result = allocateArray<double>(t.size());
+    double lastNu = std::numeric_limits<double>::quiet_NaN();
+    for (size_t i = 0; i < t.size(); i++) {
+        double curNu = parameter(nu, i);
+        if (curNu != lastNu && !std::isnan(curNu)) {
+            if (curNu <= 0.)
+                throw std::domain_error("Student-t distribution undefined for "
+                    "degree of freedom <= 0");
+            lastNu = curNu;
+        }
+        result[i] = studentT_CDF(t[i], curNu);
+    }
+    return result;
+}
+
+} // namespace prob
+
+} // namespace modules
+
+} // namespace madlib
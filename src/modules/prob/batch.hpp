@@ -0,0 +1,30 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file batch.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Chi-squared cumulative distribution function, evaluated for an array
+ */
+DECLARE_UDF(prob, chi_squared_cdf_batch)
+
+/**
+ * @brief Fisher F cumulative distribution function, evaluated for an array
+ */
+DECLARE_UDF(prob, fisher_f_cdf_batch)
+
+/**
+ * @brief Kolmogorov cumulative distribution function, evaluated for an array
+ */
+DECLARE_UDF(prob, kolmogorov_cdf_batch)
+
+/**
+ * @brief Normal cumulative distribution function, evaluated for an array
+ */
+DECLARE_UDF(prob, normal_cdf_batch)
+
+/**
+ * @brief Student-t cumulative distribution function, evaluated for an array
+ */
+DECLARE_UDF(prob, student_t_cdf_batch)
@@ -6,6 +6,7 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include "batch.hpp"
 #include "boost.hpp"
 #include "kolmogorov.hpp"
 #include "student.hpp"
@@ -0,0 +1,597 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file grouped_linear.cpp
+ *
+ * @brief Linear-regression functions for many groups in a single aggregate
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+#include <modules/prob/prob.hpp>
+
+#include "grouped_linear.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace madlib {
+
+// Use Eigen
+using namespace dbal::eigen_integration;
+
+namespace modules {
+
+// Import names from other MADlib modules
+using prob::studentT_CDF;
+
+namespace regress {
+
+/**
+ * @brief Transition state for grouped linear regression
+ *
+ * The state is an open-addressing hash table (with linear probing) that maps
+ * each group key to the sufficient statistics of that group, i.e., the same
+ * quantities that LinRegrTransitionState keeps for a single model. Since
+ * \f$ X^T X \f$ is symmetric, we only store its lower triangle, packed row by
+ * row.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length at least 4, and all elemenets are 0.
+ */
+template <class Handle>
+class GroupedLinRegrTransitionState {
+public:
+    GroupedLinRegrTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind();
+    }
+
+    /**
+     * @brief Convert to backend representation
+     *
+     * We define this function so that we can use TransitionState in the argument
+     * list and as a return type.
+     */
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Number of elements in the packed lower triangle of X^T X
+     */
+    static inline size_t triangleSize(uint16_t inWidthOfX) {
+        return static_cast<size_t>(inWidthOfX) * (inWidthOfX + 1) / 2;
+    }
+
+    /**
+     * @brief Number of elements of one slot of the hash table
+     *
+     * Slot layout:
+     * - 0: key (group key)
+     * - 1: numRows (number of rows of this group seen so far; 0 if the slot
+     *      is empty)
+     * - 2: y_sum (sum of dependent variables seen so far)
+     * - 3: y_square_sum (sum of squares of dependent variables seen so far)
+     * - 4: X_transp_Y (X^T y, for that parts of X and y seen so far)
+     * - 4 + widthOfX: lower triangle of X^T X, packed row by row
+     */
+    static inline size_t slotSize(uint16_t inWidthOfX) {
+        return 4 + inWidthOfX + triangleSize(inWidthOfX);
+    }
+
+    /**
+     * @brief Return the slot that contains the given key, or the empty slot
+     *     where it would be inserted
+     */
+    uint32_t slotOf(double inKey) const {
+        // Multiplicative hashing. The capacity is a power of 2, so we keep the
+        // (better mixed) high bits.
+        uint64_t hash = static_cast<uint64_t>(static_cast<int64_t>(inKey))
+            * 0x9E3779B97F4A7C15ULL;
+        uint32_t slot = static_cast<uint32_t>(hash >> 32) & (capacity - 1);
+
+        while (group(slot)[1] != 0 && group(slot)[0] != inKey)
+            slot = (slot + 1) & (capacity - 1);
+        return slot;
+    }
+
+    /**
+     * @brief Return the statistics of a group, inserting the group if
+     *     necessary
+     *
+     * Whenever the load factor would exceed 1/2, we reallocate the state with
+     * twice the capacity and rehash all groups. The returned pointer is only
+     * valid until the next call.
+     */
+    double *insert(const Allocator& inAllocator, double inKey) {
+        if (2 * (static_cast<uint64_t>(numGroups) + 1) > capacity)
+            grow(inAllocator);
+
+        double *stats = group(slotOf(inKey));
+        if (stats[1] == 0) {
+            stats[0] = inKey;
+            numGroups = numGroups + 1;
+        }
+        return stats;
+    }
+
+    /**
+     * @brief Return the statistics in the given slot of the hash table
+     */
+    typename HandleTraits<Handle>::DoublePtr group(uint32_t inSlot) const {
+        return slots + inSlot * slotSize(widthOfX);
+    }
+
+private:
+    static inline size_t arraySize(uint16_t inWidthOfX, uint32_t inCapacity) {
+        return 4 + slotSize(inWidthOfX) * inCapacity;
+    }
+
+    /**
+     * @brief Rebind to a new storage array
+     *
+     * Array layout:
+     * - 0: widthOfX (number of coefficients)
+     * - 1: numRows (number of rows seen so far)
+     * - 2: numGroups (number of distinct groups seen so far)
+     * - 3: capacity (number of slots, always 0 or a power of 2)
+     * - 4: slots
+     */
+    void rebind() {
+        widthOfX.rebind(&mStorage[0]);
+        numRows.rebind(&mStorage[1]);
+        numGroups.rebind(&mStorage[2]);
+        capacity.rebind(&mStorage[3]);
+
+        madlib_assert(mStorage.size() >= arraySize(widthOfX, capacity),
+            std::runtime_error("Out-of-bounds array access detected."));
+        slots = mStorage.ptr() + 4;
+    }
+
+    void grow(const Allocator& inAllocator) {
+        GroupedLinRegrTransitionState oldSelf = *this;
+        uint32_t newCapacity = oldSelf.capacity == 0 ? 16
+            : 2 * oldSelf.capacity;
+        size_t size = slotSize(oldSelf.widthOfX);
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(oldSelf.widthOfX, newCapacity));
+        mStorage[0] = oldSelf.widthOfX;
+        mStorage[3] = newCapacity;
+        rebind();
+        // Assigning one reference to another would copy the reference, not
+        // the value, so we copy through plain integers
+        uint64_t rows = oldSelf.numRows;
+        numRows = rows;
+
+        for (uint32_t slot = 0; slot < oldSelf.capacity; ++slot) {
+            const double *stats = oldSelf.group(slot);
+            if (stats[1] == 0)
+                continue;
+
+            std::copy(stats, stats + size, group(slotOf(stats[0])));
+        }
+        uint32_t groups = oldSelf.numGroups;
+        numGroups = groups;
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt16 widthOfX;
+    typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numGroups;
+    typename HandleTraits<Handle>::ReferenceToUInt32 capacity;
+    typename HandleTraits<Handle>::DoublePtr slots;
+};
+
+namespace {
+
+/**
+ * Groups with at most this many independent variables are solved by the
+ * batched Cholesky decomposition. Wider groups are solved one at a time.
+ */
+const uint16_t kMaxBatchedWidth = 16;
+
+/**
+ * Number of groups that are decomposed together
+ */
+const uint32_t kBatchSize = 32;
+
+/**
+ * A pivot of the Cholesky decomposition is considered zero if it is at most
+ * this fraction of the corresponding diagonal element of X^T X. Such groups
+ * are solved with the pseudo-inverse instead.
+ */
+const double kPivotTolerance = 1e-10;
+
+/**
+ * @brief Index of element (i, j), j <= i, in a packed lower triangle
+ */
+inline size_t packedIndex(size_t i, size_t j) {
+    return i * (i + 1) / 2 + j;
+}
+
+/**
+ * @brief Number of output elements per group
+ */
+inline size_t resultSize(uint16_t inWidthOfX) {
+    return 4 + 4 * static_cast<size_t>(inWidthOfX);
+}
+
+/**
+ * @brief Write the model of one group to the output array
+ *
+ * Given the coefficients and the diagonal of \f$ (X^T X)^{-1} \f$, the
+ * remaining statistics are computed exactly as in linregr_final.
+ */
+void
+writeGroupResult(double *outResult, uint16_t inWidthOfX, const double *inStats,
+    const double *inCoef, const double *inInverseDiagonal,
+    double inConditionNo) {
+
+    double numRows = inStats[1];
+    double y_sum = inStats[2];
+    double y_square_sum = inStats[3];
+    const double *X_transp_Y = inStats + 4;
+
+    double ess = -(y_sum * y_sum) / numRows;
+    for (uint16_t i = 0; i < inWidthOfX; ++i)
+        ess += X_transp_Y[i] * inCoef[i];
+    double tss = y_square_sum - (y_sum * y_sum) / numRows;
+
+    // See linregr_final for the rationale of the following adjustments
+    if (tss < 0)
+        tss = 0;
+    if (ess < 0)
+        ess = 0;
+    if (ess > tss)
+        ess = tss;
+
+    double r2 = (tss == 0 ? 1 : ess / tss);
+    double variance = (tss - ess) / (numRows - inWidthOfX);
+
+    double *coef = outResult + 4;
+    double *stdErr = coef + inWidthOfX;
+    double *tStats = stdErr + inWidthOfX;
+    double *pValues = tStats + inWidthOfX;
+
+    outResult[0] = inStats[0];
+    outResult[1] = numRows;
+    outResult[2] = r2;
+    outResult[3] = inConditionNo;
+    for (uint16_t i = 0; i < inWidthOfX; ++i) {
+        coef[i] = inCoef[i];
+        stdErr[i] = inInverseDiagonal[i] < 0
+            ? 0 : std::sqrt(variance * inInverseDiagonal[i]);
+        tStats[i] = (coef[i] == 0 && stdErr[i] == 0)
+            ? 0 : coef[i] / stdErr[i];
+        pValues[i] = 2. * (1. - studentT_CDF(std::fabs(tStats[i]),
+            numRows - inWidthOfX));
+    }
+}
+
+/**
+ * @brief Solve one group with the pseudo-inverse, just like linregr_final
+ */
+void
+solveGroupWithPseudoInverse(double *outResult, uint16_t inWidthOfX,
+    const double *inStats) {
+
+    const double *triangle = inStats + 4 + inWidthOfX;
+    Matrix X_transp_X(inWidthOfX, inWidthOfX);
+    for (uint16_t i = 0; i < inWidthOfX; ++i)
+        for (uint16_t j = 0; j <= i; ++j)
+            X_transp_X(i, j) = X_transp_X(j, i) = triangle[packedIndex(i, j)];
+
+    SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
+        X_transp_X, EigenvaluesOnly, ComputePseudoInverse);
+    const Matrix &inverse_of_X_transp_X = decomposition.pseudoInverse();
+
+    ColumnVector coef = inverse_of_X_transp_X
+        * Eigen::Map<const ColumnVector>(inStats + 4, inWidthOfX);
+    ColumnVector inverseDiagonal = inverse_of_X_transp_X.diagonal();
+
+    writeGroupResult(outResult, inWidthOfX, inStats, coef.data(),
+        inverseDiagonal.data(), decomposition.conditionNo());
+}
+
+/**
+ * @brief Solve a batch of groups with one Cholesky decomposition pass
+ *
+ * All matrices of the batch are stored interleaved ("structure of arrays"),
+ * so that the innermost loops run over the groups of the batch and can be
+ * vectorized by the compiler. Groups whose matrix is not (numerically)
+ * positive definite are solved with the pseudo-inverse instead.
+ *
+ * The condition number reported for groups solved here is the estimate
+ * \f$ (\max_i l_{ii} / \min_i l_{ii})^2 \f$, which is a lower bound on the
+ * condition number of \f$ X^T X = L L^T \f$.
+ */
+void
+solveGroupBatch(double **outResults, uint16_t inWidthOfX,
+    const double *const *inStats, uint32_t inNumGroups) {
+
+    const size_t w = inWidthOfX;
+    const size_t B = inNumGroups;
+    const size_t T = w * (w + 1) / 2;
+
+    // Lower triangles of L and L^{-1}, the solution vectors, and the
+    // diagonal of (X^T X)^{-1}, each for all groups of the batch
+    std::vector<double> L(T * B), Linv(T * B), z(w * B), diag(w * B);
+    std::vector<char> positiveDefinite(B, 1);
+
+    // Load X^T X and X^T y
+    for (size_t g = 0; g < B; ++g) {
+        const double *triangle = inStats[g] + 4 + w;
+        for (size_t t = 0; t < T; ++t)
+            L[t * B + g] = triangle[t];
+        for (size_t i = 0; i < w; ++i)
+            z[i * B + g] = inStats[g][4 + i];
+    }
+
+    // Cholesky decomposition X^T X = L L^T, in place
+    for (size_t j = 0; j < w; ++j) {
+        double *Ljj = &L[packedIndex(j, j) * B];
+        for (size_t g = 0; g < B; ++g) {
+            double d = Ljj[g];
+            for (size_t k = 0; k < j; ++k) {
+                double Ljk = L[packedIndex(j, k) * B + g];
+                d -= Ljk * Ljk;
+            }
+            // Ljj[g] still holds the diagonal element of X^T X
+            if (!(d > kPivotTolerance * Ljj[g])) {
+                positiveDefinite[g] = 0;
+                d = 1;
+            }
+            Ljj[g] = std::sqrt(d);
+        }
+        for (size_t i = j + 1; i < w; ++i) {
+            double *Lij = &L[packedIndex(i, j) * B];
+            for (size_t k = 0; k < j; ++k) {
+                const double *Lik = &L[packedIndex(i, k) * B];
+                const double *Ljk = &L[packedIndex(j, k) * B];
+                for (size_t g = 0; g < B; ++g)
+                    Lij[g] -= Lik[g] * Ljk[g];
+            }
+            for (size_t g = 0; g < B; ++g)
+                Lij[g] /= Ljj[g];
+        }
+    }
+
+    // Forward substitution L z' = X^T y, then back substitution L^T c = z'
+    for (size_t i = 0; i < w; ++i) {
+        for (size_t k = 0; k < i; ++k) {
+            const double *Lik = &L[packedIndex(i, k) * B];
+            for (size_t g = 0; g < B; ++g)
+                z[i * B + g] -= Lik[g] * z[k * B + g];
+        }
+        const double *Lii = &L[packedIndex(i, i) * B];
+        for (size_t g = 0; g < B; ++g)
+            z[i * B + g] /= Lii[g];
+    }
+    for (size_t i = w; i-- > 0; ) {
+        for (size_t k = i + 1; k < w; ++k) {
+            const double *Lki = &L[packedIndex(k, i) * B];
+            for (size_t g = 0; g < B; ++g)
+                z[i * B + g] -= Lki[g] * z[k * B + g];
+        }
+        const double *Lii = &L[packedIndex(i, i) * B];
+        for (size_t g = 0; g < B; ++g)
+            z[i * B + g] /= Lii[g];
+    }
+
+    // L^{-1} is lower triangular, and
+    // ((X^T X)^{-1})_{jj} = sum_{i >= j} ((L^{-1})_{ij})^2
+    for (size_t j = 0; j < w; ++j) {
+        const double *Ljj = &L[packedIndex(j, j) * B];
+        double *Linvjj = &Linv[packedIndex(j, j) * B];
+        for (size_t g = 0; g < B; ++g)
+            Linvjj[g] = 1. / Ljj[g];
+        for (size_t i = j + 1; i < w; ++i) {
+            double *Linvij = &Linv[packedIndex(i, j) * B];
+            for (size_t k = j; k < i; ++k) {
+                const double *Lik = &L[packedIndex(i, k) * B];
+                const double *Linvkj = &Linv[packedIndex(k, j) * B];
+                for (size_t g = 0; g < B; ++g)
+                    Linvij[g] -= Lik[g] * Linvkj[g];
+            }
+            const double *Lii = &L[packedIndex(i, i) * B];
+            for (size_t g = 0; g < B; ++g)
+                Linvij[g] /= Lii[g];
+        }
+        for (size_t i = j; i < w; ++i) {
+            const double *Linvij = &Linv[packedIndex(i, j) * B];
+            for (size_t g = 0; g < B; ++g)
+                diag[j * B + g] += Linvij[g] * Linvij[g];
+        }
+    }
+
+    std::vector<double> coef(w), inverseDiagonal(w);
+    for (size_t g = 0; g < B; ++g) {
+        if (!positiveDefinite[g]) {
+            solveGroupWithPseudoInverse(outResults[g], inWidthOfX, inStats[g]);
+            continue;
+        }
+
+        double minPivot = L[g], maxPivot = L[g];
+        for (size_t i = 0; i < w; ++i) {
+            double pivot = L[packedIndex(i, i) * B + g];
+            minPivot = std::min(minPivot, pivot);
+            maxPivot = std::max(maxPivot, pivot);
+            coef[i] = z[i * B + g];
+            inverseDiagonal[i] = diag[i * B + g];
+        }
+        double ratio = maxPivot / minPivot;
+        writeGroupResult(outResults[g], inWidthOfX, inStats[g], &coef[0],
+            &inverseDiagonal[0], ratio * ratio);
+    }
+}
+
+} // namespace
+
+/**
+ * @brief Perform the grouped linear-regression transition step
+ *
+ * Arguments are the group key, the dependent variable, and the array of
+ * independent variables. Group keys are stored as DOUBLE PRECISION values, so
+ * they must not exceed \f$ 2^{53} \f$ in absolute value.
+ */
+AnyType
+grouped_linregr_transition::run(AnyType &args) {
+    GroupedLinRegrTransitionState<MutableArrayHandle<double> > state = args[0];
+    int64_t key = args[1].getAs<int64_t>();
+    double y = args[2].getAs<double>();
+    HandleMap<const ColumnVector> x = args[3].getAs<ArrayHandle<double> >();
+
+    if (!std::isfinite(y))
+        throw std::domain_error("Dependent variables are not finite.");
+    else if (!isfinite(x))
+        throw std::domain_error("Design matrix is not finite.");
+    else if (key > (int64_t(1) << 53) || key < -(int64_t(1) << 53))
+        throw std::domain_error("Group keys must not exceed 2^53 in absolute "
+            "value.");
+
+    if (state.numRows == 0) {
+        if (x.size() == 0)
+            throw std::domain_error("Independent variables must not be "
+                "empty.");
+        if (x.size() > std::numeric_limits<uint16_t>::max())
+            throw std::domain_error("Number of independent variables cannot be "
+                "larger than 65535.");
+
+        state.widthOfX = static_cast<uint16_t>(x.size());
+    } else if (x.size() != state.widthOfX)
+        throw std::invalid_argument("Independent variables have inconsistent "
+            "lengths.");
+
+    uint16_t w = state.widthOfX;
+    double *stats = state.insert(*this, static_cast<double>(key));
+    stats[1] += 1;
+    stats[2] += y;
+    stats[3] += y * y;
+    double *X_transp_Y = stats + 4;
+    double *triangle = X_transp_Y + w;
+    for (uint16_t i = 0; i < w; ++i) {
+        X_transp_Y[i] += x(i) * y;
+        for (uint16_t j = 0; j <= i; ++j)
+            *triangle++ += x(i) * x(j);
+    }
+    state.numRows++;
+
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+grouped_linregr_merge_states::run(AnyType &args) {
+    GroupedLinRegrTransitionState<MutableArrayHandle<double> > stateLeft
+        = args[0];
+    GroupedLinRegrTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.numRows == 0)
+        return stateRight;
+    else if (stateRight.numRows == 0)
+        return stateLeft;
+    else if (stateLeft.widthOfX != stateRight.widthOfX)
+        throw std::invalid_argument("Independent variables have inconsistent "
+            "lengths.");
+
+    size_t size = GroupedLinRegrTransitionState<ArrayHandle<double> >
+        ::slotSize(stateRight.widthOfX);
+    for (uint32_t slot = 0; slot < stateRight.capacity; ++slot) {
+        const double *other = stateRight.group(slot);
+        if (other[1] == 0)
+            continue;
+
+        double *stats = stateLeft.insert(*this, other[0]);
+        for (size_t i = 1; i < size; ++i)
+            stats[i] += other[i];
+    }
+    stateLeft.numRows += stateRight.numRows;
+
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the grouped linear-regression final step
+ *
+ * Return the models of all groups as a single DOUBLE PRECISION array
+ * <tt>(numGroups, widthOfX, groups...)</tt>, where each group is
+ * <tt>(key, num_rows, r2, condition_no, coef[widthOfX], std_err[widthOfX],
+ * t_stats[widthOfX], p_values[widthOfX])</tt>. Groups are ordered by key.
+ *
+ * Groups with few independent variables are solved in batches with a
+ * Cholesky decomposition. All other groups, and groups whose matrix
+ * \f$ X^T X \f$ is (numerically) singular, are solved with the pseudo-inverse
+ * as in linregr_final.
+ */
+AnyType
+grouped_linregr_final::run(AnyType &args) {
+    GroupedLinRegrTransitionState<ArrayHandle<double> > state = args[0];
+
+    // If we haven't seen any data, just return Null. This is the standard
+    // behavior of aggregate function on empty data sets (compare, e.g.,
+    // how PostgreSQL handles sum or avg on empty inputs)
+    if (state.numRows == 0)
+        return Null();
+
+    // See MADLIB-138. At least on certain platforms and with certain versions,
+    // LAPACK will run into an infinite loop if pinv() is called for non-finite
+    // matrices.
+    uint16_t w = state.widthOfX;
+    size_t size = GroupedLinRegrTransitionState<ArrayHandle<double> >
+        ::slotSize(w);
+    std::vector<std::pair<double, uint32_t> > groups;
+    groups.reserve(state.numGroups);
+    for (uint32_t slot = 0; slot < state.capacity; ++slot) {
+        const double *stats = state.group(slot);
+        if (stats[1] == 0)
+            continue;
+
+        for (size_t i = 2; i < size; ++i)
+            if (!std::isfinite(stats[i]))
+                throw std::domain_error("Design matrix is not finite.");
+        groups.push_back(std::make_pair(stats[0], slot));
+    }
+    std::sort(groups.begin(), groups.end());
+
+    MutableArrayHandle<double> result = allocateArray<double>(
+        2 + resultSize(w) * groups.size());
+    result[0] = groups.size();
+    result[1] = w;
+
+    std::vector<double*> outResults(kBatchSize);
+    std::vector<const double*> batchStats(kBatchSize);
+    for (size_t begin = 0; begin < groups.size(); begin += kBatchSize) {
+        uint32_t batchSize = static_cast<uint32_t>(
+            std::min<size_t>(kBatchSize, groups.size() - begin));
+
+        for (uint32_t g = 0; g < batchSize; ++g) {
+            outResults[g] = result.ptr() + 2 + resultSize(w) * (begin + g);
+            batchStats[g] = state.group(groups[begin + g].second);
+        }
+
+        if (w <= kMaxBatchedWidth)
+            solveGroupBatch(&outResults[0], w, &batchStats[0], batchSize);
+        else
+            for (uint32_t g = 0; g < batchSize; ++g)
+                solveGroupWithPseudoInverse(outResults[g], w, batchStats[g]);
+    }
+
+    return result;
+}
+
+} // namespace regress
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,20 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file grouped_linear.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Grouped linear regression: Transition function
+ */
+DECLARE_UDF(regress, grouped_linregr_transition)
+
+/**
+ * @brief Grouped linear regression: State merge function
+ */
+DECLARE_UDF(regress, grouped_linregr_merge_states)
+
+/**
+ * @brief Grouped linear regression: Final function
+ */
+DECLARE_UDF(regress, grouped_linregr_final)
@@ -8,6 +8,7 @@
 
 #include <dbconnector/dbconnector.hpp>
 #include <modules/shared/HandleTraits.hpp>
+#include <modules/shared/SparseVectorOps.hpp>
 #include <modules/prob/prob.hpp>
 
 #include "linear.hpp"
@@ -178,6 +179,41 @@ linregr_transition::run(AnyType &args) {
     return state;
 }
 
+/**
+ * @brief Perform the linear-regression transition step (sparse rows)
+ *
+ * Same as linregr_transition, but the cost is only quadratic in the number of
+ * non-zero elements of the row.
+ */
+AnyType
+svec_linregr_transition::run(AnyType &args) {
+    LinRegrTransitionState<MutableArrayHandle<double> > state = args[0];
+    double y = args[1].getAs<double>();
+    SparseColumnVector x = args[2].getAs<SparseColumnVector>();
+    
+    if (!std::isfinite(y))
+        throw std::domain_error("Dependent variables are not finite.");
+    else if (!SparseVectorOps::isFinite(x))
+        throw std::domain_error("Design matrix is not finite.");
+    
+    if (state.numRows == 0) {
+        if (x.size() > std::numeric_limits<uint16_t>::max())
+            throw std::domain_error("Number of independent variables cannot be "
+                "larger than 65535.");
+        
+        state.initialize(*this, x.size());
+    } else if (x.size() != state.widthOfX)
+        throw std::invalid_argument("Independent variables have inconsistent "
+            "lengths.");
+    state.numRows++;
+    state.y_sum += y;
+    state.y_square_sum += y * y;
+    SparseVectorOps::addScaled(state.X_transp_Y, y, x);
+    SparseVectorOps::addScaledOuterProduct(state.X_transp_X, 1., x);
+    
+    return state;
+}
+
 /**
  * @brief Perform the perliminary aggregation function: Merge transition states
  */
@@ -198,12 +234,94 @@ linregr_merge_states::run(AnyType &args) {
     return stateLeft;
 }
 
+namespace {
+
+/**
+ * Condition number of \f$ X^T X \f$ up to which we trust the solution of the
+ * \f$ L D L^T \f$ decomposition. For larger (estimated) condition numbers, we
+ * compute the pseudo-inverse from the eigen decomposition instead.
+ */
+const double kConditionNoThreshold = 1000;
+
+/**
+ * Number of (inverse) power iterations for estimating the condition number
+ */
+const int kPowerIterations = 8;
+
+/**
+ * @brief Cheaply estimate the condition number of a symmetric positive
+ *     definite matrix, given its \f$ L D L^T \f$ decomposition
+ *
+ * We take the larger of two lower bounds: The ratio of the extreme pivots,
+ * and the ratio of the extreme eigenvalues as approximated by a few steps of
+ * power and inverse power iteration. Each step is only \f$ O(p^2) \f$.
+ *
+ * Only the lower triangular part of \c inMatrix is referenced.
+ */
+double
+estimateConditionNo(const Matrix &inMatrix, const Eigen::LDLT<Matrix> &inLDLT) {
+    ColumnVector d = inLDLT.vectorD();
+    if (!(d.minCoeff() > 0))
+        return std::numeric_limits<double>::infinity();
+    double estimate = d.maxCoeff() / d.minCoeff();
+
+    ColumnVector v = ColumnVector::Constant(inMatrix.rows(),
+        1. / std::sqrt(static_cast<double>(inMatrix.rows())));
+    ColumnVector w = v;
+    double largest = 0;
+    double inverseOfSmallest = 0;
+    for (int i = 0; i < kPowerIterations; ++i) {
+        ColumnVector Av = inMatrix.selfadjointView<Eigen::Lower>() * v;
+        ColumnVector invAw = inLDLT.solve(w);
+        largest = Av.norm();
+        inverseOfSmallest = invAw.norm();
+        if (largest == 0 || inverseOfSmallest == 0)
+            break;
+        v = Av / largest;
+        w = invAw / inverseOfSmallest;
+    }
+    return std::max(estimate, largest * inverseOfSmallest);
+}
+
+/**
+ * @brief Compute the diagonal of the inverse of a matrix, given its
+ *     \f$ L D L^T \f$ decomposition
+ *
+ * With \f$ A = P^T L D L^T P \f$, we have
+ * \f$ A^{-1} = B^T D^{-1} B \f$ where \f$ B = L^{-1} P \f$. Hence,
+ * \f$ (A^{-1})_{ii} = \sum_k B_{ki}^2 / d_k \f$, and there is no need to form
+ * \f$ A^{-1} \f$ or to multiply with it.
+ */
+ColumnVector
+inverseDiagonal(const Eigen::LDLT<Matrix> &inLDLT) {
+    Index p = inLDLT.matrixLDLT().rows();
+    Matrix identity = Matrix::Identity(p, p);
+    Matrix B = inLDLT.transpositionsP() * identity;
+    inLDLT.matrixL().solveInPlace(B);
+    ColumnVector d = inLDLT.vectorD();
+
+    ColumnVector result(p);
+    for (Index i = 0; i < p; ++i) {
+        double sum = 0;
+        for (Index k = 0; k < p; ++k)
+            sum += B(k, i) * B(k, i) / d(k);
+        result(i) = sum;
+    }
+    return result;
+}
+
+} // namespace
+
 /**
  * @brief Perform the linear-regression final step
  *
  * The result of the aggregation phase is \f$ X^T X \f$ and
- * \f$ X^T \boldsymbol y \f$. We first compute the pseudo-inverse, then the
- * regression coefficients, the model statistics, etc.
+ * \f$ X^T \boldsymbol y \f$. We first try to solve for the regression
+ * coefficients with an \f$ L D L^T \f$ decomposition, which also gives the
+ * diagonal of \f$ (X^T X)^{-1} \f$ (all that the standard errors need) and a
+ * cheap estimate of the condition number. Only if \f$ X^T X \f$ is
+ * ill-conditioned, we compute the pseudo-inverse from the eigen decomposition.
+ * We then compute the model statistics, etc.
  * 
  * @sa For the mathematical description, see \ref grp_linreg.
  */
@@ -223,16 +341,32 @@ linregr_final::run(AnyType &args) {
     if (!isfinite(state.X_transp_X) || !isfinite(state.X_transp_Y))
         throw std::domain_error("Design matrix is not finite.");
     
-    SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
-        state.X_transp_X, EigenvaluesOnly, ComputePseudoInverse);
-    
-    // Precompute (X^T * X)^+
-    Matrix inverse_of_X_transp_X = decomposition.pseudoInverse();
-
     // Vector of coefficients: For efficiency reasons, we want to return this
     // by reference, so we need to bind to db memory
     HandleMap<ColumnVector> coef(allocateArray<double>(state.widthOfX));
-    coef.noalias() = inverse_of_X_transp_X * state.X_transp_Y;
+    
+    // Diagonal of (X^T * X)^+
+    ColumnVector diagonalOfInverse;
+    double conditionNo;
+    
+    // Only the lower triangular part of X^T X is filled, which is exactly
+    // what LDLT reads
+    Matrix X_transp_X = state.X_transp_X;
+    Eigen::LDLT<Matrix> ldlt(X_transp_X);
+    conditionNo = estimateConditionNo(X_transp_X, ldlt);
+    if (conditionNo < kConditionNoThreshold) {
+        coef = ldlt.solve(state.X_transp_Y);
+        diagonalOfInverse = inverseDiagonal(ldlt);
+    } else {
+        SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
+            X_transp_X, EigenvaluesOnly, ComputePseudoInverse,
+            kConditionNoThreshold);
+        
+        const Matrix &inverse_of_X_transp_X = decomposition.pseudoInverse();
+        coef.noalias() = inverse_of_X_transp_X * state.X_transp_Y;
+        diagonalOfInverse = inverse_of_X_transp_X.diagonal();
+        conditionNo = decomposition.conditionNo();
+    }
     
     // explained sum of squares (regression sum of squares)
     double ess
@@ -279,10 +413,10 @@ linregr_final::run(AnyType &args) {
         // In an abundance of caution, we see a tiny possibility that numerical
         // instabilities in the pinv operation can lead to negative values on
         // the main diagonal of even a SPD matrix
-        if (inverse_of_X_transp_X(i,i) < 0) {
+        if (diagonalOfInverse(i) < 0) {
             stdErr(i) = 0;
         } else {
-            stdErr(i) = std::sqrt( variance * inverse_of_X_transp_X(i,i) );
+            stdErr(i) = std::sqrt( variance * diagonalOfInverse(i) );
         }
         
         if (coef(i) == 0 && stdErr(i) == 0) {
@@ -308,7 +442,7 @@ linregr_final::run(AnyType &args) {
     // Return all coefficients, standard errors, etc. in a tuple
     AnyType tuple;
     tuple << coef << r2 << stdErr << tStats << pValues
-        << decomposition.conditionNo();
+        << conditionNo;
     return tuple;
 }
 
@@ -9,6 +9,11 @@
  */
 DECLARE_UDF(regress, linregr_transition)
 
+/**
+ * @brief Linear regression: Transition function for sparse rows
+ */
+DECLARE_UDF(regress, svec_linregr_transition)
+
 /**
  * @brief Linear regression: State merge function
  */
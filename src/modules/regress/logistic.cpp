@@ -11,6 +11,7 @@
 
 #include <dbconnector/dbconnector.hpp>
 #include <modules/shared/HandleTraits.hpp>
+#include <modules/shared/SparseVectorOps.hpp>
 #include <modules/prob/prob.hpp>
 
 #include "logistic.hpp"
@@ -228,6 +229,45 @@ logregr_cg_step_transition::run(AnyType &args) {
     return state;
 }
 
+/**
+ * @brief Perform the logistic-regression transition step (sparse rows)
+ *
+ * Same as logregr_cg_step_transition, but the gradient is only updated at the
+ * non-zero positions of the row, and \f$ X^T A X \f$ by a sparse outer product.
+ */
+AnyType
+svec_logregr_cg_step_transition::run(AnyType &args) {
+    LogRegrCGTransitionState<MutableArrayHandle<double> > state = args[0];
+    double y = args[1].getAs<bool>() ? 1. : -1.;
+    SparseColumnVector x = args[2].getAs<SparseColumnVector>();
+    
+    if (!SparseVectorOps::isFinite(x))
+        throw std::domain_error("Design matrix is not finite.");
+    
+    if (state.numRows == 0) {
+        state.initialize(*this, x.size());
+        if (!args[3].isNull()) {
+            LogRegrCGTransitionState<ArrayHandle<double> > previousState = args[3];
+            
+            state = previousState;
+            state.reset();
+        }
+    } else if (x.size() != state.widthOfX)
+        throw std::invalid_argument("Independent variables have inconsistent "
+            "lengths.");
+    
+    state.numRows++;
+    double xc = SparseVectorOps::dot(x, state.coef);
+    SparseVectorOps::addScaled(state.gradNew, sigma(-y * xc) * y, x);
+    
+    double a = sigma(xc) * sigma(-xc);
+    SparseVectorOps::addScaledOuterProduct(state.X_transp_AX, a, x);
+
+    state.logLikelihood -= std::log( 1. + std::exp(-y * xc) );
+    
+    return state;
+}
+
 /**
  * @brief Perform the perliminary aggregation function: Merge transition states
  */
@@ -527,6 +567,45 @@ logregr_irls_step_transition::run(AnyType &args) {
     return state;
 }
 
+/**
+ * @brief Perform the logistic-regression transition step (sparse rows)
+ *
+ * Same as logregr_irls_step_transition, but the cost is only quadratic in the
+ * number of non-zero elements of the row.
+ */
+AnyType
+svec_logregr_irls_step_transition::run(AnyType &args) {
+    LogRegrIRLSTransitionState<MutableArrayHandle<double> > state = args[0];
+    double y = args[1].getAs<bool>() ? 1. : -1.;
+    SparseColumnVector x = args[2].getAs<SparseColumnVector>();
+
+    if (!SparseVectorOps::isFinite(x))
+        throw std::domain_error("Design matrix is not finite.");
+
+    if (state.numRows == 0) {
+        state.initialize(*this, x.size());
+        if (!args[3].isNull()) {
+            LogRegrIRLSTransitionState<ArrayHandle<double> > previousState = args[3];
+            
+            state = previousState;
+            state.reset();
+        }
+    } else if (x.size() != state.widthOfX)
+        throw std::invalid_argument("Independent variables have inconsistent "
+            "lengths.");
+    
+    state.numRows++;
+    double xc = SparseVectorOps::dot(x, state.coef);
+    double a = sigma(xc) * sigma(-xc);
+    double az = xc * a + sigma(-y * xc) * y;
+
+    SparseVectorOps::addScaled(state.X_transp_Az, az, x);
+    SparseVectorOps::addScaledOuterProduct(state.X_transp_AX, a, x);
+        
+    state.logLikelihood -= std::log( 1. + std::exp(-y * xc) );
+    return state;
+}
+
 /**
  * @brief Perform the perliminary aggregation function: Merge transition states
  */
@@ -611,6 +690,447 @@ internal_logregr_irls_result::run(AnyType &args) {
         state.X_transp_Az, state.logLikelihood, state.X_transp_AX(0,0));
 }
 
+/**
+ * @brief Inter- and intra-iteration state for iteratively-reweighted-least-
+ *        squares method with reuse of the Hessian factorization
+ *
+ * In addition to what LogRegrIRLSTransitionState keeps, the state carries
+ * from iteration to iteration the Hessian \f$ X^T A X \f$ at the time of the
+ * last factorization and its pseudo-inverse. The final function uses the
+ * latter as preconditioner for a conjugate-gradient solve of the Newton
+ * system, and only computes a new factorization if \f$ X^T A X \f$ has changed
+ * too much.
+ *
+ * In diagonal-only mode, only the diagonal of \f$ X^T A X \f$ and a diagonal
+ * upper bound of \f$ X^T A X \f$ are kept, so that the cost per row is linear
+ * in the number of independent variables.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length at least 6, and all elemenets are 0.
+ */
+template <class Handle>
+class LogRegrWIRLSTransitionState {
+    template <class OtherHandle>
+    friend class LogRegrWIRLSTransitionState;
+
+public:
+    LogRegrWIRLSTransitionState(const AnyType &inArray)
+        : mStorage(inArray.getAs<Handle>()) {
+        
+        rebind(static_cast<uint16_t>(mStorage[0]), mStorage[1] != 0);
+    }
+    
+    /**
+     * @brief Convert to backend representation
+     *
+     * We define this function so that we can use State in the
+     * argument list and as a return type.
+     */
+    inline operator AnyType() const {
+        return mStorage;
+    }
+    
+    /**
+     * @brief Initialize the state.
+     * 
+     * This function is only called for the first row of each iteration.
+     */
+    inline void initialize(const Allocator &inAllocator, uint16_t inWidthOfX,
+        bool inDiagonalOnly) {
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inWidthOfX, inDiagonalOnly));
+        rebind(inWidthOfX, inDiagonalOnly);
+        widthOfX = inWidthOfX;
+        diagonalOnly = inDiagonalOnly;
+    }
+    
+    /**
+     * @brief We need to support assigning the previous state
+     */
+    template <class OtherHandle>
+    LogRegrWIRLSTransitionState &operator=(
+        const LogRegrWIRLSTransitionState<OtherHandle> &inOtherState) {
+        
+        for (size_t i = 0; i < mStorage.size(); i++)
+            mStorage[i] = inOtherState.mStorage[i];
+        return *this;
+    }
+    
+    /**
+     * @brief Merge with another State object by copying the intra-iteration
+     *     fields
+     */
+    template <class OtherHandle>
+    LogRegrWIRLSTransitionState &operator+=(
+        const LogRegrWIRLSTransitionState<OtherHandle> &inOtherState) {
+        
+        if (mStorage.size() != inOtherState.mStorage.size() ||
+            widthOfX != inOtherState.widthOfX)
+            throw std::logic_error("Internal error: Incompatible transition "
+                "states");
+        
+        numRows += inOtherState.numRows;
+        logLikelihood += inOtherState.logLikelihood;
+        grad += inOtherState.grad;
+        if (diagonalOnly) {
+            X_transp_AX_diagonal += inOtherState.X_transp_AX_diagonal;
+            X_transp_AX_bound += inOtherState.X_transp_AX_bound;
+        } else
+            X_transp_AX += inOtherState.X_transp_AX;
+        return *this;
+    }
+        
+    /**
+     * @brief Reset the intra-iteration fields.
+     */
+    inline void reset() {
+        numRows = 0;
+        logLikelihood = 0;
+        grad.fill(0);
+        if (diagonalOnly) {
+            X_transp_AX_diagonal.fill(0);
+            X_transp_AX_bound.fill(0);
+        } else
+            X_transp_AX.fill(0);
+    }
+    
+private:
+    static inline uint64_t arraySize(const uint16_t inWidthOfX,
+        bool inDiagonalOnly) {
+
+        uint64_t p = inWidthOfX;
+        return inDiagonalOnly ? 6 + 4 * p : 6 + 2 * p + 3 * p * p;
+    }
+    
+    /**
+     * @brief Rebind to a new storage array
+     *
+     * @param inWidthOfX The number of independent variables.
+     * @param inDiagonalOnly Whether only the diagonal of X^T A X is kept
+     *
+     * Array layout (iteration refers to one aggregate-function call):
+     * Inter-iteration components (updated in final function):
+     * - 0: widthOfX (number of coefficients)
+     * - 1: diagonalOnly (whether only the diagonal of X^T A X is kept)
+     * - 2: numFactorizations (number of factorizations of X^T A X so far)
+     * - 3: coef (vector of coefficients)
+     *
+     * Intra-iteration components (updated in transition step):
+     * - 3 + widthOfX: numRows (number of rows already processed in this
+     *   iteration)
+     * - 4 + widthOfX: logLikelihood ( ln(l(c)) )
+     * - 5 + widthOfX: grad (gradient of the log-likelihood)
+     * - 5 + 2 * widthOfX: X_transp_AX_diagonal (diagonal of X^T A X), if
+     *   diagonalOnly. Otherwise, X_transp_AX (X^T A X)
+     * - 5 + 3 * widthOfX: X_transp_AX_bound (diagonal matrix D with
+     *   D >= X^T A X in the Loewner order), only if diagonalOnly
+     *
+     * Inter-iteration components (only if not diagonalOnly):
+     * - 5 + 2 * widthOfX + widthOfX^2: factoredHessian (X^T A X at the time
+     *   of the last factorization)
+     * - 5 + 2 * widthOfX + 2 * widthOfX^2: preconditioner (pseudo-inverse of
+     *   factoredHessian)
+     */
+    void rebind(uint16_t inWidthOfX, bool inDiagonalOnly) {
+        size_t p = inWidthOfX;
+
+        widthOfX.rebind(&mStorage[0]);
+        diagonalOnly.rebind(&mStorage[1]);
+        numFactorizations.rebind(&mStorage[2]);
+        coef.rebind(&mStorage[3], p);
+        numRows.rebind(&mStorage[3 + p]);
+        logLikelihood.rebind(&mStorage[4 + p]);
+        grad.rebind(&mStorage[5 + p], p);
+        if (inDiagonalOnly) {
+            X_transp_AX_diagonal.rebind(&mStorage[5 + 2 * p], p);
+            X_transp_AX_bound.rebind(&mStorage[5 + 3 * p], p);
+        } else {
+            X_transp_AX.rebind(&mStorage[5 + 2 * p], p, p);
+            factoredHessian.rebind(&mStorage[5 + 2 * p + p * p], p, p);
+            preconditioner.rebind(&mStorage[5 + 2 * p + 2 * p * p], p, p);
+        }
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt16 widthOfX;
+    typename HandleTraits<Handle>::ReferenceToBool diagonalOnly;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numFactorizations;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap coef;
+
+    typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+    typename HandleTraits<Handle>::ReferenceToDouble logLikelihood;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap grad;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap
+        X_transp_AX_diagonal;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap
+        X_transp_AX_bound;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap X_transp_AX;
+
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap factoredHessian;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap preconditioner;
+};
+
+/**
+ * @brief Perform the transition step of the IRLS method with reuse of the
+ *     Hessian factorization
+ *
+ * Arguments are the dependent and independent variables, the previous state,
+ * and (only used in the first iteration) whether to only keep the diagonal of
+ * \f$ X^T A X \f$.
+ */
+AnyType
+logregr_wirls_step_transition::run(AnyType &args) {
+    LogRegrWIRLSTransitionState<MutableArrayHandle<double> > state = args[0];
+    double y = args[1].getAs<bool>() ? 1. : -1.;
+    HandleMap<const ColumnVector> x = args[2].getAs<ArrayHandle<double> >();
+
+    if (!x.is_finite())
+        throw std::domain_error("Design matrix is not finite.");
+
+    if (state.numRows == 0) {
+        if (x.size() > std::numeric_limits<uint16_t>::max())
+            throw std::domain_error("Number of independent variables cannot be "
+                "larger than 65535.");
+
+        if (args[3].isNull()) {
+            state.initialize(*this, x.size(), args[4].getAs<bool>());
+        } else {
+            LogRegrWIRLSTransitionState<ArrayHandle<double> > previousState
+                = args[3];
+            
+            state.initialize(*this, x.size(), previousState.diagonalOnly);
+            state = previousState;
+            state.reset();
+        }
+    } else if (x.size() != state.widthOfX)
+        throw std::invalid_argument("Independent variables have inconsistent "
+            "lengths.");
+    
+    // Now do the transition step
+    state.numRows++;
+
+    // xc = x^T_i c
+    double xc = dot(x, state.coef);
+        
+    // a_i = sigma(x_i c) sigma(-x_i c)
+    double a = sigma(xc) * sigma(-xc);
+
+    state.grad.noalias() += sigma(-y * xc) * y * x;
+    if (state.diagonalOnly) {
+        state.X_transp_AX_diagonal += a * x.cwiseProduct(x);
+        // By Gershgorin's theorem, a x x^T <= a diag(|x_j| ||x||_1)
+        state.X_transp_AX_bound += (a * x.cwiseAbs().sum()) * x.cwiseAbs();
+    } else
+        triangularView<Lower>(state.X_transp_AX) += x * trans(x) * a;
+        
+    state.logLikelihood -= std::log( 1. + std::exp(-y * xc) );
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+logregr_wirls_step_merge_states::run(AnyType &args) {
+    LogRegrWIRLSTransitionState<MutableArrayHandle<double> > stateLeft
+        = args[0];
+    LogRegrWIRLSTransitionState<ArrayHandle<double> > stateRight = args[1];
+    
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.numRows == 0)
+        return stateRight;
+    else if (stateRight.numRows == 0)
+        return stateLeft;
+    
+    // Merge states together and return
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+namespace {
+
+/**
+ * Relative change (in the Frobenius norm of the lower triangular part) of
+ * \f$ X^T A X \f$ since the last factorization, above which we factorize anew
+ */
+const double kRefactorizationThreshold = 0.1;
+
+/**
+ * Maximum number of preconditioned conjugate-gradient iterations before we
+ * give up and factorize anew
+ */
+const int kMaxCGIterations = 20;
+
+/**
+ * Relative residual norm at which the conjugate-gradient solve is considered
+ * converged
+ */
+const double kCGTolerance = 1e-10;
+
+} // namespace
+
+/**
+ * @brief Perform the final step of the IRLS method with reuse of the Hessian
+ *     factorization
+ *
+ * We take the Newton step \f$ \boldsymbol c \gets \boldsymbol c + \boldsymbol s
+ * \f$ where \f$ X^T A X \boldsymbol s = \nabla l(\boldsymbol c) \f$:
+ * - In diagonal-only mode, we replace \f$ X^T A X \f$ by a diagonal upper
+ *   bound \f$ D \f$ with \f$ D_{jj} = \sum_i a_i |x_{ij}| \, \| \boldsymbol
+ *   x_i \|_1 \f$. The plain diagonal would overshoot if the independent
+ *   variables are correlated, and the iteration would diverge.
+ * - If \f$ X^T A X \f$ is close to the matrix \f$ H \f$ of the last
+ *   factorization, we solve with the conjugate-gradient method, preconditioned
+ *   with \f$ H^+ \f$ and started from \f$ H^+ \nabla l(\boldsymbol c) \f$.
+ *   Each conjugate-gradient iteration costs \f$ O(p^2) \f$.
+ * - Otherwise, or if the conjugate-gradient method does not converge quickly,
+ *   we compute the pseudo-inverse of \f$ X^T A X \f$, in \f$ O(p^3) \f$, and
+ *   keep it for the next iterations.
+ */
+AnyType
+logregr_wirls_step_final::run(AnyType &args) {
+    // We request a mutable object. Depending on the backend, this might perform
+    // a deep copy.
+    LogRegrWIRLSTransitionState<MutableArrayHandle<double> > state = args[0];
+
+    // Aggregates that haven't seen any data just return Null.
+    if (state.numRows == 0)
+        return Null();
+
+    if (!state.grad.is_finite())
+        throw NoSolutionFoundException("Over- or underflow in intermediate "
+            "calulation. Input data is likely of poor numerical condition.");
+
+    if (state.diagonalOnly) {
+        if (!state.X_transp_AX_diagonal.is_finite()
+            || !state.X_transp_AX_bound.is_finite())
+            throw NoSolutionFoundException("Over- or underflow in intermediate "
+                "calulation. Input data is likely of poor numerical "
+                "condition.");
+
+        for (Index i = 0; i < state.coef.size(); ++i)
+            if (state.X_transp_AX_bound(i) > 0)
+                state.coef(i) += state.grad(i) / state.X_transp_AX_bound(i);
+    } else {
+        // See MADLIB-138
+        if (!state.X_transp_AX.is_finite())
+            throw NoSolutionFoundException("Over- or underflow in intermediate "
+                "calulation. Input data is likely of poor numerical "
+                "condition.");
+
+        const Index p = state.widthOfX;
+        ColumnVector step(p);
+        bool refactorize = (state.numFactorizations == 0);
+
+        if (!refactorize) {
+            double changeNormSq = 0;
+            double normSq = 0;
+            for (Index j = 0; j < p; ++j)
+                for (Index i = j; i < p; ++i) {
+                    double diff = state.X_transp_AX(i,j)
+                        - state.factoredHessian(i,j);
+                    changeNormSq += diff * diff;
+                    normSq += state.factoredHessian(i,j)
+                        * state.factoredHessian(i,j);
+                }
+            refactorize = !(changeNormSq <= kRefactorizationThreshold
+                * kRefactorizationThreshold * normSq);
+        }
+
+        if (!refactorize) {
+            // Preconditioned conjugate gradient for X^T A X s = grad
+            step = state.preconditioner * state.grad;
+            ColumnVector residual = state.grad
+                - state.X_transp_AX.selfadjointView<Eigen::Lower>() * step;
+            ColumnVector z = state.preconditioner * residual;
+            ColumnVector dir = z;
+            double rz = dot(residual, z);
+            double tolerance = kCGTolerance * state.grad.norm();
+
+            bool converged = residual.norm() <= tolerance;
+            for (int k = 0; k < kMaxCGIterations && !converged; ++k) {
+                ColumnVector Ad
+                    = state.X_transp_AX.selfadjointView<Eigen::Lower>() * dir;
+                double dAd = dot(dir, Ad);
+                if (!(dAd > 0))
+                    break;
+                double alpha = rz / dAd;
+                step += alpha * dir;
+                residual -= alpha * Ad;
+                converged = residual.norm() <= tolerance;
+                z = state.preconditioner * residual;
+                double rzNew = dot(residual, z);
+                dir = z + (rzNew / rz) * dir;
+                rz = rzNew;
+            }
+            refactorize = !converged;
+        }
+
+        if (refactorize) {
+            SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
+                state.X_transp_AX, EigenvaluesOnly, ComputePseudoInverse);
+            
+            state.preconditioner = decomposition.pseudoInverse();
+            state.factoredHessian = state.X_transp_AX;
+            state.numFactorizations++;
+            step = state.preconditioner * state.grad;
+        }
+        state.coef += step;
+    }
+
+    if(!state.coef.is_finite())
+        throw NoSolutionFoundException("Over- or underflow in Newton step, "
+            "while updating coefficients. Input data is likely of poor "
+            "numerical condition.");
+    
+    return state;
+}
+
+/**
+ * @brief Return the difference in log-likelihood between two states
+ */
+AnyType
+internal_logregr_wirls_step_distance::run(AnyType &args) {
+    LogRegrWIRLSTransitionState<ArrayHandle<double> > stateLeft = args[0];
+    LogRegrWIRLSTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    return std::abs(stateLeft.logLikelihood - stateRight.logLikelihood);
+}
+
+/**
+ * @brief Return the coefficients and diagnostic statistics of the state
+ *
+ * Unlike during the iterations, we factorize \f$ X^T A X \f$ here, once. In
+ * diagonal-only mode, standard errors and condition number are computed from
+ * the diagonal of \f$ X^T A X \f$ and are therefore only approximations.
+ */
+AnyType
+internal_logregr_wirls_result::run(AnyType &args) {
+    LogRegrWIRLSTransitionState<ArrayHandle<double> > state = args[0];
+
+    if (state.diagonalOnly) {
+        ColumnVector inverseDiagonal(state.widthOfX);
+        for (Index i = 0; i < inverseDiagonal.size(); ++i)
+            inverseDiagonal(i) = 1. / state.X_transp_AX_diagonal(i);
+
+        return stateToResult(*this, state.coef, inverseDiagonal,
+            state.logLikelihood, state.X_transp_AX_diagonal.maxCoeff()
+                / state.X_transp_AX_diagonal.minCoeff());
+    }
+
+    SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
+        state.X_transp_AX, EigenvaluesOnly, ComputePseudoInverse);
+    
+    return stateToResult(*this, state.coef,
+        decomposition.pseudoInverse().diagonal(), state.logLikelihood,
+        decomposition.conditionNo());
+}
+
 /**
  * @brief Inter- and intra-iteration state for incremental gradient
  *        method for logistic regression
@@ -799,6 +1319,53 @@ logregr_igd_step_transition::run(AnyType &args) {
     return state;
 }
 
+/**
+ * @brief Perform the logistic-regression transition step (sparse rows)
+ *
+ * Same as logregr_igd_step_transition, but the gradient step only touches the
+ * coefficients at the non-zero positions of the row.
+ */
+AnyType
+svec_logregr_igd_step_transition::run(AnyType &args) {
+    LogRegrIGDTransitionState<MutableArrayHandle<double> > state = args[0];
+    double y = args[1].getAs<bool>() ? 1. : -1.;
+    SparseColumnVector x = args[2].getAs<SparseColumnVector>();
+
+    if (!SparseVectorOps::isFinite(x))
+        throw std::domain_error("Design matrix is not finite.");
+
+    if (state.numRows == 0) {
+        state.initialize(*this, x.size());
+
+        if (!args[3].isNull()) {
+            LogRegrIGDTransitionState<ArrayHandle<double> > previousState = args[3];
+            
+            state = previousState;
+            state.reset();
+        }
+    } else if (x.size() != state.widthOfX)
+        throw std::invalid_argument("Independent variables have inconsistent "
+            "lengths.");
+    
+    state.numRows++;
+    double xc = SparseVectorOps::dot(x, state.coef);
+    double scale = state.stepsize * sigma(-xc * y) * y;
+    SparseVectorOps::addScaled(state.coef, scale, x);
+
+    // Note: previous coefficients are used for Hessian and log likelihood
+    if (!args[3].isNull()) {
+        LogRegrIGDTransitionState<ArrayHandle<double> > previousState = args[3];
+        
+        double previous_xc = SparseVectorOps::dot(x, previousState.coef);
+        double a = sigma(previous_xc) * sigma(-previous_xc);
+        SparseVectorOps::addScaledOuterProduct(state.X_transp_AX, a, x);
+        
+        state.logLikelihood -= std::log( 1. + std::exp(-y * previous_xc) );
+    }
+
+    return state;
+}
+
 /**
  * @brief Perform the perliminary aggregation function: Merge transition states
  */
@@ -867,6 +1434,394 @@ internal_logregr_igd_result::run(AnyType &args) {
         decomposition.conditionNo());
 }
 
+/**
+ * @brief Inter- and intra-iteration state for mini-batch incremental gradient
+ *        method for logistic regression
+ *
+ * TransitionState encapsualtes the transition state during the
+ * aggregate function during an iteration. To the database, the state is
+ * exposed as a single DOUBLE PRECISION array, to the C++ code it is a proper
+ * object containing scalars and vectors.
+ *
+ * Compared to LogRegrIGDTransitionState, the gradient is accumulated over
+ * batches of rows before the coefficients are updated, the step size follows
+ * the schedule \f$ \eta_k = \eta_0 / (1 + \delta k) \f$ (where \f$ k \f$ is
+ * the iteration), and \f$ X^T A X \f$ is only stored and computed if requested.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length at least 10, and at least first element is 0
+ * (exact values of other elements are ignored).
+ */
+template <class Handle>
+class LogRegrMIGDTransitionState {
+    template <class OtherHandle>
+    friend class LogRegrMIGDTransitionState;
+
+public:
+    LogRegrMIGDTransitionState(const AnyType &inArray)
+        : mStorage(inArray.getAs<Handle>()) {
+        
+        rebind(static_cast<uint16_t>(mStorage[0]), mStorage[5] != 0);
+    }
+    
+    /**
+     * @brief Convert to backend representation
+     *
+     * We define this function so that we can use State in the
+     * argument list and as a return type.
+     */
+    inline operator AnyType() const {
+        return mStorage;
+    }
+    
+    /**
+     * @brief Initialize the mini-batch incremental-gradient state.
+     * 
+     * This function is only called for the first row of each iteration.
+     */
+    inline void initialize(const Allocator &inAllocator, uint16_t inWidthOfX,
+        bool inComputeHessian) {
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inWidthOfX, inComputeHessian));
+        rebind(inWidthOfX, inComputeHessian);
+        widthOfX = inWidthOfX;
+        computeHessian = inComputeHessian;
+    }
+    
+    /**
+     * @brief We need to support assigning the previous state
+     */
+    template <class OtherHandle>
+    LogRegrMIGDTransitionState &operator=(
+        const LogRegrMIGDTransitionState<OtherHandle> &inOtherState) {
+        
+        for (size_t i = 0; i < mStorage.size(); i++)
+            mStorage[i] = inOtherState.mStorage[i];
+        return *this;
+    }
+    
+    /**
+     * @brief Merge with another State object
+     *
+     * The models of both states (including the updates of their partial
+     * batches) are averaged, weighted by the number of rows that each state
+     * has seen.
+     */
+    template <class OtherHandle>
+    LogRegrMIGDTransitionState &operator+=(
+        const LogRegrMIGDTransitionState<OtherHandle> &inOtherState) {
+
+        if (mStorage.size() != inOtherState.mStorage.size() ||
+            widthOfX != inOtherState.widthOfX)
+            throw std::logic_error("Internal error: Incompatible transition "
+                "states");
+        
+        flushBatch();
+        double totalNumRows = numRows + inOtherState.numRows;
+        coef = double(numRows) / totalNumRows * coef
+            + double(inOtherState.numRows) / totalNumRows
+                * inOtherState.flushedCoef();
+
+        numRows += inOtherState.numRows;
+        logLikelihood += inOtherState.logLikelihood;
+        grad += inOtherState.grad;
+        if (computeHessian)
+            X_transp_AX += inOtherState.X_transp_AX;
+        return *this;
+    }
+    
+    /**
+     * @brief Reset the intra-iteration fields and advance the step-size
+     *     schedule
+     */
+    inline void reset() {
+        iteration++;
+        numRows = 0;
+        numBatchRows = 0;
+        logLikelihood = 0;
+        batchGrad.fill(0);
+        grad.fill(0);
+        if (computeHessian)
+            X_transp_AX.fill(0);
+    }
+
+    /**
+     * @brief Step size of the current iteration
+     */
+    inline double stepsize() const {
+        return initialStepsize / (1. + stepsizeDecay * iteration);
+    }
+
+    /**
+     * @brief Update the coefficients with the gradient of the current
+     *     (possibly partial) batch
+     *
+     * We use the average gradient of the rows in the batch, so that the step
+     * size is independent of the batch size.
+     */
+    inline void flushBatch() {
+        if (numBatchRows == 0)
+            return;
+
+        coef += stepsize() / static_cast<double>(numBatchRows) * batchGrad;
+        batchGrad.fill(0);
+        numBatchRows = 0;
+    }
+
+    /**
+     * @brief Return the coefficients as if the current batch had been flushed
+     */
+    inline ColumnVector flushedCoef() const {
+        ColumnVector result = coef;
+        if (numBatchRows > 0)
+            result += stepsize() / static_cast<double>(numBatchRows)
+                * batchGrad;
+        return result;
+    }
+    
+private:
+    static inline uint32_t arraySize(const uint16_t inWidthOfX,
+        bool inComputeHessian) {
+
+        return 9 + 3 * inWidthOfX
+            + (inComputeHessian ? inWidthOfX * inWidthOfX : 0);
+    }
+
+    /**
+     * @brief Rebind to a new storage array
+     *
+     * @param inWidthOfX The number of independent variables.
+     * @param inComputeHessian Whether the state contains \f$ X^T A X \f$
+     *
+     * Array layout (iteration refers to one aggregate-function call):
+     * Inter-iteration components (updated in final function):
+     * - 0: widthOfX (number of coefficients)
+     * - 1: batchSize (number of rows per gradient step)
+     * - 2: initialStepsize (step size of the first iteration)
+     * - 3: stepsizeDecay (decay of the step size per iteration)
+     * - 4: iteration (number of the current iteration, starting at 0)
+     * - 5: computeHessian (whether to compute X^T A X)
+     * - 6: coef (vector of coefficients)
+     *
+     * Intra-iteration components (updated in transition step):
+     * - 6 + widthOfX: numRows (number of rows already processed in this
+     *   iteration)
+     * - 7 + widthOfX: numBatchRows (number of rows in the current batch)
+     * - 8 + widthOfX: logLikelihood ( ln(l(c)) )
+     * - 9 + widthOfX: batchGrad (gradient of the current batch)
+     * - 9 + 2 * widthOfX: grad (gradient at the coefficients of the previous
+     *   iteration)
+     * - 9 + 3 * widthOfX: X_transp_AX (X^T A X, only if computeHessian)
+     *
+     * Note: Log-likelihood, gradient, and X^T A X all refer to the
+     * coefficients of the previous iteration.
+     */
+    void rebind(uint16_t inWidthOfX, bool inComputeHessian) {
+        widthOfX.rebind(&mStorage[0]);
+        batchSize.rebind(&mStorage[1]);
+        initialStepsize.rebind(&mStorage[2]);
+        stepsizeDecay.rebind(&mStorage[3]);
+        iteration.rebind(&mStorage[4]);
+        computeHessian.rebind(&mStorage[5]);
+        coef.rebind(&mStorage[6], inWidthOfX);
+        numRows.rebind(&mStorage[6 + inWidthOfX]);
+        numBatchRows.rebind(&mStorage[7 + inWidthOfX]);
+        logLikelihood.rebind(&mStorage[8 + inWidthOfX]);
+        batchGrad.rebind(&mStorage[9 + inWidthOfX], inWidthOfX);
+        grad.rebind(&mStorage[9 + 2 * inWidthOfX], inWidthOfX);
+        if (inComputeHessian)
+            X_transp_AX.rebind(&mStorage[9 + 3 * inWidthOfX], inWidthOfX,
+                inWidthOfX);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt16 widthOfX;
+    typename HandleTraits<Handle>::ReferenceToUInt32 batchSize;
+    typename HandleTraits<Handle>::ReferenceToDouble initialStepsize;
+    typename HandleTraits<Handle>::ReferenceToDouble stepsizeDecay;
+    typename HandleTraits<Handle>::ReferenceToUInt32 iteration;
+    typename HandleTraits<Handle>::ReferenceToBool computeHessian;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap coef;
+
+    typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numBatchRows;
+    typename HandleTraits<Handle>::ReferenceToDouble logLikelihood;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap batchGrad;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap grad;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap X_transp_AX;
+};
+
+/**
+ * @brief Perform the mini-batch incremental-gradient transition step
+ *
+ * Arguments are the dependent and independent variables, the previous state,
+ * and (only used in the first iteration) the batch size, the initial step size,
+ * the step-size decay, and whether to compute \f$ X^T A X \f$.
+ *
+ * Without \f$ X^T A X \f$, the cost per row is linear in the number of
+ * independent variables.
+ */
+AnyType
+logregr_migd_step_transition::run(AnyType &args) {
+    LogRegrMIGDTransitionState<MutableArrayHandle<double> > state = args[0];
+    double y = args[1].getAs<bool>() ? 1. : -1.;
+    HandleMap<const ColumnVector> x = args[2].getAs<ArrayHandle<double> >();
+
+    if (!x.is_finite())
+        throw std::domain_error("Design matrix is not finite.");
+
+    if (state.numRows == 0) {
+        if (args[3].isNull()) {
+            int32_t batchSize = args[4].getAs<int32_t>();
+            double stepsize = args[5].getAs<double>();
+            double stepsizeDecay = args[6].getAs<double>();
+
+            if (batchSize < 1)
+                throw std::domain_error("Batch size must be positive.");
+            if (!(stepsize > 0))
+                throw std::domain_error("Step size must be positive.");
+            if (!(stepsizeDecay >= 0))
+                throw std::domain_error("Step-size decay must not be "
+                    "negative.");
+
+            state.initialize(*this, x.size(), args[7].getAs<bool>());
+            state.batchSize = batchSize;
+            state.initialStepsize = stepsize;
+            state.stepsizeDecay = stepsizeDecay;
+        } else {
+            LogRegrMIGDTransitionState<ArrayHandle<double> > previousState
+                = args[3];
+
+            state.initialize(*this, x.size(), previousState.computeHessian);
+            state = previousState;
+            state.reset();
+        }
+    } else if (x.size() != state.widthOfX)
+        throw std::invalid_argument("Independent variables have inconsistent "
+            "lengths.");
+    
+    state.numRows++;
+
+    // Gradient step with the current coefficients, once per batch
+    double xc = dot(x, state.coef);
+    state.batchGrad.noalias() += sigma(-y * xc) * y * x;
+    state.numBatchRows++;
+    if (state.numBatchRows >= state.batchSize)
+        state.flushBatch();
+
+    // Statistics for the coefficients of the previous iteration. In the first
+    // iteration, these are all 0.
+    double previous_xc = 0;
+    if (!args[3].isNull()) {
+        LogRegrMIGDTransitionState<ArrayHandle<double> > previousState
+            = args[3];
+        previous_xc = dot(x, previousState.coef);
+    }
+    state.grad.noalias() += sigma(-y * previous_xc) * y * x;
+    state.logLikelihood -= std::log( 1. + std::exp(-y * previous_xc) );
+    if (state.computeHessian) {
+        // a_i = sigma(x_i c) sigma(-x_i c)
+        double a = sigma(previous_xc) * sigma(-previous_xc);
+        triangularView<Lower>(state.X_transp_AX) += x * trans(x) * a;
+    }
+
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+logregr_migd_step_merge_states::run(AnyType &args) {
+    LogRegrMIGDTransitionState<MutableArrayHandle<double> > stateLeft = args[0];
+    LogRegrMIGDTransitionState<ArrayHandle<double> > stateRight = args[1];
+    
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.numRows == 0)
+        return stateRight;
+    else if (stateRight.numRows == 0)
+        return stateLeft;
+    
+    // Merge states together and return
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the mini-batch incremental-gradient final step
+ *
+ * We apply the update of the last, partial batch.
+ */
+AnyType
+logregr_migd_step_final::run(AnyType &args) {
+    // We request a mutable object. Depending on the backend, this might perform
+    // a deep copy.
+    LogRegrMIGDTransitionState<MutableArrayHandle<double> > state = args[0];
+
+    // Aggregates that haven't seen any data just return Null.
+    if (state.numRows == 0)
+        return Null();
+
+    state.flushBatch();
+    if(!state.coef.is_finite())
+        throw NoSolutionFoundException("Over- or underflow in "
+            "incremental-gradient iteration. Input data is likely of poor "
+            "numerical condition.");
+    
+    return state;
+}
+
+/**
+ * @brief Return the norm of the average gradient (at the coefficients of the
+ *     previous iteration)
+ *
+ * Unlike the other methods, we do not compare two states: The gradient of the
+ * log-likelihood is 0 at the optimum, so its norm is a direct measure of
+ * convergence. Only the first argument is used.
+ */
+AnyType
+internal_logregr_migd_step_distance::run(AnyType &args) {
+    LogRegrMIGDTransitionState<ArrayHandle<double> > state = args[0];
+
+    return state.grad.norm() / static_cast<double>(state.numRows);
+}
+
+/**
+ * @brief Return the coefficients and diagnostic statistics of the state
+ *
+ * If \f$ X^T A X \f$ was not computed, standard errors, Wald statistics, and
+ * the condition number are NULL.
+ */
+AnyType
+internal_logregr_migd_result::run(AnyType &args) {
+    LogRegrMIGDTransitionState<ArrayHandle<double> > state = args[0];
+    
+    if (state.computeHessian) {
+        SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
+            state.X_transp_AX, EigenvaluesOnly, ComputePseudoInverse);
+        
+        return stateToResult(*this, state.coef,
+            decomposition.pseudoInverse().diagonal(), state.logLikelihood,
+            decomposition.conditionNo());
+    }
+
+    HandleMap<ColumnVector> coef(allocateArray<double>(state.widthOfX));
+    HandleMap<ColumnVector> oddsRatios(allocateArray<double>(state.widthOfX));
+    coef = state.coef;
+    for (Index i = 0; i < coef.size(); ++i)
+        oddsRatios(i) = std::exp( coef(i) );
+
+    AnyType tuple;
+    tuple << coef << static_cast<double>(state.logLikelihood) << Null()
+        << Null() << Null() << oddsRatios << Null();
+    return tuple;
+}
+
 /**
  * @brief Compute the diagnostic statistics
  *
@@ -9,6 +9,12 @@
  */
 DECLARE_UDF(regress, logregr_cg_step_transition)
 
+/**
+ * @brief Logistic regression (conjugate-gradient step): Transition function for
+ *     sparse rows
+ */
+DECLARE_UDF(regress, svec_logregr_cg_step_transition)
+
 /**
  * @brief Logistic regression (conjugate-gradient step): State merge function
  */
@@ -38,6 +44,12 @@ DECLARE_UDF(regress, internal_logregr_cg_result)
  */
 DECLARE_UDF(regress, logregr_irls_step_transition)
 
+/**
+ * @brief Logistic regression (iteratively-reweighted-lest-squares step): Transition function for
+ *     sparse rows
+ */
+DECLARE_UDF(regress, svec_logregr_irls_step_transition)
+
 /**
  * @brief Logistic regression (iteratively-reweighted-lest-squares step):
  *     State merge function
@@ -63,11 +75,49 @@ DECLARE_UDF(regress, internal_logregr_irls_step_distance)
 DECLARE_UDF(regress, internal_logregr_irls_result)
 
 
+/**
+ * @brief Logistic regression (IRLS step with reuse of the Hessian
+ *     factorization): Transition function
+ */
+DECLARE_UDF(regress, logregr_wirls_step_transition)
+
+/**
+ * @brief Logistic regression (IRLS step with reuse of the Hessian
+ *     factorization): State merge function
+ */
+DECLARE_UDF(regress, logregr_wirls_step_merge_states)
+
+/**
+ * @brief Logistic regression (IRLS step with reuse of the Hessian
+ *     factorization): Final function
+ */
+DECLARE_UDF(regress, logregr_wirls_step_final)
+
+/**
+ * @brief Logistic regression (IRLS step with reuse of the Hessian
+ *     factorization): Difference in log-likelihood between two transition
+ *     states
+ */
+DECLARE_UDF(regress, internal_logregr_wirls_step_distance)
+
+/**
+ * @brief Logistic regression (IRLS step with reuse of the Hessian
+ *     factorization): Convert transition state to result tuple
+ */
+DECLARE_UDF(regress, internal_logregr_wirls_result)
+
+
 /**
  * @brief Logistic regression (incremetal-gradient step): Transition function
  */
 DECLARE_UDF(regress, logregr_igd_step_transition)
 
+/**
+ * @brief Logistic regression (incremetal-gradient step): Transition function for
+ *     sparse rows
+ */
+DECLARE_UDF(regress, svec_logregr_igd_step_transition)
+
 /**
  * @brief Logistic regression (incremetal-gradient step): State merge function
  */
@@ -89,3 +139,34 @@ DECLARE_UDF(regress, internal_logregr_igd_step_distance)
  *     Convert transition state to result tuple
  */
 DECLARE_UDF(regress, internal_logregr_igd_result)
+
+
+/**
+ * @brief Logistic regression (mini-batch incremental-gradient step):
+ *     Transition function
+ */
+DECLARE_UDF(regress, logregr_migd_step_transition)
+
+/**
+ * @brief Logistic regression (mini-batch incremental-gradient step):
+ *     State merge function
+ */
+DECLARE_UDF(regress, logregr_migd_step_merge_states)
+
+/**
+ * @brief Logistic regression (mini-batch incremental-gradient step):
+ *     Final function
+ */
+DECLARE_UDF(regress, logregr_migd_step_final)
+
+/**
+ * @brief Logistic regression (mini-batch incremental-gradient step): Norm of
+ *     the average gradient
+ */
+DECLARE_UDF(regress, internal_logregr_migd_step_distance)
+
+/**
+ * @brief Logistic regression (mini-batch incremental-gradient step):
+ *     Convert transition state to result tuple
+ */
+DECLARE_UDF(regress, internal_logregr_migd_result)
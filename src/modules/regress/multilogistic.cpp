@@ -0,0 +1,387 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file multilogistic.cpp
+ *
+ * @brief Multinomial logistic-regression functions
+ *
+ * We implement the iteratively-reweighted-least-squares (Newton) method for
+ * all categories at once, so that each iteration is a single scan.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+
+#include "multilogistic.hpp"
+
+namespace madlib {
+
+// Use Eigen
+using namespace dbal::eigen_integration;
+
+namespace modules {
+
+// Import names from other MADlib modules
+using dbal::NoSolutionFoundException;
+
+namespace regress {
+
+// Internal functions (defined in logistic.cpp)
+AnyType stateToResult(const Allocator &inAllocator,
+    const HandleMap<const ColumnVector, TransparentHandle<double> > &coef,
+    const ColumnVector &diagonal_of_inverse_of_X_transp_AX,
+    double logLikelihood,
+    double conditionNo);
+
+/**
+ * @brief Inter- and intra-iteration state for iteratively-reweighted-least-
+ *        squares method for multinomial logistic regression
+ *
+ * With \f$ K \f$ categories and \f$ p \f$ independent variables, category 0 is
+ * the reference category, and the model has \f$ n = (K - 1) p \f$
+ * coefficients. They are stored category by category, i.e., the coefficients
+ * of category \f$ k \geq 1 \f$ are \f$ \boldsymbol c_k =
+ * (c_{(k-1)p + 1}, \dots, c_{kp}) \f$.
+ *
+ * The (negative) Hessian is block-structured: Block \f$ (k, l) \f$ is
+ * \f$ X^T A_{kl} X \f$ where \f$ A_{kl} \f$ is the diagonal matrix with
+ * entries \f$ \pi_{ik} (\delta_{kl} - \pi_{il}) \f$, and \f$ \pi_{ik} \f$ is
+ * the probability of category \f$ k \f$ for row \f$ i \f$. As usual, we only
+ * fill the lower triangular part.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length at least 4, and all elemenets are 0.
+ */
+template <class Handle>
+class MLogRegrIRLSTransitionState {
+    template <class OtherHandle>
+    friend class MLogRegrIRLSTransitionState;
+
+public:
+    MLogRegrIRLSTransitionState(const AnyType &inArray)
+        : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint16_t>(mStorage[0]),
+            static_cast<uint16_t>(mStorage[1]));
+    }
+
+    /**
+     * @brief Convert to backend representation
+     *
+     * We define this function so that we can use State in the
+     * argument list and as a return type.
+     */
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the iteratively-reweighted-least-squares state.
+     *
+     * This function is only called for the first row of each iteration.
+     */
+    inline void initialize(const Allocator &inAllocator, uint16_t inWidthOfX,
+        uint16_t inNumCategories) {
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(
+                arraySize(inWidthOfX, inNumCategories));
+        rebind(inWidthOfX, inNumCategories);
+        widthOfX = inWidthOfX;
+        numCategories = inNumCategories;
+    }
+
+    /**
+     * @brief We need to support assigning the previous state
+     */
+    template <class OtherHandle>
+    MLogRegrIRLSTransitionState &operator=(
+        const MLogRegrIRLSTransitionState<OtherHandle> &inOtherState) {
+
+        for (size_t i = 0; i < mStorage.size(); i++)
+            mStorage[i] = inOtherState.mStorage[i];
+        return *this;
+    }
+
+    /**
+     * @brief Merge with another State object by copying the intra-iteration
+     *     fields
+     */
+    template <class OtherHandle>
+    MLogRegrIRLSTransitionState &operator+=(
+        const MLogRegrIRLSTransitionState<OtherHandle> &inOtherState) {
+
+        if (mStorage.size() != inOtherState.mStorage.size() ||
+            widthOfX != inOtherState.widthOfX ||
+            numCategories != inOtherState.numCategories)
+            throw std::logic_error("Internal error: Incompatible transition "
+                "states");
+
+        numRows += inOtherState.numRows;
+        grad += inOtherState.grad;
+        X_transp_AX += inOtherState.X_transp_AX;
+        logLikelihood += inOtherState.logLikelihood;
+        return *this;
+    }
+
+    /**
+     * @brief Reset the inter-iteration fields.
+     */
+    inline void reset() {
+        numRows = 0;
+        grad.fill(0);
+        X_transp_AX.fill(0);
+        logLikelihood = 0;
+    }
+
+    /**
+     * @brief Number of coefficients
+     */
+    static inline uint32_t numCoef(const uint16_t inWidthOfX,
+        const uint16_t inNumCategories) {
+
+        return inNumCategories > 0
+            ? static_cast<uint32_t>(inWidthOfX) * (inNumCategories - 1)
+            : 0;
+    }
+
+private:
+    static inline uint64_t arraySize(const uint16_t inWidthOfX,
+        const uint16_t inNumCategories) {
+
+        uint64_t n = numCoef(inWidthOfX, inNumCategories);
+        return 4 + 2 * n + n * n;
+    }
+
+    /**
+     * @brief Rebind to a new storage array
+     *
+     * @param inWidthOfX The number of independent variables.
+     * @param inNumCategories The number of categories.
+     *
+     * Array layout (iteration refers to one aggregate-function call), where
+     * n = widthOfX * (numCategories - 1):
+     * Inter-iteration components (updated in final function):
+     * - 0: widthOfX (number of independent variables)
+     * - 1: numCategories (number of categories, including the reference
+     *      category 0)
+     * - 2: coef (vector of coefficients)
+     *
+     * Intra-iteration components (updated in transition step):
+     * - 2 + n: numRows (number of rows already processed in this iteration)
+     * - 3 + n: grad (gradient of the log-likelihood)
+     * - 3 + 2 * n: X_transp_AX (negative Hessian of the log-likelihood)
+     * - 3 + n^2 + 2 * n: logLikelihood ( ln(l(c)) )
+     */
+    void rebind(uint16_t inWidthOfX, uint16_t inNumCategories) {
+        size_t n = numCoef(inWidthOfX, inNumCategories);
+
+        widthOfX.rebind(&mStorage[0]);
+        numCategories.rebind(&mStorage[1]);
+        coef.rebind(&mStorage[2], n);
+        numRows.rebind(&mStorage[2 + n]);
+        grad.rebind(&mStorage[3 + n], n);
+        X_transp_AX.rebind(&mStorage[3 + 2 * n], n, n);
+        logLikelihood.rebind(&mStorage[3 + n * n + 2 * n]);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt16 widthOfX;
+    typename HandleTraits<Handle>::ReferenceToUInt16 numCategories;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap coef;
+
+    typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap grad;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap X_transp_AX;
+    typename HandleTraits<Handle>::ReferenceToDouble logLikelihood;
+};
+
+/**
+ * @brief Perform the multinomial logistic-regression transition step
+ *
+ * Arguments are the category (an integer between 0 and
+ * <tt>numCategories - 1</tt>), the independent variables, the number of
+ * categories, and the previous state.
+ *
+ * With linear predictors \f$ \eta_k = \boldsymbol c_k^T \boldsymbol x \f$ for
+ * \f$ k \geq 1 \f$ and \f$ \eta_0 = 0 \f$, the category probabilities are
+ * \f$ \pi_k = \exp(\eta_k - \mathit{lse}) \f$ where
+ * \f$ \mathit{lse} = \log \sum_{l=0}^{K-1} \exp(\eta_l) \f$. We compute the
+ * latter as \f$ m + \log \sum_l \exp(\eta_l - m) \f$ with
+ * \f$ m = \max_l \eta_l \f$, so that no term overflows.
+ */
+AnyType
+mlogregr_irls_step_transition::run(AnyType &args) {
+    MLogRegrIRLSTransitionState<MutableArrayHandle<double> > state = args[0];
+    int32_t y = args[1].getAs<int32_t>();
+    HandleMap<const ColumnVector> x = args[2].getAs<ArrayHandle<double> >();
+    int32_t numCategories = args[3].getAs<int32_t>();
+
+    // Non-finite input would propagate into the Hessian and, in turn, into
+    // the pseudo-inverse computed in the final function.
+    if (!x.is_finite())
+        throw std::domain_error("Design matrix is not finite.");
+    if (numCategories < 2
+        || numCategories > std::numeric_limits<uint16_t>::max())
+        throw std::domain_error("Number of categories must be at least 2 and "
+            "at most 65535.");
+    if (y < 0 || y >= numCategories)
+        throw std::domain_error("Dependent variable must be a category "
+            "between 0 and the number of categories minus 1.");
+
+    if (state.numRows == 0) {
+        if (x.size() > std::numeric_limits<uint16_t>::max()
+            || static_cast<uint64_t>(x.size()) * (numCategories - 1)
+                > std::numeric_limits<uint16_t>::max())
+            throw std::domain_error("Number of coefficients cannot be larger "
+                "than 65535.");
+
+        state.initialize(*this, x.size(), numCategories);
+        if (!args[4].isNull()) {
+            MLogRegrIRLSTransitionState<ArrayHandle<double> > previousState
+                = args[4];
+
+            state = previousState;
+            state.reset();
+        }
+    }
+    if (x.size() != state.widthOfX || numCategories != state.numCategories)
+        throw std::invalid_argument("Inconsistent number of independent "
+            "variables or categories.");
+
+    // Now do the transition step
+    state.numRows++;
+
+    const Index p = state.widthOfX;
+    const Index numNonRef = numCategories - 1;
+
+    // eta_k = c_k^T x, for all non-reference categories
+    ColumnVector eta(numNonRef);
+    for (Index k = 0; k < numNonRef; ++k)
+        eta(k) = dot(state.coef.segment(k * p, p), x);
+
+    double maxEta = std::max(0., eta.maxCoeff());
+    double sumExp = std::exp(-maxEta);
+    for (Index k = 0; k < numNonRef; ++k)
+        sumExp += std::exp(eta(k) - maxEta);
+    double logSumExp = maxEta + std::log(sumExp);
+
+    ColumnVector prob(numNonRef);
+    for (Index k = 0; k < numNonRef; ++k)
+        prob(k) = std::exp(eta(k) - logSumExp);
+
+    //          n
+    //         --
+    // l(c) =  \  eta_{y_i} - lse_i
+    //         /_
+    //         i=1
+    state.logLikelihood += (y > 0 ? eta(y - 1) : 0.) - logSumExp;
+
+    for (Index k = 0; k < numNonRef; ++k) {
+        // Gradient block k: (1[y = k] - pi_k) x
+        state.grad.segment(k * p, p)
+            += ((y == k + 1 ? 1. : 0.) - prob(k)) * x;
+
+        // Hessian blocks (k, l) with l <= k:
+        // pi_k (delta_kl - pi_l) x x^T
+        state.X_transp_AX.block(k * p, k * p, p, p)
+            .triangularView<Eigen::Lower>()
+            += (prob(k) * (1. - prob(k))) * x * trans(x);
+        for (Index l = 0; l < k; ++l)
+            state.X_transp_AX.block(k * p, l * p, p, p).noalias()
+                += (-prob(k) * prob(l)) * x * trans(x);
+    }
+
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+mlogregr_irls_step_merge_states::run(AnyType &args) {
+    MLogRegrIRLSTransitionState<MutableArrayHandle<double> > stateLeft
+        = args[0];
+    MLogRegrIRLSTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.numRows == 0)
+        return stateRight;
+    else if (stateRight.numRows == 0)
+        return stateLeft;
+
+    // Merge states together and return
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the multinomial logistic-regression final step
+ *
+ * We take the Newton step \f$ \boldsymbol c \gets \boldsymbol c +
+ * (X^T A X)^+ \nabla l(\boldsymbol c) \f$.
+ */
+AnyType
+mlogregr_irls_step_final::run(AnyType &args) {
+    // We request a mutable object. Depending on the backend, this might perform
+    // a deep copy.
+    MLogRegrIRLSTransitionState<MutableArrayHandle<double> > state = args[0];
+
+    // Aggregates that haven't seen any data just return Null.
+    if (state.numRows == 0)
+        return Null();
+
+    if (!state.X_transp_AX.is_finite() || !state.grad.is_finite())
+        throw NoSolutionFoundException("Over- or underflow in intermediate "
+            "calulation. Input data is likely of poor numerical condition.");
+
+    SymmetricPositiveDefiniteEigenDecomposition<Matrix> decomposition(
+        state.X_transp_AX, EigenvaluesOnly, ComputePseudoInverse);
+
+    // Precompute (X^T * A * X)^+
+    Matrix inverse_of_X_transp_AX = decomposition.pseudoInverse();
+
+    state.coef.noalias() += inverse_of_X_transp_AX * state.grad;
+    if (!state.coef.is_finite())
+        throw NoSolutionFoundException("Over- or underflow in Newton step, "
+            "while updating coefficients. Input data is likely of poor "
+            "numerical condition.");
+
+    // As in logregr_irls_step_final, we use the intra-iteration fields for
+    // storing the diagonal of (X^T A X)^+ and the condition number
+    state.grad = inverse_of_X_transp_AX.diagonal();
+    state.X_transp_AX(0,0) = decomposition.conditionNo();
+
+    return state;
+}
+
+/**
+ * @brief Return the difference in log-likelihood between two states
+ */
+AnyType
+internal_mlogregr_irls_step_distance::run(AnyType &args) {
+    MLogRegrIRLSTransitionState<ArrayHandle<double> > stateLeft = args[0];
+    MLogRegrIRLSTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    return std::abs(stateLeft.logLikelihood - stateRight.logLikelihood);
+}
+
+/**
+ * @brief Return the coefficients and diagnostic statistics of the state
+ */
+AnyType
+internal_mlogregr_irls_result::run(AnyType &args) {
+    MLogRegrIRLSTransitionState<ArrayHandle<double> > state = args[0];
+
+    return stateToResult(*this, state.coef,
+        state.grad, state.logLikelihood, state.X_transp_AX(0,0));
+}
+
+} // namespace regress
+
+} // namespace modules
+
+} // namespace madlib
@@ -7,4 +7,6 @@
  * -------------------------------------------------------------------------- */
 
 #include "linear.hpp"
+#include "grouped_linear.hpp"
 #include "logistic.hpp"
+#include "multilogistic.hpp"
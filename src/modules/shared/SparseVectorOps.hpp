@@ -0,0 +1,86 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file SparseVectorOps.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+namespace madlib {
+
+namespace modules {
+
+/**
+ * @brief Kernels for transition functions that take sparse rows
+ *
+ * Transition functions typically update dense state vectors and matrices with
+ * a row of the design matrix. If the row is an svec, all of the following
+ * functions only iterate over its non-zero elements. In particular, none of
+ * them densifies the row.
+ *
+ * Dense matrices are only updated in their lower triangular part, as is the
+ * convention for symmetric matrices in transition states.
+ *
+ * @see For an example usage, see linear.cpp.
+ */
+struct SparseVectorOps {
+    typedef dbal::eigen_integration::SparseColumnVector SparseColumnVector;
+
+    /**
+     * @brief Test whether all non-zero elements are finite
+     */
+    static bool isFinite(const SparseColumnVector &inX) {
+        for (SparseColumnVector::InnerIterator it(inX); it; ++it)
+            if (!std::isfinite(it.value()))
+                return false;
+        return true;
+    }
+
+    /**
+     * @brief Return \f$ \boldsymbol x^T \boldsymbol y \f$
+     */
+    template <class DenseVector>
+    static double dot(const SparseColumnVector &inX, const DenseVector &inY) {
+        double sum = 0;
+        for (SparseColumnVector::InnerIterator it(inX); it; ++it)
+            sum += it.value() * inY(it.index());
+        return sum;
+    }
+
+    /**
+     * @brief Perform \f$ \boldsymbol y \gets \boldsymbol y + a \boldsymbol x \f$
+     *
+     * Only the elements of \f$ \boldsymbol y \f$ at the non-zero positions of
+     * \f$ \boldsymbol x \f$ are touched.
+     */
+    template <class DenseVector>
+    static void addScaled(DenseVector &ioY, double inScale,
+        const SparseColumnVector &inX) {
+
+        for (SparseColumnVector::InnerIterator it(inX); it; ++it)
+            ioY(it.index()) += inScale * it.value();
+    }
+
+    /**
+     * @brief Perform \f$ A \gets A + a \boldsymbol x \boldsymbol x^T \f$ on the
+     *     lower triangular part of \f$ A \f$
+     *
+     * The cost is quadratic in the number of non-zero elements of
+     * \f$ \boldsymbol x \f$ (and independent of its dimension).
+     */
+    template <class DenseMatrix>
+    static void addScaledOuterProduct(DenseMatrix &ioA, double inScale,
+        const SparseColumnVector &inX) {
+
+        // Indices of inner iterators are increasing, so we can stop the inner
+        // loop at the diagonal
+        for (SparseColumnVector::InnerIterator row(inX); row; ++row) {
+            double scaledValue = inScale * row.value();
+            for (SparseColumnVector::InnerIterator col(inX);
+                col && col.index() <= row.index(); ++col)
+                ioA(row.index(), col.index()) += scaledValue * col.value();
+        }
+    }
+};
+
+} // namespace modules
+
+} // namespace madlib
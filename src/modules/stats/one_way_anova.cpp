@@ -9,7 +9,6 @@
 #include <dbconnector/dbconnector.hpp>
 #include <modules/shared/HandleTraits.hpp>
 #include <modules/prob/prob.hpp>
-#include <utils/Math.hpp>
 
 // We use string concatenation with the + operator
 #include <string>
@@ -28,6 +27,17 @@ namespace stats {
 /**
  * @brief Transition state for one-way ANOVA functions
  *
+ * Per-group statistics are stored in the order in which the groups were first
+ * seen, and an open-addressing hash table (with linear probing) maps each
+ * group value to its index. Adding a group is therefore amortized constant
+ * time, and merging two states is linear in the total number of groups.
+ *
+ * To the database, the state is exposed as a single DOUBLE PRECISION array:
+ * <tt>(numGroups, capacity, slots[capacity], groupValues[capacity/2],
+ * num[capacity/2], sum[capacity/2], corrected_square_sum[capacity/2])</tt>.
+ * A slot holds 1 + the index of its group, or 0 if it is empty. The capacity
+ * is 0 or a power of 2, and at most half of the slots are in use.
+ *
  * Note: We assume that the DOUBLE PRECISION array is initialized by the
  * database with length 2, and all elemenets are 0. Handle::operator[] will
  * perform bounds checking.
@@ -38,7 +48,7 @@ public:
     OWATransitionState(const AnyType &inArray)
       : mStorage(inArray.getAs<Handle>()) {
       
-        rebind(utils::nextPowerOfTwo(static_cast<uint16_t>(mStorage[0])));
+        rebind();
     }
     
     /**
@@ -52,117 +62,110 @@ public:
     }
     
     /**
-     * @brief Return the index (in the num, sum, and corrected_square_sum
-     *     fields) of a group value
+     * @brief Return the index (in the groupValues, num, sum, and
+     *     corrected_square_sum fields) of a group value, or -1 if there is no
+     *     such group
+     */
+    int64_t findGroup(int32_t inValue) const {
+        if (capacity == 0)
+            return -1;
+        
+        return static_cast<int64_t>(slots[slotOf(inValue)]) - 1;
+    }
+    
+    /**
+     * @brief Return the index of a group value, adding a new group if the
+     *     value is not found
      *
-     * If a value is not found, we add a new group to the transition state.
-     * Since we do not want to reallocate too often, we reserve some buffer
-     * space in the storage array. So we need to reallocate and copy memory only
-     * whenever the number of groups hits a power of 2.
+     * Whenever the load factor of the hash table would exceed 1/2, we
+     * reallocate the state with twice the capacity and rehash all groups.
      */
-    uint32_t idxOfGroup(const Allocator& inAllocator, uint16_t inValue);
+    uint32_t idxOfGroup(const Allocator& inAllocator, int32_t inValue) {
+        if (2 * (static_cast<uint64_t>(numGroups) + 1) > capacity)
+            grow(inAllocator);
+        
+        uint32_t slot = slotOf(inValue);
+        if (slots[slot] == 0) {
+            groupValues[numGroups] = inValue;
+            numGroups = numGroups + 1;
+            slots[slot] = numGroups;
+        }
+        return static_cast<uint32_t>(slots[slot]) - 1;
+    }
     
 private:
-    static inline size_t arraySize(uint16_t inNumGroupsReserved) {
-        return 1 + 5 * inNumGroupsReserved;
+    static inline size_t arraySize(uint32_t inCapacity) {
+        return 2 + 3 * static_cast<size_t>(inCapacity);
+    }
+    
+    /**
+     * @brief Return the slot that contains the given group value, or the
+     *     empty slot where it would be inserted
+     */
+    uint32_t slotOf(int32_t inValue) const {
+        // Multiplicative hashing. The capacity is a power of 2, so we keep the
+        // (better mixed) high bits.
+        uint64_t hash = static_cast<uint64_t>(static_cast<uint32_t>(inValue))
+            * 0x9E3779B97F4A7C15ULL;
+        uint32_t slot = static_cast<uint32_t>(hash >> 32) & (capacity - 1);
+        
+        while (slots[slot] != 0
+            && groupValues[static_cast<uint32_t>(slots[slot]) - 1] != inValue)
+            slot = (slot + 1) & (capacity - 1);
+        return slot;
     }
 
-    void rebind(uint16_t inNumGroupsReserved) {
-        madlib_assert(mStorage.size() >= arraySize(inNumGroupsReserved),
+    void rebind() {
+        numGroups.rebind(&mStorage[0]);
+        capacity.rebind(&mStorage[1]);
+        
+        madlib_assert(mStorage.size() >= arraySize(capacity),
             std::runtime_error("Out-of-bounds array access detected."));
         
-        numGroups.rebind(&mStorage[0]);
-        groupValues = &mStorage[1];
-        posToIndices = &mStorage[1 + inNumGroupsReserved];
-        num.rebind(&mStorage[1 + 2 * inNumGroupsReserved], inNumGroupsReserved);
-        sum.rebind(&mStorage[1 + 3 * inNumGroupsReserved], inNumGroupsReserved);
+        uint32_t numGroupsReserved = capacity / 2;
+        slots = mStorage.ptr() + 2;
+        groupValues = slots + capacity;
+        num.rebind(groupValues + numGroupsReserved, numGroupsReserved);
+        sum.rebind(groupValues + 2 * numGroupsReserved, numGroupsReserved);
         corrected_square_sum.rebind(
-            &mStorage[1 + 4 * inNumGroupsReserved], inNumGroupsReserved);
+            groupValues + 3 * numGroupsReserved, numGroupsReserved);
+    }
+    
+    void grow(const Allocator& inAllocator) {
+        OWATransitionState oldSelf = *this;
+        uint32_t newCapacity = oldSelf.capacity == 0 ? 16
+            : 2 * oldSelf.capacity;
+        
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(newCapacity));
+        mStorage[1] = newCapacity;
+        rebind();
+        
+        // The per-group statistics do not move relative to each other, so we
+        // only need to rebuild the hash table
+        uint32_t n = oldSelf.numGroups;
+        std::copy(oldSelf.groupValues, oldSelf.groupValues + n, groupValues);
+        num.segment(0, n) << oldSelf.num.segment(0, n);
+        sum.segment(0, n) << oldSelf.sum.segment(0, n);
+        corrected_square_sum.segment(0, n)
+            << oldSelf.corrected_square_sum.segment(0, n);
+        for (uint32_t idx = 0; idx < n; ++idx)
+            slots[slotOf(static_cast<int32_t>(groupValues[idx]))] = idx + 1;
+        numGroups = n;
     }
 
     Handle mStorage;
     
 public:
-    typename HandleTraits<Handle>::ReferenceToUInt16 numGroups;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numGroups;
+    typename HandleTraits<Handle>::ReferenceToUInt32 capacity;
+    typename HandleTraits<Handle>::DoublePtr slots;
     typename HandleTraits<Handle>::DoublePtr groupValues;
-    typename HandleTraits<Handle>::DoublePtr posToIndices;
     typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap num;
     typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap sum;
     typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap corrected_square_sum;
 };
 
-template <>
-uint32_t
-OWATransitionState<ArrayHandle<double> >::idxOfGroup(
-    const Allocator&, uint16_t inValue) {
-    
-    uint16_t pos = std::lower_bound(
-        groupValues, groupValues + numGroups, inValue) - groupValues;
-
-    if (pos >= numGroups || groupValues[pos] != inValue) {
-        // Did not find this group value. We have to start a new group.
-        throw std::runtime_error("Could not find a grouping value during "
-            "one-way ANOVA.");
-    }
-    return pos;
-}
-
-template <>
-uint32_t
-OWATransitionState<MutableArrayHandle<double> >::idxOfGroup(
-    const Allocator& inAllocator, uint16_t inValue) {
-    
-    // FIXME: Think of using proper iterators. Add some safety. Overflow checks.
-    // http://jira.madlib.net/browse/MADLIB-499
-    uint16_t pos = std::lower_bound(
-        groupValues, groupValues + numGroups, inValue) - groupValues;
-    
-    if (pos >= numGroups || groupValues[pos] != inValue) {
-        // Did not find this group value. We have to start a new group.
-        
-        uint16_t numGroupsReserved = utils::nextPowerOfTwo(
-            static_cast<uint16_t>(numGroups));
-        if (numGroupsReserved > numGroups) {
-            // We have enough reserve space allocated.
-            std::copy(groupValues + pos, groupValues + numGroups,
-                groupValues + pos + 1);
-            groupValues[pos] = inValue;
-            
-            std::copy(posToIndices + pos, posToIndices + numGroups,
-                posToIndices + pos + 1);
-            posToIndices[pos] = numGroups++;
-        } else {
-            // We need to reallocate storage for the transition state
-            // Save our current state, so we can subsequently restore it
-            // with the new storage
-            OWATransitionState oldSelf = *this;
-            if (numGroupsReserved == 0)
-                numGroupsReserved = 1;
-            else
-                numGroupsReserved *= 2;
-            mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
-                dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(numGroupsReserved));
-            rebind(numGroupsReserved);
-            
-            numGroups = oldSelf.numGroups + 1;
-            std::copy(oldSelf.groupValues, oldSelf.groupValues + pos, groupValues);
-            std::copy(oldSelf.groupValues + pos,
-                oldSelf.groupValues + oldSelf.numGroups, groupValues + pos + 1);
-            groupValues[pos] = inValue;
-            
-            std::copy(oldSelf.posToIndices, oldSelf.posToIndices + pos, posToIndices);
-            std::copy(oldSelf.posToIndices + pos,
-                oldSelf.posToIndices + oldSelf.numGroups, posToIndices + pos + 1);
-            posToIndices[pos] = oldSelf.numGroups;
-            
-            num.segment(0, oldSelf.numGroups) << oldSelf.num;
-            sum.segment(0, oldSelf.numGroups) << oldSelf.sum;
-            corrected_square_sum.segment(0, oldSelf.numGroups) << oldSelf.corrected_square_sum;
-        }
-    }
-    return posToIndices[pos];
-}
-
 // FIXME: Same function used for t_test. Factor out.
 // http://jira.madlib.net/browse/MADLIB-500
 /**
@@ -218,7 +221,7 @@ one_way_anova_transition::run(AnyType &args) {
     int32_t group = args[1].getAs<int32_t>();
     double value = args[2].getAs<double>();
     
-    int idx = state.idxOfGroup(*this, group);
+    uint32_t idx = state.idxOfGroup(*this, group);
     updateCorrectedSumOfSquares(
         state.num(idx), state.sum(idx), state.corrected_square_sum(idx),
         1, value, 0);
@@ -234,11 +237,11 @@ one_way_anova_merge_states::run(AnyType &args) {
     OWATransitionState<MutableArrayHandle<double> > stateLeft = args[0];
     OWATransitionState<ArrayHandle<double> > stateRight = args[1];
     
-    // Merge states together and return
-    for (int posRight = 0; posRight < stateRight.numGroups; posRight++) {
-        double value = stateRight.groupValues[posRight];
-        int idxRight = stateRight.idxOfGroup(*this, value);
-        int idxLeft = stateLeft.idxOfGroup(*this, value);
+    // Merge states together and return. The groups of the right state are
+    // visited in index order, so no lookup is needed on that side.
+    for (uint32_t idxRight = 0; idxRight < stateRight.numGroups; idxRight++) {
+        uint32_t idxLeft = stateLeft.idxOfGroup(*this,
+            static_cast<int32_t>(stateRight.groupValues[idxRight]));
         updateCorrectedSumOfSquares(
             stateLeft.num(idxLeft), stateLeft.sum(idxLeft),
                 stateLeft.corrected_square_sum(idxLeft),
@@ -265,7 +268,7 @@ one_way_anova_final::run(AnyType &args) {
     double grand_mean = state.sum.sum() / state.num.sum();
     double sum_squares_between = 0;
     
-    for (int idx = 0; idx < state.numGroups; idx++)
+    for (uint32_t idx = 0; idx < state.numGroups; idx++)
         sum_squares_between += state.num(idx)
                              * std::pow(state.sum(idx) / state.num(idx)
                                         - grand_mean, 2);
@@ -290,6 +293,76 @@ one_way_anova_final::run(AnyType &args) {
     return tuple;
 }
 
+/**
+ * @brief Extract the two-sample t-test state of two groups from a one-way
+ *     ANOVA state
+ *
+ * The one-way ANOVA state holds count, sum, and corrected sum of squares for
+ * every group, which is the union of the sufficient statistics of the t-tests,
+ * the F-test, and one-way ANOVA. The result has the layout of
+ * TTestTransitionState in t_test.cpp, so that the t-test and F-test final
+ * functions can be applied to it. Group \c group_y may be NULL (for the
+ * one-sample t-test). Missing groups contribute an empty sample.
+ */
+AnyType
+hypothesis_tests_two_sample_state::run(AnyType &args) {
+    if (args[0].isNull())
+        return Null();
+
+    OWATransitionState<ArrayHandle<double> > state = args[0];
+    MutableArrayHandle<double> result = allocateArray<double>(6);
+
+    for (int sample = 0; sample < 2; sample++) {
+        if (args[1 + sample].isNull())
+            continue;
+
+        int64_t idx = state.findGroup(args[1 + sample].getAs<int32_t>());
+        if (idx < 0)
+            continue;
+
+        result[3 * sample] = state.num(idx);
+        result[3 * sample + 1] = state.sum(idx);
+        result[3 * sample + 2] = state.corrected_square_sum(idx);
+    }
+    return result;
+}
+
+/**
+ * @brief Extract the chi-squared goodness-of-fit test state of the group sizes
+ *     from a one-way ANOVA state
+ *
+ * The observed counts are the group sizes, and the expected distribution is
+ * uniform over all groups that occur in the data. In A/B tests, this checks
+ * for a mismatch in the sample ratio. The result has the layout of
+ * Chi2TestTransitionState in chi_squared_test.cpp.
+ */
+AnyType
+hypothesis_tests_chi2_gof_state::run(AnyType &args) {
+    OWATransitionState<ArrayHandle<double> > state = args[0];
+    MutableArrayHandle<double> result = allocateArray<double>(7);
+
+    double numGroups = state.numGroups;
+    double meanCount = numGroups > 0 ? state.num.sum() / numGroups : 0;
+    double sumSquares = 0;
+    double correctedSumSquares = 0;
+    for (uint32_t idx = 0; idx < state.numGroups; idx++) {
+        sumSquares += state.num(idx) * state.num(idx);
+        correctedSumSquares += std::pow(state.num(idx) - meanCount, 2);
+    }
+
+    // With all expected counts equal to 1, the sum of squared deviations
+    // accumulated by chi2_gof_test_transition is
+    // \sum_{i<j} (o_i - o_j)^2 = k \sum_i (o_i - \bar o)^2
+    result[0] = numGroups;
+    result[1] = numGroups;
+    result[2] = sumSquares;
+    result[3] = state.num.sum();
+    result[4] = numGroups * correctedSumSquares;
+    result[5] = 1;
+    result[6] = -1;
+    return result;
+}
+
 } // namespace stats
 
 } // namespace modules
@@ -18,3 +18,15 @@ DECLARE_UDF(stats, one_way_anova_merge_states)
  * @brief One-way ANOVA: Final function
  */
 DECLARE_UDF(stats, one_way_anova_final)
+
+/**
+ * @brief Combined hypothesis tests: Extract the two-sample t-test state of
+ *     two groups
+ */
+DECLARE_UDF(stats, hypothesis_tests_two_sample_state)
+
+/**
+ * @brief Combined hypothesis tests: Extract the chi-squared goodness-of-fit
+ *     test state of the group sizes
+ */
+DECLARE_UDF(stats, hypothesis_tests_chi2_gof_state)
@@ -0,0 +1,491 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file rank_test_summary.cpp
+ *
+ * @brief Rank tests that do not need sorted input
+ *
+ * The Mann-Whitney, Wilcoxon-signed-rank, and Kolmogorov-Smirnov statistics
+ * only depend on the relative order of the values. Instead of requiring an
+ * ordered aggregate, we summarize each sample by the (sorted) multiset of its
+ * values. Summaries of different segments can be merged, and the final
+ * functions compute the statistics in one sweep over the merged summary.
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+#include <modules/prob/prob.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "rank_test_summary.hpp"
+
+namespace madlib {
+
+namespace modules {
+
+// Import names from other MADlib modules
+using prob::kolmogorovCDF;
+using prob::normalCDF;
+
+namespace stats {
+
+namespace {
+
+/**
+ * @brief A range of values together with its multiplicities in the two
+ *     samples
+ *
+ * Entries that have not been combined with other values consist of a single
+ * value, i.e., <tt>lower == upper</tt>.
+ */
+struct RankSummaryEntry {
+    double lower;
+    double upper;
+    double count[2];
+
+    bool operator<(const RankSummaryEntry &inOther) const {
+        return lower < inOther.lower;
+    }
+};
+
+typedef std::vector<RankSummaryEntry> RankSummaryEntries;
+
+/**
+ * @brief Default for the maximum number of distinct values in a summary
+ */
+const uint32_t kDefaultMaxSummarySize = 1024;
+
+/**
+ * @brief Sort entries and combine overlapping ranges. If more than inMaxSize
+ *     entries remain, also combine runs of neighboring entries.
+ *
+ * Up to inMaxSize distinct values, the summary is therefore exact. Beyond
+ * that, we combine neighbors greedily as long as the combined multiplicity is
+ * at most \f$ w := 2n / (\mathit{inMaxSize} - 1) \f$, where \f$ n \f$ is the
+ * total number of values. Any two consecutive buckets then have a combined
+ * multiplicity greater than \f$ w \f$, so there are less than inMaxSize
+ * buckets. The values of a bucket are treated as ties, so every rank is off
+ * by at most the multiplicity of its bucket.
+ *
+ * A bucket keeps the range of its values. A value that is added later and
+ * falls within this range joins the bucket, instead of being ordered before
+ * all of the bucket's values. Otherwise, rank errors would accumulate with
+ * every compaction of the transition state. A bucket may therefore grow
+ * beyond \f$ w \f$ if many later values fall within its range.
+ */
+void
+compactEntries(RankSummaryEntries &ioEntries, uint32_t inMaxSize) {
+    std::sort(ioEntries.begin(), ioEntries.end());
+
+    size_t numDistinct = 0;
+    double total = 0;
+    for (size_t i = 0; i < ioEntries.size(); i++) {
+        const RankSummaryEntry &entry = ioEntries[i];
+        total += entry.count[0] + entry.count[1];
+        if (numDistinct > 0
+            && entry.lower <= ioEntries[numDistinct - 1].upper) {
+
+            RankSummaryEntry &previous = ioEntries[numDistinct - 1];
+            previous.upper = std::max(previous.upper, entry.upper);
+            previous.count[0] += entry.count[0];
+            previous.count[1] += entry.count[1];
+        } else {
+            ioEntries[numDistinct++] = entry;
+        }
+    }
+    ioEntries.resize(numDistinct);
+    if (numDistinct <= inMaxSize)
+        return;
+
+    double maxWeight = 2. * total / (inMaxSize - 1);
+    size_t numBuckets = 0;
+    double bucketWeight = 0;
+    for (size_t i = 0; i < numDistinct; i++) {
+        const RankSummaryEntry &entry = ioEntries[i];
+        double weight = entry.count[0] + entry.count[1];
+        if (numBuckets > 0 && bucketWeight + weight <= maxWeight) {
+            RankSummaryEntry &bucket = ioEntries[numBuckets - 1];
+            bucket.upper = entry.upper;
+            bucket.count[0] += entry.count[0];
+            bucket.count[1] += entry.count[1];
+            bucketWeight += weight;
+        } else {
+            ioEntries[numBuckets++] = entry;
+            bucketWeight = weight;
+        }
+    }
+    ioEntries.resize(numBuckets);
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Transition state for rank summaries
+ *
+ * The state stores up to 2 * maxSize entries, each consisting of a range of
+ * values and its multiplicities in the first and second sample. Only a prefix of the
+ * entries is sorted. The transition function appends to the end, and whenever
+ * the state is full, we sort and compact it down to at most maxSize entries.
+ * The amortized cost per row is therefore logarithmic.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length 2, and all elemenets are 0. The actual storage is
+ * allocated by the first call of the transition function, when maxSize is
+ * known. Handle::operator[] will perform bounds checking.
+ */
+template <class Handle>
+class RankSummaryTransitionState {
+public:
+    RankSummaryTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint32_t>(mStorage[0]));
+    }
+
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Allocate the storage for at most inMaxSize compacted entries
+     */
+    void initialize(const Allocator &inAllocator, uint32_t inMaxSize) {
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(inMaxSize));
+        rebind(inMaxSize);
+        maxSize = inMaxSize;
+    }
+
+    /**
+     * @brief Append all entries to a vector
+     */
+    void getEntries(RankSummaryEntries &outEntries) const {
+        for (uint32_t i = 0; i < numEntries; i++) {
+            RankSummaryEntry entry;
+            entry.lower = lower[i];
+            entry.upper = upper[i];
+            entry.count[0] = counts[2 * i];
+            entry.count[1] = counts[2 * i + 1];
+            outEntries.push_back(entry);
+        }
+    }
+
+    /**
+     * @brief Replace all entries by at most 2 * maxSize new ones
+     */
+    void setEntries(const RankSummaryEntries &inEntries) {
+        madlib_assert(inEntries.size() <= 2 * static_cast<size_t>(maxSize),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        numEntries = static_cast<uint32_t>(inEntries.size());
+        for (uint32_t i = 0; i < numEntries; i++) {
+            lower[i] = inEntries[i].lower;
+            upper[i] = inEntries[i].upper;
+            counts[2 * i] = inEntries[i].count[0];
+            counts[2 * i + 1] = inEntries[i].count[1];
+        }
+    }
+
+    /**
+     * @brief Sort and compact the entries
+     */
+    void compact() {
+        RankSummaryEntries entries;
+        getEntries(entries);
+        compactEntries(entries, maxSize);
+        setEntries(entries);
+    }
+
+    /**
+     * @brief Add a value to a sample
+     */
+    void insert(double inValue, int inSample) {
+        if (numEntries >= 2 * maxSize)
+            compact();
+
+        uint32_t i = numEntries;
+        lower[i] = inValue;
+        upper[i] = inValue;
+        counts[2 * i] = inSample == 0 ? 1 : 0;
+        counts[2 * i + 1] = inSample == 0 ? 0 : 1;
+        numEntries = i + 1;
+    }
+
+private:
+    static inline size_t arraySize(uint32_t inMaxSize) {
+        return 2 + 8 * static_cast<size_t>(inMaxSize);
+    }
+
+    void rebind(uint32_t inMaxSize) {
+        madlib_assert(mStorage.size() >= arraySize(inMaxSize),
+            std::runtime_error("Out-of-bounds array access detected."));
+
+        maxSize.rebind(&mStorage[0]);
+        numEntries.rebind(&mStorage[1]);
+        lower = &mStorage[2];
+        upper = &mStorage[2 + 2 * static_cast<size_t>(inMaxSize)];
+        counts = &mStorage[2 + 4 * static_cast<size_t>(inMaxSize)];
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt32 maxSize;
+    typename HandleTraits<Handle>::ReferenceToUInt32 numEntries;
+    typename HandleTraits<Handle>::DoublePtr lower;
+    typename HandleTraits<Handle>::DoublePtr upper;
+    typename HandleTraits<Handle>::DoublePtr counts;
+};
+
+namespace {
+
+/**
+ * @brief Insert a value into a rank summary, allocating it on first use
+ */
+void
+insertIntoRankSummary(const Allocator &inAllocator,
+    RankSummaryTransitionState<MutableArrayHandle<double> > &ioState,
+    double inValue, int inSample, const AnyType &inMaxSizeArg) {
+
+    if (ioState.maxSize == 0) {
+        int32_t maxSize = inMaxSizeArg.isNull()
+            ? static_cast<int32_t>(kDefaultMaxSummarySize)
+            : inMaxSizeArg.getAs<int32_t>();
+        if (maxSize < 2)
+            throw std::invalid_argument("Maximum summary size must be at "
+                "least 2.");
+        ioState.initialize(inAllocator, static_cast<uint32_t>(maxSize));
+    }
+    ioState.insert(inValue, inSample);
+}
+
+/**
+ * @brief Return the sorted and compacted entries of a rank summary
+ */
+RankSummaryEntries
+finalEntries(const RankSummaryTransitionState<ArrayHandle<double> > &inState) {
+    RankSummaryEntries entries;
+    inState.getEntries(entries);
+    if (!entries.empty())
+        compactEntries(entries, inState.maxSize);
+    return entries;
+}
+
+/**
+ * @brief Compute sample sizes, rank sums, and the tie correction of the
+ *     variance
+ *
+ * Ties receive the average rank. For each group of \f$ t \f$ ties, the tie
+ * correction is \f$ (t^3 - t)/48 \f$, as in wsr_test_transition.
+ */
+void
+rankSums(const RankSummaryEntries &inEntries, Eigen::Vector2d &outNum,
+    Eigen::Vector2d &outRankSum, double &outReduceVariance) {
+
+    outNum.setZero();
+    outRankSum.setZero();
+    outReduceVariance = 0;
+
+    double rank = 0;
+    for (size_t i = 0; i < inEntries.size(); i++) {
+        const RankSummaryEntry &entry = inEntries[i];
+        double t = entry.count[0] + entry.count[1];
+        double averageRank = rank + (t + 1.) / 2.;
+        for (int sample = 0; sample <= 1; sample++) {
+            outNum(sample) += entry.count[sample];
+            outRankSum(sample) += entry.count[sample] * averageRank;
+        }
+        outReduceVariance += (t * t * t - t) / 48.;
+        rank += t;
+    }
+}
+
+} // anonymous namespace
+
+/**
+ * @brief Perform the rank-summary transition step for two samples
+ */
+AnyType
+rank_summary_transition::run(AnyType &args) {
+    RankSummaryTransitionState<MutableArrayHandle<double> > state = args[0];
+    int sample = args[1].getAs<bool>() ? 0 : 1;
+    double value = args[2].getAs<double>();
+
+    insertIntoRankSummary(*this, state, value, sample,
+        args.numFields() >= 4 ? args[3] : Null());
+    return state;
+}
+
+/**
+ * @brief Perform the rank-summary transition step for the Wilcoxon-Signed-Rank
+ *     test
+ *
+ * We summarize absolute values. Index 0 refers to the positive values and
+ * index 1 refers to the negative values. Values of zero are ignored.
+ */
+AnyType
+wsr_rank_summary_transition::run(AnyType &args) {
+    RankSummaryTransitionState<MutableArrayHandle<double> > state = args[0];
+    double value = args[1].getAs<double>();
+
+    if (value == 0)
+        return state;
+
+    insertIntoRankSummary(*this, state, std::fabs(value), value > 0 ? 0 : 1,
+        args.numFields() >= 3 ? args[2] : Null());
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+rank_summary_merge_states::run(AnyType &args) {
+    RankSummaryTransitionState<MutableArrayHandle<double> > stateLeft = args[0];
+    RankSummaryTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.numEntries == 0)
+        return stateRight;
+    else if (stateRight.numEntries == 0)
+        return stateLeft;
+
+    // Each side holds up to 2 * maxSize entries, because states are only
+    // compacted once full. Compacting the union leaves at most maxSize
+    // entries, which fit into the left state.
+    RankSummaryEntries entries;
+    stateLeft.getEntries(entries);
+    stateRight.getEntries(entries);
+    compactEntries(entries, stateLeft.maxSize);
+    stateLeft.setEntries(entries);
+
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the Mann-Whitney-test final step on a rank summary
+ *
+ * The result is the same as the one of mw_test_final.
+ */
+AnyType
+mw_test_rank_summary_final::run(AnyType &args) {
+    RankSummaryTransitionState<ArrayHandle<double> > state = args[0];
+
+    Eigen::Vector2d num;
+    Eigen::Vector2d rankSum;
+    double reduceVariance;
+    rankSums(finalEntries(state), num, rankSum, reduceVariance);
+
+    // If we haven't seen any data, just return Null. This is the standard
+    // behavior of aggregate function on empty data sets (compare, e.g.,
+    // how PostgreSQL handles sum or avg on empty inputs)
+    if (num(0) == 0 || num(1) == 0)
+        return Null();
+
+    Eigen::Vector2d U;
+    double numProd = num.prod();
+
+    U(0) = rankSum(1) - num(1) * (num(1) + 1.) / 2.;
+    U(1) = numProd - U(0);
+
+    double u_statistic = U.minCoeff();
+    double z_statistic = (u_statistic - (numProd / 2.))
+                       / (std::sqrt( numProd * (num.sum() + 1) / 12. ));
+
+    AnyType tuple;
+    tuple
+        << z_statistic
+        << u_statistic
+        << 1. - normalCDF(z_statistic)
+        << 2. * (1. - normalCDF(std::fabs(z_statistic)));
+    return tuple;
+}
+
+/**
+ * @brief Perform the Wilcoxon-Signed-Rank-test final step on a rank summary
+ *
+ * The result is the same as the one of wsr_test_final, except that ties are
+ * determined by exact equality of the absolute values.
+ */
+AnyType
+wsr_test_rank_summary_final::run(AnyType &args) {
+    RankSummaryTransitionState<ArrayHandle<double> > state = args[0];
+
+    Eigen::Vector2d num;
+    Eigen::Vector2d rankSum;
+    double reduceVariance;
+    rankSums(finalEntries(state), num, rankSum, reduceVariance);
+
+    if (num.sum() == 0)
+        return Null();
+
+    double n_n1 = num.sum() * (num.sum() + 1);
+    double statistic = rankSum.minCoeff();
+    double z_statistic = (rankSum(0) - n_n1 / 4.)
+                       / std::sqrt(n_n1 * (2 * num.sum() + 1.) / 24.
+                            - reduceVariance);
+
+    AnyType tuple;
+    tuple
+        << statistic
+        << rankSum(0)
+        << rankSum(1)
+        << static_cast<int64_t>(num.sum())
+        << z_statistic
+        << 1. - normalCDF(z_statistic)
+        << 2. * (1. - normalCDF(std::fabs(z_statistic)));
+    return tuple;
+}
+
+/**
+ * @brief Perform the Kolmogorov-Smirnov-test final step on a rank summary
+ *
+ * The result is the same as the one of ks_test_final. The sample sizes are
+ * taken from the data and need not be specified in advance.
+ */
+AnyType
+ks_test_rank_summary_final::run(AnyType &args) {
+    RankSummaryTransitionState<ArrayHandle<double> > state = args[0];
+    RankSummaryEntries entries = finalEntries(state);
+
+    Eigen::Vector2d num = Eigen::Vector2d::Zero();
+    for (size_t i = 0; i < entries.size(); i++)
+        for (int sample = 0; sample <= 1; sample++)
+            num(sample) += entries[i].count[sample];
+
+    if (num(0) == 0 || num(1) == 0)
+        return Null();
+
+    // The difference of the empirical distribution functions only changes at
+    // the values in the summary
+    Eigen::Vector2d cumulative = Eigen::Vector2d::Zero();
+    double maxDiff = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        for (int sample = 0; sample <= 1; sample++)
+            cumulative(sample) += entries[i].count[sample];
+
+        double diff = std::fabs(cumulative(0) / num(0)
+                        - cumulative(1) / num(1));
+        if (maxDiff < diff)
+            maxDiff = diff;
+    }
+
+    double root = std::sqrt(num.prod() / num.sum());
+    double kolmogorov_statistic = (root + 0.12 + 0.11 / root) * maxDiff;
+
+    AnyType tuple;
+    tuple
+        << maxDiff // The Kolmogorov-Smirnov statistic
+        << kolmogorov_statistic
+        << 1. - kolmogorovCDF( kolmogorov_statistic );
+    return tuple;
+}
+
+} // namespace stats
+
+} // namespace modules
+
+} // namespace madlib
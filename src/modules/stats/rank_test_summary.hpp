@@ -0,0 +1,35 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file rank_test_summary.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Rank summary of two samples: Transition function
+ */
+DECLARE_UDF(stats, rank_summary_transition)
+
+/**
+ * @brief Rank summary of the signs of absolute values: Transition function
+ */
+DECLARE_UDF(stats, wsr_rank_summary_transition)
+
+/**
+ * @brief Rank summary: State merge function
+ */
+DECLARE_UDF(stats, rank_summary_merge_states)
+
+/**
+ * @brief Mann-Whitney U Test on a rank summary: Final function
+ */
+DECLARE_UDF(stats, mw_test_rank_summary_final)
+
+/**
+ * @brief Wilcoxon-Signed-Rank Test on a rank summary: Final function
+ */
+DECLARE_UDF(stats, wsr_test_rank_summary_final)
+
+/**
+ * @brief Kolmogorov-Smirnov Test on a rank summary: Final function
+ */
+DECLARE_UDF(stats, ks_test_rank_summary_final)
@@ -10,5 +10,6 @@
 #include "kolmogorov_smirnov_test.hpp"
 #include "mann_whitney_test.hpp"
 #include "one_way_anova.hpp"
+#include "rank_test_summary.hpp"
 #include "t_test.hpp"
 #include "wilcoxon_signed_rank_test.hpp"
@@ -0,0 +1,250 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file als.cpp
+ *
+ * @brief Alternating-least-squares functions for matrix factorization
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+#include <modules/shared/HandleTraits.hpp>
+
+#include "als.hpp"
+
+namespace madlib {
+
+// Use Eigen
+using namespace dbal::eigen_integration;
+
+namespace modules {
+
+namespace svd_mf {
+
+/**
+ * @brief Transition state for one alternating-least-squares step
+ *
+ * One ALS step computes the factor row \f$ \boldsymbol x \f$ of a single
+ * matrix row (or column) while keeping the other factor matrix fixed. This is
+ * a ridge regression of the observed values \f$ y_i \f$ on the fixed factor
+ * rows \f$ \boldsymbol f_i \f$, so we accumulate the normal equations
+ * \f$ F^T F \f$ and \f$ F^T \boldsymbol y \f$.
+ *
+ * Note: We assume that the DOUBLE PRECISION array is initialized by the
+ * database with length at least 6, and all elemenets are 0.
+ */
+template <class Handle>
+class ALSTransitionState {
+    template <class OtherHandle>
+    friend class ALSTransitionState;
+
+public:
+    ALSTransitionState(const AnyType &inArray)
+      : mStorage(inArray.getAs<Handle>()) {
+
+        rebind(static_cast<uint16_t>(mStorage[1]));
+    }
+
+    /**
+     * @brief Convert to backend representation
+     *
+     * We define this function so that we can use TransitionState in the argument
+     * list and as a return type.
+     */
+    inline operator AnyType() const {
+        return mStorage;
+    }
+
+    /**
+     * @brief Initialize the transition state. Only called for first row.
+     *
+     * @param inAllocator Allocator for the memory transition state. Must fill
+     *     the memory block with zeros.
+     * @param inNumFeatures Number of features, i.e., the rank of the
+     *     factorization
+     */
+    inline void initialize(const Allocator &inAllocator,
+        uint16_t inNumFeatures) {
+
+        mStorage = inAllocator.allocateArray<double, dbal::AggregateContext,
+            dbal::DoZero, dbal::ThrowBadAlloc>(arraySize(inNumFeatures));
+        rebind(inNumFeatures);
+        numFeatures = inNumFeatures;
+    }
+
+    /**
+     * @brief Merge with another TransitionState object
+     */
+    template <class OtherHandle>
+    ALSTransitionState &operator+=(
+        const ALSTransitionState<OtherHandle> &inOtherState) {
+
+        if (mStorage.size() != inOtherState.mStorage.size()
+            || numFeatures != inOtherState.numFeatures)
+            throw std::logic_error("Internal error: Incompatible transition "
+                "states");
+
+        numRows += inOtherState.numRows;
+        y_square_sum += inOtherState.y_square_sum;
+        F_transp_Y += inOtherState.F_transp_Y;
+        F_transp_F += inOtherState.F_transp_F;
+        return *this;
+    }
+
+private:
+    static inline size_t arraySize(const uint16_t inNumFeatures) {
+        return 4 + inNumFeatures + inNumFeatures % 2
+            + inNumFeatures * inNumFeatures;
+    }
+
+    /**
+     * @brief Rebind to a new storage array
+     *
+     * @param inNumFeatures The number of features
+     *
+     * Array layout:
+     * - 0: numRows (number of observed values seen so far)
+     * - 1: numFeatures (rank of the factorization)
+     * - 2: lambda (regularization parameter)
+     * - 3: y_square_sum (sum of squares of observed values seen so far)
+     * - 4: F_transp_Y (F^T y, for that parts of F and y seen so far)
+     * - 4 + numFeatures + numFeatures % 2: (F^T F, as seen so far)
+     *
+     * Note that we want 16-byte alignment for all vectors and matrices. We
+     * therefore ensure that F_transp_Y and F_transp_F begin at even positions.
+     */
+    void rebind(uint16_t inNumFeatures) {
+        numRows.rebind(&mStorage[0]);
+        numFeatures.rebind(&mStorage[1]);
+        lambda.rebind(&mStorage[2]);
+        y_square_sum.rebind(&mStorage[3]);
+        F_transp_Y.rebind(&mStorage[4], inNumFeatures);
+        F_transp_F.rebind(&mStorage[4 + inNumFeatures + (inNumFeatures % 2)],
+            inNumFeatures, inNumFeatures);
+    }
+
+    Handle mStorage;
+
+public:
+    typename HandleTraits<Handle>::ReferenceToUInt64 numRows;
+    typename HandleTraits<Handle>::ReferenceToUInt16 numFeatures;
+    typename HandleTraits<Handle>::ReferenceToDouble lambda;
+    typename HandleTraits<Handle>::ReferenceToDouble y_square_sum;
+    typename HandleTraits<Handle>::ColumnVectorTransparentHandleMap F_transp_Y;
+    typename HandleTraits<Handle>::MatrixTransparentHandleMap F_transp_F;
+};
+
+/**
+ * @brief Perform the alternating-least-squares transition step
+ *
+ * Arguments are the observed value, the (fixed) factor row of the other
+ * dimension, and the regularization parameter.
+ */
+AnyType
+als_step_transition::run(AnyType &args) {
+    ALSTransitionState<MutableArrayHandle<double> > state = args[0];
+    double y = args[1].getAs<double>();
+    HandleMap<const ColumnVector> f = args[2].getAs<ArrayHandle<double> >();
+    double lambda = args[3].getAs<double>();
+
+    if (!std::isfinite(y))
+        throw std::domain_error("Matrix values are not finite.");
+    else if (!isfinite(f))
+        throw std::domain_error("Factor matrix is not finite.");
+
+    if (state.numRows == 0) {
+        if (f.size() == 0)
+            throw std::domain_error("Factor rows must not be empty.");
+        if (f.size() > std::numeric_limits<uint16_t>::max())
+            throw std::domain_error("Number of features cannot be larger "
+                "than 65535.");
+        if (lambda < 0)
+            throw std::domain_error("Regularization parameter must not be "
+                "negative.");
+
+        state.initialize(*this, f.size());
+        state.lambda = lambda;
+    } else if (f.size() != state.numFeatures)
+        throw std::invalid_argument("Factor rows have inconsistent lengths.");
+
+    state.numRows++;
+    state.y_square_sum += y * y;
+    state.F_transp_Y.noalias() += f * y;
+    // F^T F is symmetric, so it is sufficient to only fill a triangular part
+    // of the matrix
+    triangularView<Lower>(state.F_transp_F) += f * trans(f);
+
+    return state;
+}
+
+/**
+ * @brief Perform the perliminary aggregation function: Merge transition states
+ */
+AnyType
+als_step_merge_states::run(AnyType &args) {
+    ALSTransitionState<MutableArrayHandle<double> > stateLeft = args[0];
+    ALSTransitionState<ArrayHandle<double> > stateRight = args[1];
+
+    // We first handle the trivial case where this function is called with one
+    // of the states being the initial state
+    if (stateLeft.numRows == 0)
+        return stateRight;
+    else if (stateRight.numRows == 0)
+        return stateLeft;
+
+    // Merge states together and return
+    stateLeft += stateRight;
+    return stateLeft;
+}
+
+/**
+ * @brief Perform the alternating-least-squares final step
+ *
+ * We solve the regularized normal equations
+ * \f$ (F^T F + \lambda n I) \boldsymbol x = F^T \boldsymbol y \f$, where the
+ * regularization is weighted by the number \f$ n \f$ of observed values
+ * (Zhou et al., 2008). Since the matrix is symmetric positive definite for
+ * \f$ \lambda > 0 \f$, a Cholesky-type (LDL^T) decomposition suffices.
+ *
+ * Returns the new factor row and the residual sum of squares
+ * \f$ \| \boldsymbol y - F \boldsymbol x \|^2 \f$, so that no additional scan
+ * is necessary to monitor convergence.
+ */
+AnyType
+als_step_final::run(AnyType &args) {
+    ALSTransitionState<ArrayHandle<double> > state = args[0];
+
+    // If we haven't seen any data, just return Null. This is the standard
+    // behavior of aggregate function on empty data sets (compare, e.g.,
+    // how PostgreSQL handles sum or avg on empty inputs)
+    if (state.numRows == 0)
+        return Null();
+
+    if (!isfinite(state.F_transp_F) || !isfinite(state.F_transp_Y))
+        throw std::domain_error("Factor matrix is not finite.");
+
+    // Only the lower triangular part of F^T F is filled, which is exactly
+    // what LDLT reads
+    Matrix A = state.F_transp_F;
+    A.diagonal().array() += state.lambda * static_cast<double>(state.numRows);
+
+    HandleMap<ColumnVector> factor(allocateArray<double>(state.numFeatures));
+    factor = Eigen::LDLT<Matrix>(A).solve(state.F_transp_Y);
+
+    // ||y - F x||^2 = y^T y - 2 x^T F^T y + x^T F^T F x
+    ColumnVector F_transp_F_x
+        = state.F_transp_F.selfadjointView<Eigen::Lower>() * factor;
+    double residualSumSquares = state.y_square_sum
+        - 2 * dot(factor, state.F_transp_Y) + dot(factor, F_transp_F_x);
+
+    AnyType tuple;
+    tuple
+        << factor
+        << std::max(residualSumSquares, 0.);
+    return tuple;
+}
+
+} // namespace svd_mf
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,20 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file als.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Alternating least squares: Transition function
+ */
+DECLARE_UDF(svd_mf, als_step_transition)
+
+/**
+ * @brief Alternating least squares: State merge function
+ */
+DECLARE_UDF(svd_mf, als_step_merge_states)
+
+/**
+ * @brief Alternating least squares: Final function
+ */
+DECLARE_UDF(svd_mf, als_step_final)
@@ -0,0 +1,9 @@
+/* -----------------------------------------------------------------------------
+ *
+ * @file svd_mf.hpp
+ *
+ * @brief Umbrella header that includes all matrix-factorization headers
+ *
+ * -------------------------------------------------------------------------- */
+
+#include "als.hpp"
@@ -0,0 +1,72 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file allocator_check.cpp
+ *
+ * @brief Self-check of the memory allocation of the C++ AL
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#include <dbconnector/dbconnector.hpp>
+
+#include "allocator_check.hpp"
+
+namespace madlib {
+
+// Use Eigen
+using namespace dbal::eigen_integration;
+
+namespace modules {
+
+namespace utilities {
+
+/**
+ * @brief Allocate, reallocate and free temporaries, and call itself recursively
+ *
+ * Arguments are the remaining recursion depth, the number of iterations, and
+ * the function itself. In each iteration, we free two temporaries of
+ * different size in the order of allocation (i.e., not in LIFO order), and we
+ * grow a vector by one element, which reallocates its memory. The vector is
+ * kept alive across the nested call, and it is grown further afterwards.
+ *
+ * @return The sum of all elements seen, which is
+ *     \f$ (d + 1) \sum_{i=1}^n \big( (i \bmod 7) + 1 + i \big) \f$ for depth
+ *     \f$ d \f$ and \f$ n \f$ iterations. Any other value indicates that
+ *     memory was corrupted.
+ */
+AnyType
+allocator_check::run(AnyType &args) {
+    int32_t depth = args[0].getAs<int32_t>();
+    int32_t iterations = args[1].getAs<int32_t>();
+    FunctionHandle self = args[2].getAs<FunctionHandle>();
+
+    if (depth < 0 || iterations < 0)
+        throw std::invalid_argument("Depth and number of iterations must be "
+            "non-negative.");
+
+    double sum = 0;
+    ColumnVector grown(1);
+    grown(0) = 0;
+    for (int32_t i = 1; i <= iterations; ++i) {
+        ColumnVector* first = new ColumnVector(
+            ColumnVector::Constant(i % 100 + 1, 1.));
+        ColumnVector* second = new ColumnVector(
+            ColumnVector::Constant(i % 7 + 1, 1.));
+        delete first;
+        sum += second->sum();
+        delete second;
+
+        if (depth > 0 && i == (iterations + 1) / 2)
+            sum += self(depth - 1, iterations, self).getAs<double>();
+
+        grown.conservativeResize(i + 1);
+        grown(i) = i;
+    }
+
+    return sum + grown.sum();
+}
+
+} // namespace utilities
+
+} // namespace modules
+
+} // namespace madlib
@@ -0,0 +1,10 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file allocator_check.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+/**
+ * @brief Exercise the memory allocation of the C++ AL (for install checks)
+ */
+DECLARE_UDF(utilities, allocator_check)
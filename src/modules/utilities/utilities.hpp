@@ -0,0 +1,9 @@
+/* -----------------------------------------------------------------------------
+ *
+ * @file utilities.hpp
+ *
+ * @brief Umbrella header that includes all utility headers
+ *
+ * -------------------------------------------------------------------------- */
+
+#include "allocator_check.hpp"
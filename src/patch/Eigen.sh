@@ -14,7 +14,7 @@ patch -N -p1 <<'EOF'
    void *result;
 -  #if !EIGEN_ALIGN
 +  #if 1
-+    result = madlib::defaultAllocator().allocate<madlib::dbal::FunctionContext, madlib::dbal::DoNotZero, madlib::dbal::ThrowBadAlloc>(size);
++    result = madlib::defaultAllocator().allocate<madlib::dbal::ArenaContext, madlib::dbal::DoNotZero, madlib::dbal::ThrowBadAlloc>(size);
 +  #elif !EIGEN_ALIGN
      result = std::malloc(size);
    #elif EIGEN_MALLOC_ALREADY_ALIGNED
@@ -25,7 +25,7 @@ patch -N -p1 <<'EOF'
  {
 -  #if !EIGEN_ALIGN
 +  #if 1
-+    madlib::defaultAllocator().free<madlib::dbal::FunctionContext>(ptr);
++    madlib::defaultAllocator().free<madlib::dbal::ArenaContext>(ptr);
 +  #elif !EIGEN_ALIGN
      std::free(ptr);
    #elif EIGEN_MALLOC_ALREADY_ALIGNED
@@ -36,7 +36,7 @@ patch -N -p1 <<'EOF'
    void *result;
 -#if !EIGEN_ALIGN
 +#if 1
-+  result = madlib::defaultAllocator().reallocate<madlib::dbal::FunctionContext, madlib::dbal::DoNotZero, madlib::dbal::ThrowBadAlloc>(ptr, new_size);
++  result = madlib::defaultAllocator().reallocate<madlib::dbal::ArenaContext, madlib::dbal::DoNotZero, madlib::dbal::ThrowBadAlloc>(ptr, new_size);
 +#elif !EIGEN_ALIGN
    result = std::realloc(ptr,new_size);
  #elif EIGEN_MALLOC_ALREADY_ALIGNED
@@ -46,7 +46,7 @@ patch -N -p1 <<'EOF'
    check_that_malloc_is_allowed();
  
 -  void *result = std::malloc(size);
-+  void *result = madlib::defaultAllocator().allocate<madlib::dbal::FunctionContext, madlib::dbal::DoNotZero, madlib::dbal::ThrowBadAlloc>(size);
++  void *result = madlib::defaultAllocator().allocate<madlib::dbal::ArenaContext, madlib::dbal::DoNotZero, madlib::dbal::ThrowBadAlloc>(size);
    #ifdef EIGEN_EXCEPTIONS
      if(!result) throw std::bad_alloc();
    #endif
@@ -55,7 +55,7 @@ patch -N -p1 <<'EOF'
  template<> inline void conditional_aligned_free<false>(void *ptr)
  {
 -  std::free(ptr);
-+  madlib::defaultAllocator().free<madlib::dbal::FunctionContext>(ptr);
++  madlib::defaultAllocator().free<madlib::dbal::ArenaContext>(ptr);
  }
  
  template<bool Align> inline void* conditional_aligned_realloc(void* ptr, size_t new_size, size_t old_size)
@@ -64,7 +64,7 @@ patch -N -p1 <<'EOF'
  template<> inline void* conditional_aligned_realloc<false>(void* ptr, size_t new_size, size_t)
  {
 -  return std::realloc(ptr, new_size);
-+  return madlib::defaultAllocator().reallocate<madlib::dbal::FunctionContext, madlib::dbal::DoNotZero, madlib::dbal::ThrowBadAlloc>(ptr, new_size);
++  return madlib::defaultAllocator().reallocate<madlib::dbal::ArenaContext, madlib::dbal::DoNotZero, madlib::dbal::ThrowBadAlloc>(ptr, new_size);
  }
  
  /*****************************************************************************
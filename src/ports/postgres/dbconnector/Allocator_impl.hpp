@@ -73,12 +73,27 @@ Allocator::allocateArray(size_t inNumElements) const {
  * @return The address of a 16-byte aligned block of memory large enough to hold
  *     \c inSize bytes. On all supported platforms, 16-byte alignment is enough
  *     for any arbitrary operation.
+ *
+ * With <tt>MC == dbal::ArenaContext</tt>, the memory is taken from the arena
+ * of the current UDF invocation (see Arena) and must not outlive it. It may
+ * only be reallocated or freed with <tt>MC == dbal::ArenaContext</tt>.
  */
 template <dbal::MemoryContext MC, dbal::ZeroMemory ZM,
     dbal::OnMemoryAllocationFailure F>
 inline
 void *
 Allocator::allocate(size_t inSize) const {
+    if (MC == dbal::ArenaContext) {
+        void *ptr = Arena::allocate(inSize);
+        if (ptr == NULL) {
+            if (F == dbal::ThrowBadAlloc)
+                throw std::bad_alloc();
+            return NULL;
+        }
+        if (ZM == dbal::DoZero)
+            std::memset(ptr, 0, inSize);
+        return ptr;
+    }
     return internalAllocate<MC, ZM, F, NewAllocation>(NULL, inSize);
 }
 
@@ -101,6 +116,15 @@ template <dbal::MemoryContext MC, dbal::ZeroMemory ZM,
 inline
 void *
 Allocator::reallocate(void *inPtr, const size_t inSize) const {
+    if (MC == dbal::ArenaContext) {
+        if (inPtr == NULL)
+            return allocate<MC, ZM, F>(inSize);
+
+        void *ptr = Arena::reallocate(inPtr, inSize);
+        if (ptr == NULL && F == dbal::ThrowBadAlloc)
+            throw std::bad_alloc();
+        return ptr;
+    }
     return internalAllocate<MC, ZM, F, Reallocation>(inPtr, inSize);
 }
 
@@ -131,6 +155,11 @@ void
 Allocator::free(void *inPtr) const {
     if (inPtr == NULL)
         return;
+    
+    if (MC == dbal::ArenaContext) {
+        Arena::free(inPtr);
+        return;
+    }
         
     /*
      * See allocate(const size_t, const std::nothrow_t&) why we disable
@@ -331,6 +360,13 @@ Allocator::internalAllocate(void *inPtr, const size_t inSize) const {
                                           : internalPalloc<ZM>(inSize);
                 MemoryContextSwitchTo(oldContext);
             }
+        } else if (MC == dbal::CacheContext) {
+            // Same lifetime as the cached system-catalog information for this
+            // function, i.e., typically until the end of the current query
+            oldContext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+            ptr = (R == Reallocation) ? internalRePalloc<ZM>(inPtr, inSize)
+                                      : internalPalloc<ZM>(inSize);
+            MemoryContextSwitchTo(oldContext);
         } else {
             ptr = R ? internalRePalloc<ZM>(inPtr, inSize)
                     : internalPalloc<ZM>(inSize);
@@ -0,0 +1,271 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file Arena_impl.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_POSTGRES_ARENA_IMPL_HPP
+#define MADLIB_POSTGRES_ARENA_IMPL_HPP
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+/**
+ * @brief The innermost arena, or NULL if we are not within a call into the
+ *     C++ AL
+ */
+inline
+Arena*&
+Arena::current() {
+    static Arena* sCurrent = NULL;
+    return sCurrent;
+}
+
+/**
+ * @brief Return the arena that a chunk of memory was allocated from
+ *
+ * This is the arena of an enclosing call if the chunk was allocated there.
+ * NULL if the chunk was allocated from the function context.
+ */
+inline
+Arena*
+Arena::owner(const void *inPtr) {
+    return header(inPtr)->info.arena;
+}
+
+/**
+ * @brief Initialize the arena and make it the current one
+ */
+inline
+void
+Arena::enter() {
+    mBlocks = NULL;
+    mFree = NULL;
+    mEnd = NULL;
+    std::fill(mFreeLists, mFreeLists + kNumSizeClasses,
+        static_cast<void*>(NULL));
+    mBlockSize = kInitialBlockSize;
+    mTotalSize = 0;
+    mParent = current();
+    current() = this;
+}
+
+/**
+ * @brief Release all memory of the arena and restore the previous arena
+ *
+ * Chunks that fell back to the function context are left to the backend.
+ * Never throws.
+ */
+inline
+void
+Arena::leave() {
+    current() = mParent;
+
+    BlockHeader* block = mBlocks;
+    while (block != NULL) {
+        BlockHeader* next = block->info.next;
+        defaultAllocator().free<dbal::FunctionContext>(block);
+        block = next;
+    }
+    mBlocks = NULL;
+    mFree = NULL;
+    mEnd = NULL;
+    std::fill(mFreeLists, mFreeLists + kNumSizeClasses,
+        static_cast<void*>(NULL));
+}
+
+/**
+ * @brief Allocate a 16-byte aligned chunk of memory from the current arena
+ *
+ * @return NULL if the backend could not provide the memory. Never throws.
+ */
+inline
+void *
+Arena::allocate(size_t inSize) {
+    Arena* arena = current();
+    void* ptr = arena ? arena->allocateChunk(inSize) : NULL;
+    return ptr ? ptr : allocateFallback(inSize);
+}
+
+/**
+ * @brief Change the size of a chunk of memory returned by allocate()
+ *
+ * If the capacity of the chunk suffices, the chunk is returned unchanged.
+ * Otherwise, we allocate a new chunk from the same arena as the old one (so
+ * that the lifetime does not change), copy the old contents and free the old
+ * chunk. Chunks of the function context are resized by the backend.
+ *
+ * @return NULL if no memory could be allocated, in which case the old chunk
+ *     is left untouched. Never throws.
+ */
+inline
+void *
+Arena::reallocate(void *inPtr, size_t inSize) {
+    ChunkHeader* chunk = header(inPtr);
+    Arena* arena = chunk->info.arena;
+
+    if (arena == NULL) {
+        if (inSize > std::numeric_limits<size_t>::max() - sizeof(ChunkHeader))
+            return NULL;
+
+        chunk = static_cast<ChunkHeader*>(
+            defaultAllocator().reallocate<dbal::FunctionContext,
+                dbal::DoNotZero, dbal::ReturnNULL>(chunk,
+                    sizeof(ChunkHeader) + inSize));
+        if (chunk == NULL)
+            return NULL;
+        chunk->info.capacity = inSize;
+        return chunk + 1;
+    }
+
+    if (inSize <= chunk->info.capacity)
+        return inPtr;
+
+    void* ptr = arena->allocateChunk(inSize);
+    if (ptr == NULL)
+        ptr = allocateFallback(inSize);
+    if (ptr == NULL)
+        return NULL;
+
+    std::memcpy(ptr, inPtr, chunk->info.capacity);
+    free(inPtr);
+    return ptr;
+}
+
+/**
+ * @brief Deallocate a chunk of memory returned by allocate() or reallocate()
+ *
+ * Arena chunks are put on the free list of their owner. Never throws.
+ */
+inline
+void
+Arena::free(void *inPtr) {
+    ChunkHeader* chunk = header(inPtr);
+    Arena* arena = chunk->info.arena;
+
+    if (arena == NULL) {
+        defaultAllocator().free<dbal::FunctionContext>(chunk);
+        return;
+    }
+
+    void*& freeList = arena->mFreeLists[sizeClass(chunk->info.capacity)];
+    *static_cast<void**>(inPtr) = freeList;
+    freeList = inPtr;
+}
+
+/**
+ * @brief Return the smallest size class with capacity of at least inSize
+ *
+ * Precondition: <tt>inSize <= kMaxChunkSize</tt>
+ */
+inline
+unsigned int
+Arena::sizeClass(size_t inSize) {
+    unsigned int sizeClass = 0;
+    for (size_t capacity = kMinChunkSize; capacity < inSize; capacity *= 2)
+        ++sizeClass;
+    return sizeClass;
+}
+
+inline
+Arena::ChunkHeader*
+Arena::header(const void *inPtr) {
+    return const_cast<ChunkHeader*>(
+        static_cast<const ChunkHeader*>(inPtr) - 1);
+}
+
+/**
+ * @brief Allocate a chunk of memory from the function context
+ *
+ * @return NULL if the backend could not provide the memory. Never throws.
+ */
+inline
+void *
+Arena::allocateFallback(size_t inSize) {
+    if (inSize > std::numeric_limits<size_t>::max() - sizeof(ChunkHeader))
+        return NULL;
+
+    ChunkHeader* chunk = static_cast<ChunkHeader*>(
+        defaultAllocator().allocate<dbal::FunctionContext, dbal::DoNotZero,
+            dbal::ReturnNULL>(sizeof(ChunkHeader) + inSize));
+    if (chunk == NULL)
+        return NULL;
+
+    chunk->info.arena = NULL;
+    chunk->info.capacity = inSize;
+    return chunk + 1;
+}
+
+/**
+ * @brief Allocate a chunk of memory from this arena
+ *
+ * @return NULL if the request is larger than kMaxChunkSize or if the arena
+ *     has reached its maximum size. Never throws.
+ */
+inline
+void *
+Arena::allocateChunk(size_t inSize) {
+    if (inSize > kMaxChunkSize)
+        return NULL;
+
+    unsigned int sizeClass = Arena::sizeClass(inSize);
+    void*& freeList = mFreeLists[sizeClass];
+    if (freeList != NULL) {
+        void* ptr = freeList;
+        freeList = *static_cast<void**>(ptr);
+        return ptr;
+    }
+
+    size_t capacity = kMinChunkSize << sizeClass;
+    size_t size = sizeof(ChunkHeader) + capacity;
+    if (static_cast<size_t>(mEnd - mFree) < size && !newBlock(size))
+        return NULL;
+
+    ChunkHeader* chunk = reinterpret_cast<ChunkHeader*>(mFree);
+    chunk->info.arena = this;
+    chunk->info.capacity = capacity;
+    mFree += size;
+    return chunk + 1;
+}
+
+/**
+ * @brief Start a new block that can hold at least inMinSize bytes
+ *
+ * The remainder of the previous block is abandoned. Never throws.
+ *
+ * @return false if the arena has reached its maximum size or if the backend
+ *     could not provide the memory
+ */
+inline
+bool
+Arena::newBlock(size_t inMinSize) {
+    size_t size = std::max(mBlockSize, inMinSize);
+    if (mTotalSize + size > kMaxSize)
+        return false;
+
+    BlockHeader* block = static_cast<BlockHeader*>(
+        defaultAllocator().allocate<dbal::FunctionContext, dbal::DoNotZero,
+            dbal::ReturnNULL>(sizeof(BlockHeader) + size));
+    if (block == NULL)
+        return false;
+
+    block->info.next = mBlocks;
+    mBlocks = block;
+    mFree = reinterpret_cast<char*>(block + 1);
+    mEnd = mFree + size;
+    mTotalSize += size;
+    if (mBlockSize < kMaxBlockSize)
+        mBlockSize *= 2;
+    return true;
+}
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_POSTGRES_ARENA_IMPL_HPP)
@@ -0,0 +1,123 @@
+/* ----------------------------------------------------------------------- *//**
+ *
+ * @file Arena_proto.hpp
+ *
+ *//* ----------------------------------------------------------------------- */
+
+#ifndef MADLIB_POSTGRES_ARENA_PROTO_HPP
+#define MADLIB_POSTGRES_ARENA_PROTO_HPP
+
+namespace madlib {
+
+namespace dbconnector {
+
+namespace postgres {
+
+/**
+ * @brief Arena for the temporaries of one UDF invocation
+ *
+ * UDF::call() makes an arena current for the duration of each call into the
+ * C++ AL. Allocations with <tt>dbal::ArenaContext</tt> (this includes
+ * <tt>operator new</tt> and all Eigen temporaries) are then served from
+ * power-of-two size classes: A freed chunk is put on the free list of its
+ * size class and reused by the next allocation of that class; otherwise, we
+ * increment a pointer into a block of memory. All blocks are released in bulk
+ * when the call returns.
+ *
+ * Each chunk is preceded by a ChunkHeader that records the owning arena and
+ * the capacity of the chunk, so that free() and reallocate() take constant
+ * time. This is also true for the memory of enclosing calls (e.g., when an
+ * object is deleted within a nested call through a FunctionHandle).
+ *
+ * Requests larger than kMaxChunkSize, requests when no arena is current, and
+ * requests after the arena has reached its maximum size fall back to
+ * <tt>dbal::FunctionContext</tt>. These chunks carry the same header (with a
+ * NULL owner). Memory from allocate() must therefore never be returned to the
+ * backend directly.
+ *
+ * An Arena object contains only plain old data and has no destructor, so that
+ * it can live on the stack of UDF::call() (which ends in a longjmp in case of
+ * an error). The caller is responsible for calling leave().
+ */
+class Arena {
+public:
+    /**
+     * Size of the first block. Each subsequent block is twice as large as its
+     * predecessor, up to kMaxBlockSize.
+     */
+    static const size_t kInitialBlockSize = 8 * 1024;
+    static const size_t kMaxBlockSize = 1024 * 1024;
+    
+    /**
+     * Once the arena has grown to this size, further allocations fall back
+     * to the function context.
+     */
+    static const size_t kMaxSize = 64 * 1024 * 1024;
+
+    /**
+     * Capacities of the size classes are kMinChunkSize, 2 * kMinChunkSize,
+     * ..., kMaxChunkSize
+     */
+    static const size_t kMinChunkSize = 16;
+    static const size_t kMaxChunkSize = 64 * 1024;
+    static const unsigned int kNumSizeClasses = 13;
+
+    void enter();
+    void leave();
+    
+    static void *allocate(size_t inSize);
+    static void *reallocate(void *inPtr, size_t inSize);
+    static void free(void *inPtr);
+    
+    static Arena*& current();
+    static Arena* owner(const void *inPtr);
+
+protected:
+    /**
+     * @brief Header in front of each block of memory
+     *
+     * Padded to 16 bytes, so that the block data is 16-byte aligned.
+     */
+    union BlockHeader {
+        struct {
+            BlockHeader* next;
+        } info;
+        char padding[16];
+    };
+
+    /**
+     * @brief Header in front of each chunk returned by allocate()
+     *
+     * Padded to 16 bytes, so that the chunk data is 16-byte aligned. While a
+     * chunk is on a free list, its first word points to the next free chunk.
+     */
+    union ChunkHeader {
+        struct {
+            Arena* arena;
+            size_t capacity;
+        } info;
+        char padding[16];
+    };
+
+    static unsigned int sizeClass(size_t inSize);
+    static ChunkHeader* header(const void *inPtr);
+    static void *allocateFallback(size_t inSize);
+    void *allocateChunk(size_t inSize);
+    bool newBlock(size_t inMinSize);
+
+    BlockHeader* mBlocks;
+    char* mFree;
+    char* mEnd;
+    void* mFreeLists[kNumSizeClasses];
+    size_t mBlockSize;
+    size_t mTotalSize;
+    Arena* mParent;
+};
+
+} // namespace postgres
+
+} // namespace dbconnector
+
+} // namespace madlib
+
+#endif // defined(MADLIB_POSTGRES_ARENA_PROTO_HPP)
@@ -88,7 +88,7 @@ FunctionHandle::invoke(AnyType &args) {
     
     MemoryContext oldContext = NULL;
     MemoryContext callContext = NULL;
-    if (mFuncCallOptions | GarbageCollectionAfterCall) {
+    if (mFuncCallOptions & GarbageCollectionAfterCall) {
         // In order to do garbage collection, we need to create a new
         // memory context
         callContext = AllocSetContextCreate(CurrentMemoryContext,
@@ -112,7 +112,9 @@ FunctionHandle::invoke(AnyType &args) {
         MemoryContextSwitchTo(oldContext);
         TypeInformation* typeInfo
             = mSysInfo->typeInformation(mFuncInfo->rettype);
-        result = datumCopy(result, typeInfo->isByValue(), typeInfo->getLen());
+        if (!funcPtrCallInfo.isnull)
+            result = datumCopy(result, typeInfo->isByValue(),
+                typeInfo->getLen());
         MemoryContextDelete(callContext);
     }
     
@@ -9,6 +9,9 @@
  * memory leaks.
  * See header file \c <new> and §18.4.1 of the C++ Standard.
  *
+ * Within a call into the C++ AL, memory comes from the arena of the current
+ * invocation (see Arena), which is released in bulk when the call returns.
+ *
  * @note
  *     This is merely a precaution. C++ objects should still be properly
  *     deallocated. We still make the promise to user code that all destructors
@@ -46,7 +49,7 @@
 void*
 operator new(std::size_t size) throw (std::bad_alloc) {
     return madlib::defaultAllocator().allocate<
-        madlib::dbal::FunctionContext,
+        madlib::dbal::ArenaContext,
         madlib::dbal::DoNotZero,
         madlib::dbal::ThrowBadAlloc>(size);
 }
@@ -61,7 +64,7 @@ operator new(std::size_t size) throw (std::bad_alloc) {
  */
 void
 operator delete(void *ptr) throw() {
-    madlib::defaultAllocator().free<madlib::dbal::FunctionContext>(ptr);
+    madlib::defaultAllocator().free<madlib::dbal::ArenaContext>(ptr);
 }
 
 /**
@@ -74,7 +77,7 @@ operator delete(void *ptr) throw() {
 void*
 operator new(std::size_t size, const std::nothrow_t&) throw() {
     return madlib::defaultAllocator().allocate<
-        madlib::dbal::FunctionContext,
+        madlib::dbal::ArenaContext,
         madlib::dbal::DoNotZero,
         madlib::dbal::ReturnNULL>(size);
 }
@@ -87,5 +90,5 @@ operator new(std::size_t size, const std::nothrow_t&) throw() {
  */
 void
 operator delete(void *ptr, const std::nothrow_t&) throw() {
-    madlib::defaultAllocator().free<madlib::dbal::FunctionContext>(ptr);
+    madlib::defaultAllocator().free<madlib::dbal::ArenaContext>(ptr);
 }
@@ -220,6 +220,7 @@ SystemInformation::functionInformation(Oid inFuncID) {
             // BACKEND: GETSTRUCT is just a macro
             pgFunc = reinterpret_cast<Form_pg_proc>(GETSTRUCT(tup));
             cachedFuncInfo->cxx_func = NULL;
+            cachedFuncInfo->userCache = NULL;
             cachedFuncInfo->flinfo.fn_oid = InvalidOid;
             // The number of arguments (excluding OUT params)
             cachedFuncInfo->nargs = pgFunc->proargtypes.dim1;
@@ -88,6 +88,15 @@ struct FunctionInformation {
      */
     UDF::Pointer cxx_func;
     
+    /**
+     * Data that a C++ AL function wants to keep across calls within the
+     * same query, e.g., a lookup table built from arguments that are
+     * constant for the whole query. NULL until set by the function (see
+     * UDF::userCache()). It must be allocated in dbal::CacheContext, and we
+     * rely on the PostgreSQL garbage collection for cleanup.
+     */
+    void* userCache;
+    
     /**
      * Holds system-catalog information that must be looked up before a
      * function can be called through fmgr. We store it here, because the
@@ -36,6 +36,49 @@ UDF::invoke(FunctionCallInfo fcinfo, AnyType& args) {
     return Function(fcinfo).run(args);
 }
 
+/**
+ * @brief Per-query storage for user data of the current function
+ *
+ * The returned pointer is NULL on the first call of the function within a
+ * query. Whatever it is set to is seen by all subsequent calls of the same
+ * function in the same query. The pointed-to memory has to be allocated in
+ * dbal::CacheContext.
+ */
+inline
+void*&
+UDF::userCache() {
+    return SystemInformation::get(fcinfo)
+        ->functionInformation(fcinfo->flinfo->fn_oid)->userCache;
+}
+
+/**
+ * @brief Whether an argument has the same value for all calls of the current
+ *     function within a query
+ *
+ * This is the case if the argument expression is a constant or a parameter.
+ * The latter includes the result of an uncorrelated subquery (an InitPlan).
+ * Everything else, in particular column references, is conservatively
+ * considered unstable. The check is O(1) and only inspects the parse tree,
+ * so callers typically do it once per query and keep the result in
+ * userCache().
+ */
+inline
+bool
+UDF::isArgumentStable(uint16_t inArgNo) const {
+    // BACKEND: All of the following are macros or simple list accessors that
+    // do not raise errors for valid indices, so no PG_TRY() is needed.
+    Node* expr = fcinfo->flinfo->fn_expr;
+    if (expr == NULL || !IsA(expr, FuncExpr))
+        return false;
+
+    List* args = reinterpret_cast<FuncExpr*>(expr)->args;
+    if (static_cast<int>(inArgNo) >= list_length(args))
+        return false;
+
+    Node* arg = static_cast<Node*>(list_nth(args, inArgNo));
+    return IsA(arg, Const) || IsA(arg, Param);
+}
+
 /**
  * @brief Each exported C function calls this method (and nothing else)
  */
@@ -45,6 +88,13 @@ Datum
 UDF::call(FunctionCallInfo fcinfo) {
     int sqlerrcode;
     char msg[2048];
+    
+    // All temporaries of this invocation (in particular, those of Eigen and
+    // operator new) are allocated from an arena that we release in bulk
+    // before returning. The arena must still be alive in the catch handlers
+    // below, because exception messages may be allocated from it.
+    Arena arena;
+    arena.enter();
 
     try {
         // We want to store in the cache that this function is implemented on
@@ -54,13 +104,23 @@ UDF::call(FunctionCallInfo fcinfo) {
             ->functionInformation(fcinfo->flinfo->fn_oid)->cxx_func
             = invoke<Function>;
 
-        AnyType args(fcinfo);
-        AnyType result = invoke<Function>(fcinfo, args);
+        bool isNull;
+        Datum datum = 0;
+        {
+            // All C++ objects have to be destroyed before the arena is left
+            AnyType args(fcinfo);
+            AnyType result = invoke<Function>(fcinfo, args);
+
+            isNull = result.isNull();
+            if (!isNull)
+                datum = result.getAsDatum(fcinfo);
+        }
+        arena.leave();
 
-        if (result.isNull())
+        if (isNull)
             PG_RETURN_NULL();
         
-        return result.getAsDatum(fcinfo);
+        return datum;
     } catch (std::bad_alloc &) {
         sqlerrcode = ERRCODE_OUT_OF_MEMORY;
         strncpy(msg,
@@ -93,6 +153,7 @@ UDF::call(FunctionCallInfo fcinfo) {
     // This code will only be reached in case of error.
     // We want to ereport only here, with only POD (plain old data) left on the
     // stack. (ereport will do a longjmp)
+    arena.leave();
     msg[sizeof(msg) - 1] = '\0';
     ereport (
         ERROR, (
@@ -29,6 +29,10 @@ public:
     template <class Function>
     static AnyType invoke(FunctionCallInfo fcinfo, AnyType& args);
 
+protected:
+    void*& userCache();
+    bool isArgumentStable(uint16_t inArgNo) const;
+
 private:
     OutputStreamBuffer<INFO> mOutStreamBuffer;
     OutputStreamBuffer<WARNING> mErrStreamBuffer;
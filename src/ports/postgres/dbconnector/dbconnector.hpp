@@ -166,6 +166,7 @@ madlib ## _ ## _pgfunc _arglist { \
 #include <utils/Reference.hpp>
 
 #include "Allocator_proto.hpp"
+#include "Arena_proto.hpp"
 #include "ArrayHandle_proto.hpp"
 #include "AnyType_proto.hpp"
 #include "FunctionHandle_proto.hpp"
@@ -227,6 +228,7 @@ struct DefaultHandle<EigenType, false> {
 
 #include "TypeTraits.hpp"
 #include "Allocator_impl.hpp"
+#include "Arena_impl.hpp"
 #include "AnyType_impl.hpp"
 #include "ArrayHandle_impl.hpp"
 #include "FunctionHandle_impl.hpp"